@@ -1,37 +1,71 @@
-#-------------------------------------------------
-#
-# Project created by QtCreator 2015-01-15T10:07:59
-#
-#-------------------------------------------------
-
-QT += core gui widgets opengl serialport
-
-CONFIG += c++17
-QMAKE_CXXFLAGS += -std=c++17
-
-#greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
-
-TARGET = iNEMO-Calibration
-
-TEMPLATE = app
-
-SOURCES += main.cpp\
-    mainwindow.cpp \
-    renderer.cpp \
-    serialthread.cpp \
-    Render/staticmesh.cpp \
-    Render/pointcloud.cpp \
-    Render/axes.cpp \
-    Render/types.cpp
-
-HEADERS  += mainwindow.h \
-    renderer.h \
-    serialthread.h \
-    Render/staticmesh.h \
-    Render/pointcloud.h \
-    Render/axes.h \
-    Render/types.h
-
-FORMS    += mainwindow.ui
-
-RESOURCES += Render/data.qrc
+#-------------------------------------------------
+#
+# Project created by QtCreator 2015-01-15T10:07:59
+#
+#-------------------------------------------------
+
+QT += core gui widgets serialport concurrent
+
+CONFIG += c++17
+QMAKE_CXXFLAGS += -std=c++17
+
+#greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+TARGET = iNEMO-Calibration
+
+TEMPLATE = app
+
+SOURCES += main.cpp\
+    mainwindow.cpp \
+    renderer.cpp \
+    serialthread.cpp \
+    devicemanager.cpp \
+    binaryprotocol.cpp \
+    samplering.cpp \
+    latency.cpp \
+    streamrecorder.cpp \
+    telemetrydecoder.cpp \
+    batchfit.cpp \
+    fitpreview.cpp \
+    gyrocalibrator.cpp \
+    sensorfusion.cpp \
+    batchfusion.cpp \
+    Render/staticmesh.cpp \
+    Render/pointcloud.cpp \
+    Render/axes.cpp \
+    Render/types.cpp \
+    Render/ellipsoid.cpp \
+    Render/moments.cpp \
+    Render/coverage.cpp \
+    Render/renderobject.cpp \
+    Render/viewset.cpp \
+    Render/wireframe.cpp
+
+HEADERS  += mainwindow.h \
+    renderer.h \
+    serialthread.h \
+    devicemanager.h \
+    binaryprotocol.h \
+    samplering.h \
+    latency.h \
+    streamrecorder.h \
+    telemetrydecoder.h \
+    batchfit.h \
+    fitpreview.h \
+    gyrocalibrator.h \
+    sensorfusion.h \
+    batchfusion.h \
+    Render/staticmesh.h \
+    Render/pointcloud.h \
+    Render/axes.h \
+    Render/types.h \
+    Render/ellipsoid.h \
+    Render/moments.h \
+    Render/coverage.h \
+    Render/renderobject.h \
+    Render/viewset.h \
+    Render/wireframe.h
+
+FORMS    += mainwindow.ui
+
+RESOURCES += Render/data.qrc
@@ -1,95 +1,109 @@
-#include "axes.h"
-
-#include <stdint.h>
-
-
-
-struct PointType {
-    float x, y, z;
-    uint8_t r, g, b, a;
-
-    PointType(float _1, float _2, float _3, int _4, int _5, int _6, int _7){
-        x = _1;
-        y = _2;
-        z = _3;
-        r = _4;
-        g = _5;
-        b = _6;
-        a = _7;
-    }
-};
-
-static const PointType points[] = {
-    PointType(-10.0f, 0.0f, 0.0f, 255,0,0,255),
-    PointType(+10.0f, 0.0f, 0.0f, 255,0,0,255),
-    PointType(0.0f, -10.0f, 0.0f, 0,255,0,255),
-    PointType(0.0f, +10.0f, 0.0f, 0,255,0,255),
-    PointType(0.0f, 0.0f, -10.0f, 0,0,255,255),
-    PointType(0.0f, 0.0f, +10.0f, 0,0,255,255)
-};
-
-static const char* vertex =
-    "#version 330\n"
-    "uniform mat4 proj_view_model_matrix;\n"
-    "in vec4 a_position;\n"
-    "in vec4 a_color;\n"
-    "out vec4 v_color;\n"
-    "void main() { v_color = a_color; gl_Position = proj_view_model_matrix * a_position; }\n";
-
-static const char* fragment =
-    "#version 330\n"
-    "in vec4 v_color;\n"
-    "void main() { gl_FragColor = v_color; }\n";
-
-
-
-///
-/// \brief Constructor.
-///
-Axes::Axes()
-{
-    initializeGLFunctions();
-
-    glGenBuffers(1, &m_buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
-    glBufferData(GL_ARRAY_BUFFER, 6 * sizeof(PointType), points, GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-    if (!m_shader.addShaderFromSourceCode(QGLShader::Vertex, vertex)) throw "wtf";
-    if (!m_shader.addShaderFromSourceCode(QGLShader::Fragment, fragment)) throw "wtf";
-    if (!m_shader.link()) throw "wtf";
-}
-
-
-
-///
-/// \brief Destructor.
-///
-Axes::~Axes()
-{
-    glDeleteBuffers(1, &m_buffer);
-}
-
-
-
-///
-/// \brief Renderiza los ejes de coordenadas.
-///
-void Axes::render(const QMatrix4x4& pvmMatrix)
-{
-    glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
-
-    m_shader.bind();
-    m_shader.setUniformValue("proj_view_model_matrix", pvmMatrix);
-
-    int positionLocation = m_shader.attributeLocation("a_position");
-    m_shader.enableAttributeArray(positionLocation);
-    glVertexAttribPointer(positionLocation, 3, GL_FLOAT, GL_FALSE, sizeof(PointType), (const void *)offsetof(PointType, x));
-
-    int colorLocation = m_shader.attributeLocation("a_color");
-    m_shader.enableAttributeArray(colorLocation);
-    glVertexAttribPointer(colorLocation, 4, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(PointType), (const void *)offsetof(PointType, r));
-
-    glDrawArrays(GL_LINES, 0, 6);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-}
+#include "axes.h"
+
+#include <stdint.h>
+
+
+
+struct PointType {
+    float x, y, z;
+    uint8_t r, g, b, a;
+
+    PointType(float _1, float _2, float _3, int _4, int _5, int _6, int _7){
+        x = _1;
+        y = _2;
+        z = _3;
+        r = _4;
+        g = _5;
+        b = _6;
+        a = _7;
+    }
+};
+
+static const PointType points[] = {
+    PointType(-10.0f, 0.0f, 0.0f, 255,0,0,255),
+    PointType(+10.0f, 0.0f, 0.0f, 255,0,0,255),
+    PointType(0.0f, -10.0f, 0.0f, 0,255,0,255),
+    PointType(0.0f, +10.0f, 0.0f, 0,255,0,255),
+    PointType(0.0f, 0.0f, -10.0f, 0,0,255,255),
+    PointType(0.0f, 0.0f, +10.0f, 0,0,255,255)
+};
+
+static const char* vertex =
+    "in vec4 v_position;\n"
+    "in vec4 v_color;\n"
+    "out vec4 f_color;\n"
+    "void main() { f_color = v_color; gl_Position = viewPosition(v_position); }\n";
+
+static const char* fragment =
+    "#version 330 core\n"
+    "in vec4 f_color;\n"
+    "out vec4 frag_color;\n"
+    "void main() { frag_color = f_color; }\n";
+
+
+
+///
+/// \brief Constructor.
+///
+Axes::Axes()
+{
+    glGenBuffers(1, &m_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    glBufferData(GL_ARRAY_BUFFER, 6 * sizeof(PointType), points, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    link(vertex, fragment);
+    m_vao.create();
+    m_vao.bind();
+    setupVertexArray();
+    m_vao.release();
+}
+
+
+
+///
+/// \brief Destructor.
+///
+Axes::~Axes()
+{
+    m_vao.destroy();
+    glDeleteBuffers(1, &m_buffer);
+}
+
+
+
+///
+/// \brief Describe los vértices en el VAO activo.
+///
+void Axes::setupVertexArray()
+{
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+
+    int positionLocation = m_shader.attributeLocation("v_position");
+    m_shader.enableAttributeArray(positionLocation);
+    glVertexAttribPointer(positionLocation, 3, GL_FLOAT, GL_FALSE, sizeof(PointType), (const void *)offsetof(PointType, x));
+
+    int colorLocation = m_shader.attributeLocation("v_color");
+    m_shader.enableAttributeArray(colorLocation);
+    glVertexAttribPointer(colorLocation, 4, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(PointType), (const void *)offsetof(PointType, r));
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+
+
+///
+/// \brief Renderiza los ejes en varias vistas del ViewSet activo con una sola llamada.
+/// \param first Primera vista.
+/// \param count Número de vistas.
+///
+void Axes::render(int first, int count)
+{
+    m_shader.bind();
+    m_shader.setUniformValue(uniform("first_view", m_first_view), first);
+
+    m_vao.bind();
+    if(!cachedState()) setupVertexArray();
+    glDrawArraysInstanced(GL_LINES, 0, 6, count);
+    m_vao.release();
+}
@@ -1,4 +1,4 @@
-#version 330
+#version 330 core
 
 uniform vec3 light_direction;
 uniform vec3 light_color;
@@ -7,11 +7,13 @@ in vec4 f_position;
 in vec3 f_normal;
 in vec4 f_color;
 
+out vec4 frag_color;
+
 
 
 void main()
 {
     float light_irradiance = dot(f_normal, -light_direction)+0.25f;
-    gl_FragColor.rgb = light_irradiance * light_color.rgb * f_color.rgb;
-    gl_FragColor.a = 1.0f;
+    frag_color.rgb = light_irradiance * light_color.rgb * f_color.rgb;
+    frag_color.a = 1.0f;
 }
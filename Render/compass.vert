@@ -1,6 +1,5 @@
-#version 330
+// Sin #version: RenderObject::link() antepone ViewSet::vertexHeader(), con el bloque "Views" y viewPosition()
 
-uniform mat4 proj_view_matrix;
 uniform mat4 model_matrix;
 uniform mat3 normal_matrix;
 
@@ -19,5 +18,5 @@ void main()
     f_position = model_matrix * v_position;
     f_normal = normal_matrix * v_normal;
     f_color = v_color / 255.0f;
-    gl_Position = proj_view_matrix * model_matrix * v_position;
+    gl_Position = viewPosition(model_matrix * v_position);
 }
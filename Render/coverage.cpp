@@ -0,0 +1,177 @@
+#include "coverage.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+
+///
+/// \brief Constructor, calcula los anillos de la partición.
+/// \param bins Número de celdas; como mínimo, los dos casquetes polares.
+///
+SphereGrid::SphereGrid(int bins) : m_bins(std::max(bins, 2))
+{
+    // Casquete polar de una celda y altura ideal de los anillos, la de una celda cuadrada
+    const double cap = acos(1.0 - 2.0 / m_bins);
+    const double side = sqrt(4.0 * M_PI / m_bins);
+    const int rings = (m_bins > 2) ? std::max(1, int(lround((M_PI - 2.0 * cap) / side))) : 0;
+    const double height = (M_PI - 2.0 * cap) / std::max(rings, 1);
+
+    // Reparte las celdas entre los anillos según su área, arrastrando el redondeo al siguiente
+    m_ring_first.push_back(0);
+    m_ring_size.push_back(1);
+    int assigned = 1;
+    double carry = 0.0;
+    for (int i = 0; i < rings; ++i) {
+        const double top = cap + i * height;
+        const double ideal = (cos(top) - cos(top + height)) * m_bins / 2.0 + carry;
+        const int size = (i == rings - 1) ? m_bins - 1 - assigned : std::max(1, int(lround(ideal)));
+        carry = ideal - size;
+        m_ring_first.push_back(assigned);
+        m_ring_size.push_back(size);
+        assigned += size;
+    }
+    m_ring_first.push_back(assigned);
+    m_ring_size.push_back(1);
+}
+
+
+
+///
+/// \brief Número de celdas.
+///
+int SphereGrid::size() const
+{
+    return m_bins;
+}
+
+
+
+///
+/// \brief Celda de una dirección.
+///
+/// Como todas las celdas tienen la misma área, el área de la esfera por encima de la dirección, que
+/// sólo depende de z, dice cuántas celdas quedan por encima y por tanto en qué anillo está.
+/// \param direction Dirección, no hace falta que esté normalizada.
+/// \return Índice de la celda, entre 0 y size()-1.
+///
+int SphereGrid::bin(const QVector3D& direction) const
+{
+    const float length = direction.length();
+    const double z = (length > 0.0f) ? direction.z() / length : 1.0;
+    const double above = std::min(std::max((1.0 - z) * m_bins / 2.0, 0.0), m_bins - 1e-6);
+    const int ring = int(std::upper_bound(m_ring_first.begin(), m_ring_first.end(), int(above)) - m_ring_first.begin()) - 1;
+
+    const int size = m_ring_size[ring];
+    if (size == 1) return m_ring_first[ring];
+    double phi = atan2(direction.y(), direction.x());
+    if (phi < 0.0) phi += 2.0 * M_PI;
+    return m_ring_first[ring] + std::min(int(phi * size / (2.0 * M_PI)), size - 1);
+}
+
+
+
+///
+/// \brief Constructor, con el índice vacío y sin corrección.
+/// \param bins Número de celdas de la esfera.
+/// \param capacity Muestras que se aceptan como mucho en cada celda.
+///
+CoverageIndex::CoverageIndex(int bins, int capacity) : m_grid(bins), m_capacity(capacity)
+{
+    reset();
+}
+
+
+
+///
+/// \brief Vacía el índice y vuelve a la corrección identidad.
+///
+void CoverageIndex::reset()
+{
+    m_counts.assign(m_grid.size(), 0);
+    m_covered = 0;
+    m_correction.setToIdentity();
+}
+
+
+
+///
+/// \brief Cambia la corrección con la que se calculan las direcciones de las muestras.
+/// \param correction Corrección estimada del sensor.
+///
+void CoverageIndex::setCorrection(const QMatrix4x4& correction)
+{
+    m_correction = correction;
+}
+
+
+
+///
+/// \brief Celda de una muestra.
+/// \param point Muestra sin calibrar.
+/// \return Índice de la celda.
+///
+int CoverageIndex::bin(const QVector3D& point) const
+{
+    return m_grid.bin(m_correction.map(point));
+}
+
+
+
+///
+/// \brief Indica si una celda ya tiene todas las muestras que se aceptan.
+/// \param bin Índice de la celda.
+///
+bool CoverageIndex::full(int bin) const
+{
+    return m_counts[bin] >= m_capacity;
+}
+
+
+
+///
+/// \brief Cuenta una muestra aceptada en una celda.
+/// \param bin Índice de la celda.
+///
+void CoverageIndex::insert(int bin)
+{
+    if (!m_counts[bin]++) ++m_covered;
+}
+
+
+
+///
+/// \brief Vuelve a contar las muestras guardadas con la corrección actual.
+/// \param x Coordenadas x de las muestras.
+/// \param y Coordenadas y de las muestras.
+/// \param z Coordenadas z de las muestras.
+/// \param count Número de muestras.
+///
+void CoverageIndex::rebin(const float* x, const float* y, const float* z, size_t count)
+{
+    std::fill(m_counts.begin(), m_counts.end(), 0);
+    m_covered = 0;
+    for (size_t i = 0; i < count; ++i) {
+        insert(bin(QVector3D(x[i], y[i], z[i])));
+    }
+}
+
+
+
+///
+/// \brief Número de celdas con alguna muestra.
+///
+int CoverageIndex::covered() const
+{
+    return m_covered;
+}
+
+
+
+///
+/// \brief Fracción de la esfera cubierta por las muestras, entre 0 y 1.
+///
+double CoverageIndex::coverage() const
+{
+    return double(m_covered) / m_grid.size();
+}
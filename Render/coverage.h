@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+
+#include <QMatrix4x4>
+#include <QVector3D>
+
+
+
+///
+/// \brief División de la esfera unidad en celdas de igual área.
+///
+/// Es una partición en anillos: un casquete en cada polo y, entre ellos, anillos de latitud con un
+/// número de celdas proporcional a su perímetro. Los límites de los anillos se ajustan para que cada
+/// celda tenga exactamente un área de 4π/N, así que contar celdas ocupadas mide directamente la
+/// fracción de la esfera cubierta. Buscar la celda de una dirección sólo cuesta una búsqueda binaria
+/// entre los anillos y un atan2.
+///
+class SphereGrid
+{
+public:
+    explicit SphereGrid(int bins);
+    int size() const;
+    int bin(const QVector3D& direction) const;
+
+private:
+    int m_bins;
+    std::vector<int> m_ring_first;
+    std::vector<int> m_ring_size;
+};
+
+
+
+///
+/// \brief Índice de las direcciones de las muestras de un sensor durante la calibración.
+///
+/// Guarda cuántas muestras se han aceptado en cada celda de una SphereGrid, para descartar las que caen
+/// en celdas que ya tienen Capacity, y la fracción de celdas con alguna muestra. Las muestras están
+/// sin calibrar, así que la dirección se toma después de aplicarles la corrección estimada hasta el
+/// momento; al cambiar la estimación hay que recontar las muestras guardadas con rebin().
+///
+class CoverageIndex
+{
+public:
+    static const int DefaultBins = 400;
+    static const int DefaultCapacity = 16;
+
+    explicit CoverageIndex(int bins = DefaultBins, int capacity = DefaultCapacity);
+    void reset();
+    void setCorrection(const QMatrix4x4& correction);
+    int bin(const QVector3D& point) const;
+    bool full(int bin) const;
+    void insert(int bin);
+    void rebin(const float* x, const float* y, const float* z, size_t count);
+    int covered() const;
+    double coverage() const;
+
+private:
+    SphereGrid m_grid;
+    int m_capacity;
+    std::vector<int> m_counts;
+    int m_covered;
+    QMatrix4x4 m_correction;
+};
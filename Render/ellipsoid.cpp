@@ -0,0 +1,499 @@
+#include "ellipsoid.h"
+
+#include <cmath>
+#include <algorithm>
+
+#include "eigen3/Eigen/Dense"
+
+// Columnas de la matriz de diseño: x², y², z², 2xy, 2xz, 2yz, 2x, 2y, 2z
+static const int COLUMN_EXPONENTS[9][3] = {
+    { 2, 0, 0 }, { 0, 2, 0 }, { 0, 0, 2 }, { 1, 1, 0 }, { 1, 0, 1 }, { 0, 1, 1 },
+    { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } };
+static const double COLUMN_FACTORS[9] = { 1, 1, 1, 2, 2, 2, 2, 2, 2 };
+static const int ALIGNED_COLUMNS[6] = { 0, 1, 2, 6, 7, 8 };
+
+// Las muestras de un vector se pasan al núcleo de momentos en bloques de este tamaño
+static const int SOA_BLOCK = 1024;
+
+
+
+///
+/// \brief Constructor, con el acumulador vacío.
+///
+EllipsoidAccumulator::EllipsoidAccumulator()
+{
+    reset();
+}
+
+
+
+///
+/// \brief Descarta todas las muestras acumuladas.
+///
+void EllipsoidAccumulator::reset()
+{
+    for (double& value : m_moments) value = 0.0;
+    m_count = 0;
+}
+
+
+
+///
+/// \brief Suma una muestra a las ecuaciones normales.
+/// \param point Muestra del sensor, sin calibrar.
+///
+void EllipsoidAccumulator::add(const QVector3D& point)
+{
+    const float x = point.x(), y = point.y(), z = point.z();
+    AccumulateMoments(&x, &y, &z, 1, m_moments, MomentsScalar);
+    ++m_count;
+}
+
+
+
+///
+/// \brief Suma un conjunto de muestras a las ecuaciones normales.
+/// \param points Muestras del sensor, sin calibrar.
+///
+void EllipsoidAccumulator::add(const std::vector<QVector3D>& points)
+{
+    // Separa las coordenadas por bloques para el núcleo vectorial
+    float x[SOA_BLOCK], y[SOA_BLOCK], z[SOA_BLOCK];
+    for (size_t begin = 0; begin < points.size(); begin += SOA_BLOCK) {
+        const size_t count = std::min<size_t>(SOA_BLOCK, points.size() - begin);
+        for (size_t i = 0; i < count; ++i) {
+            x[i] = points[begin + i].x();
+            y[i] = points[begin + i].y();
+            z[i] = points[begin + i].z();
+        }
+        add(x, y, z, count);
+    }
+}
+
+
+
+///
+/// \brief Suma muestras guardadas como estructura de vectores, con el núcleo vectorial.
+/// \param x Coordenadas x de las muestras.
+/// \param y Coordenadas y de las muestras.
+/// \param z Coordenadas z de las muestras.
+/// \param count Número de muestras.
+///
+void EllipsoidAccumulator::add(const float* x, const float* y, const float* z, size_t count)
+{
+    AccumulateMoments(x, y, z, count, m_moments);
+    m_count += count;
+}
+
+
+
+///
+/// \brief Suma las muestras de otro acumulador, por ejemplo el de otro hilo.
+/// \param other Acumulador a sumar.
+///
+void EllipsoidAccumulator::merge(const EllipsoidAccumulator& other)
+{
+    for (int k = 0; k < EllipsoidMoments; ++k) m_moments[k] += other.m_moments[k];
+    m_count += other.m_count;
+}
+
+
+
+///
+/// \brief Quita las muestras de otro acumulador, que tienen que haberse sumado antes a éste.
+/// \param other Acumulador con las muestras a quitar.
+///
+void EllipsoidAccumulator::remove(const EllipsoidAccumulator& other)
+{
+    for (int k = 0; k < EllipsoidMoments; ++k) m_moments[k] -= other.m_moments[k];
+    m_count -= other.m_count;
+}
+
+
+
+///
+/// \brief Número de muestras acumuladas.
+///
+uint64_t EllipsoidAccumulator::count() const
+{
+    return m_count;
+}
+
+
+
+///
+/// \brief Resuelve el ajuste con las muestras acumuladas hasta ahora.
+/// \param model Modelo de elipsoide.
+/// \return Matriz de corrección que, al multiplicar cada punto, da una esfera de radio 1, o la
+/// identidad si no hay suficientes muestras o no forman una elipsoide.
+///
+QMatrix4x4 EllipsoidAccumulator::solve(EllipsoidModel model) const
+{
+    return (model == EllipsoidOriented) ? solveOriented() : solveAligned();
+}
+
+
+
+///
+/// \brief Centro, semiamplitudes y error de una corrección sobre las muestras acumuladas.
+///
+/// Con P = WᵀW y q = Wᵀo, ||Wx + o||² - 1 = xᵀPx + 2qᵀx + ||o||² - 1 es una combinación de las mismas
+/// columnas que el ajuste más una constante, así que la suma de sus cuadrados sale de los momentos sin
+/// volver a recorrer las muestras. Para residuos pequeños r² - 1 ≈ 2(r - 1), de donde el error del radio.
+/// \param correction Matriz de corrección, por ejemplo la de solve().
+/// \return Forma de la elipsoide; m_valid es falso si la corrección no es invertible.
+///
+EllipsoidShape EllipsoidAccumulator::shape(const QMatrix4x4& correction) const
+{
+    EllipsoidShape shape = { false, QVector3D(), QVector3D(), 0.0 };
+    Eigen::Matrix3d W;
+    Eigen::Vector3d o;
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) W(i, j) = correction(i, j);
+        o(i) = correction(i, 3);
+    }
+    const Eigen::FullPivLU<Eigen::Matrix3d> lu(W);
+    if (!lu.isInvertible()) return shape;
+
+    // La elipsoide es c + W⁻¹u con ||u|| = 1; su semiamplitud en el eje i es la norma de la fila i de W⁻¹
+    const Eigen::Matrix3d M = lu.inverse();
+    const Eigen::Vector3d center = -M * o;
+    shape.m_center = QVector3D(center.x(), center.y(), center.z());
+    shape.m_radii = QVector3D(M.row(0).norm(), M.row(1).norm(), M.row(2).norm());
+    shape.m_valid = true;
+    if (!m_count) return shape;
+
+    // Coeficientes de ||Wx + o||² - 1 sobre las columnas x², y², z², 2xy, 2xz, 2yz, 2x, 2y, 2z
+    const Eigen::Matrix3d P = W.transpose() * W;
+    const Eigen::Vector3d q = W.transpose() * o;
+    const double v[Parameters] = { P(0, 0), P(1, 1), P(2, 2), P(0, 1), P(0, 2), P(1, 2), q.x(), q.y(), q.z() };
+    const double constant = o.squaredNorm() - 1.0;
+
+    double sum = m_count * constant * constant;
+    for (int i = 0; i < Parameters; ++i) {
+        for (int j = 0; j < Parameters; ++j) sum += v[i] * v[j] * ata(i, j);
+        sum += 2.0 * constant * v[i] * atb(i);
+    }
+    shape.m_rms = 0.5 * sqrt(std::max(sum, 0.0) / m_count);
+    return shape;
+}
+
+
+
+///
+/// \brief Elemento de AᵀA, a partir de los momentos.
+///
+double EllipsoidAccumulator::ata(int i, int j) const
+{
+    const int index = MomentIndex(COLUMN_EXPONENTS[i][0] + COLUMN_EXPONENTS[j][0],
+                                  COLUMN_EXPONENTS[i][1] + COLUMN_EXPONENTS[j][1],
+                                  COLUMN_EXPONENTS[i][2] + COLUMN_EXPONENTS[j][2]);
+    return COLUMN_FACTORS[i] * COLUMN_FACTORS[j] * m_moments[index];
+}
+
+
+
+///
+/// \brief Elemento de Aᵀ1, a partir de los momentos.
+///
+double EllipsoidAccumulator::atb(int i) const
+{
+    return COLUMN_FACTORS[i] * m_moments[MomentIndex(COLUMN_EXPONENTS[i][0], COLUMN_EXPONENTS[i][1], COLUMN_EXPONENTS[i][2])];
+}
+
+
+
+///
+/// \brief Ajuste de una elipsoide alineada con los ejes, Ax² + By² + Cz² + 2Gx + 2Hy + 2Iz = 1.
+///
+QMatrix4x4 EllipsoidAccumulator::solveAligned() const
+{
+    // Si no hay suficientes datos, se devuelve una matriz identidad
+    if (m_count < 6)
+    {
+        return QMatrix4x4();
+    }
+
+    // Reconstruye las ecuaciones normales sin los términos cruzados
+    Eigen::Matrix<double, 6, 6> mA;
+    Eigen::Matrix<double, 6, 1> mB;
+    for (int i = 0; i < 6; ++i) {
+        for (int j = 0; j < 6; ++j) {
+            mA(i, j) = ata(ALIGNED_COLUMNS[i], ALIGNED_COLUMNS[j]);
+        }
+        mB(i) = atb(ALIGNED_COLUMNS[i]);
+    }
+
+    // Resuelve el sistema de ecuaciones
+    Eigen::Matrix<double, 6, 1> v1 = mA.fullPivLu().solve(mB);
+    Eigen::VectorXd v2(9);
+    v2 << v1[0], v1[1], v1[2], 0.0, 0.0, 0.0, v1[3], v1[4], v1[5];
+
+    // Calcula el centro de la elipsoide
+    Eigen::Vector3d center(-v2[6] / v2[0], -v2[7] / v2[1], -v2[8] / v2[2]);
+    double gam = 1.0 + (v2[6] * v2[6] / v2[0] + v2[7] * v2[7] / v2[1] + v2[8] * v2[8] / v2[2]);
+    Eigen::Vector3d radii(sqrt( gam / v2[0] ), sqrt( gam / v2[1] ), sqrt( gam / v2[2] ));
+    Eigen::Vector3d scale(1.0 / radii[0], 1.0 / radii[1], 1.0 / radii[2]);
+
+    // Matriz de corrección
+    return QMatrix4x4(
+        scale.x(), 0.0, 0.0, -center.x()*scale.x(),
+        0.0, scale.y(), 0.0, -center.y()*scale.y(),
+        0.0, 0.0, scale.z(), -center.z()*scale.z(),
+        0.0, 0.0, 0.0, 1.0);
+}
+
+
+
+///
+/// \brief Ajuste de una elipsoide con orientación arbitraria.
+///
+/// Con Q la forma cuadrática y b los términos lineales, la elipsoide es (x-c)ᵀQ(x-c) = γ, con
+/// c = -Q⁻¹b y γ = 1 + cᵀQc. Si Q/γ = VΛVᵀ, la corrección es W = V√ΛVᵀ aplicada a x-c: es la raíz
+/// simétrica, así que no añade ninguna rotación además de la propia deformación.
+///
+QMatrix4x4 EllipsoidAccumulator::solveOriented() const
+{
+    // Si no hay suficientes datos, se devuelve una matriz identidad
+    if (m_count < Parameters)
+    {
+        return QMatrix4x4();
+    }
+
+    // Reconstruye las ecuaciones normales
+    Eigen::Matrix<double, Parameters, Parameters> mA;
+    Eigen::Matrix<double, Parameters, 1> mB;
+    for (int i = 0; i < Parameters; ++i) {
+        for (int j = 0; j < Parameters; ++j) {
+            mA(i, j) = ata(i, j);
+        }
+        mB(i) = atb(i);
+    }
+
+    // Resuelve el sistema de ecuaciones; AᵀA es simétrica y semidefinida positiva
+    Eigen::LDLT<Eigen::Matrix<double, Parameters, Parameters>> ldlt(mA);
+    if (ldlt.info() != Eigen::Success) return QMatrix4x4();
+    const Eigen::Matrix<double, Parameters, 1> v = ldlt.solve(mB);
+
+    // Forma algebraica de la elipsoide
+    Eigen::Matrix3d Q;
+    Q << v[0], v[3], v[4],
+         v[3], v[1], v[5],
+         v[4], v[5], v[2];
+    const Eigen::Vector3d b(v[6], v[7], v[8]);
+
+    // Calcula el centro de la elipsoide
+    const Eigen::Vector3d center = -Q.ldlt().solve(b);
+    const double gam = 1.0 + center.dot(Q * center);
+    if (!(gam > 0.0)) return QMatrix4x4();
+
+    // Resuelve el eigenproblema; si algún autovalor no es positivo, no es una elipsoide
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> es(Q / gam);
+    if ((es.info() != Eigen::Success) || !(es.eigenvalues().minCoeff() > 0.0)) return QMatrix4x4();
+    const Eigen::Matrix3d W = es.eigenvectors() * es.eigenvalues().cwiseSqrt().asDiagonal() * es.eigenvectors().transpose();
+    const Eigen::Vector3d offset = -W * center;
+
+    // Matriz de corrección
+    return QMatrix4x4(
+        W(0, 0), W(0, 1), W(0, 2), offset.x(),
+        W(1, 0), W(1, 1), W(1, 2), offset.y(),
+        W(2, 0), W(2, 1), W(2, 2), offset.z(),
+        0.0, 0.0, 0.0, 1.0);
+}
+
+
+
+///
+/// \brief Constructor.
+///
+RobustEllipsoidFit::RobustEllipsoidFit() : m_rejected_count(0), m_iterations(0), m_cancel(nullptr)
+{
+}
+
+
+
+///
+/// \brief Indica una marca que, al activarse desde otro hilo, interrumpe el ajuste entre dos pasadas.
+/// \param cancel Marca de cancelación, o nulo para no poder cancelarlo.
+///
+void RobustEllipsoidFit::setCancel(const std::atomic<bool>* cancel)
+{
+    m_cancel = cancel;
+}
+
+
+
+///
+/// \brief Ajusta una elipsoide descartando las muestras atípicas.
+/// \param x Coordenadas x de las muestras.
+/// \param y Coordenadas y de las muestras.
+/// \param z Coordenadas z de las muestras.
+/// \param count Número de muestras.
+/// \param model Modelo de elipsoide.
+/// \return Matriz de corrección, como EllipsoidAccumulator::solve().
+///
+QMatrix4x4 RobustEllipsoidFit::solve(const float* x, const float* y, const float* z, size_t count, EllipsoidModel model)
+{
+    EllipsoidAccumulator all;
+    all.add(x, y, z, count);
+    return solve(x, y, z, count, model, all);
+}
+
+
+
+///
+/// \brief Ajusta una elipsoide descartando las muestras atípicas, partiendo de las ecuaciones normales
+/// de todas ellas, por ejemplo las que ya se han acumulado durante la captura.
+/// \param x Coordenadas x de las muestras.
+/// \param y Coordenadas y de las muestras.
+/// \param z Coordenadas z de las muestras.
+/// \param count Número de muestras.
+/// \param model Modelo de elipsoide.
+/// \param all Acumulador con exactamente esas mismas muestras.
+/// \return Matriz de corrección, como EllipsoidAccumulator::solve().
+///
+QMatrix4x4 RobustEllipsoidFit::solve(const float* x, const float* y, const float* z, size_t count, EllipsoidModel model,
+                                     const EllipsoidAccumulator& all)
+{
+    m_rejected.assign(count, 0);
+    m_rejected_count = 0;
+    m_iterations = 0;
+
+    EllipsoidAccumulator fit = all;
+    QMatrix4x4 correction = fit.solve(model);
+    while (m_iterations < MaxIterations) {
+        if (m_cancel && *m_cancel) break;
+        ++m_iterations;
+        computeResiduals(correction, x, y, z, count);
+        m_previous = m_rejected;
+        const size_t previous_count = m_rejected_count;
+        if (!reweight(threshold(), x, y, z, fit)) break;
+
+        // Si quedan muy pocas muestras, el ajuste anterior es el último válido, y con él sus marcas
+        if (fit.count() < uint64_t(EllipsoidAccumulator::Parameters)) {
+            m_rejected.swap(m_previous);
+            m_rejected_count = previous_count;
+            break;
+        }
+        correction = fit.solve(model);
+    }
+    return correction;
+}
+
+
+
+///
+/// \brief Marca de cada muestra: distinto de cero si se ha descartado en el último ajuste.
+///
+const std::vector<uint8_t>& RobustEllipsoidFit::rejected() const
+{
+    return m_rejected;
+}
+
+
+
+///
+/// \brief Número de muestras descartadas en el último ajuste.
+///
+size_t RobustEllipsoidFit::rejectedCount() const
+{
+    return m_rejected_count;
+}
+
+
+
+///
+/// \brief Número de pasadas del último ajuste.
+///
+int RobustEllipsoidFit::iterations() const
+{
+    return m_iterations;
+}
+
+
+
+///
+/// \brief Calcula el residuo de cada muestra: su distancia a la esfera unidad tras la corrección.
+/// \param correction Matriz de corrección actual.
+/// \param x Coordenadas x de las muestras.
+/// \param y Coordenadas y de las muestras.
+/// \param z Coordenadas z de las muestras.
+/// \param count Número de muestras.
+///
+void RobustEllipsoidFit::computeResiduals(const QMatrix4x4& correction, const float* x, const float* y, const float* z, size_t count)
+{
+    float m[3][4];
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 4; ++j) m[i][j] = correction(i, j);
+    }
+
+    m_residuals.resize(count);
+    float* residuals = m_residuals.data();
+    for (size_t i = 0; i < count; ++i) {
+        const float cx = m[0][0] * x[i] + m[0][1] * y[i] + m[0][2] * z[i] + m[0][3];
+        const float cy = m[1][0] * x[i] + m[1][1] * y[i] + m[1][2] * z[i] + m[1][3];
+        const float cz = m[2][0] * x[i] + m[2][1] * y[i] + m[2][2] * z[i] + m[2][3];
+        residuals[i] = std::fabs(std::sqrt(cx * cx + cy * cy + cz * cz) - 1.0f);
+    }
+}
+
+
+
+///
+/// \brief Umbral de descarte a partir de la mediana de los residuos, que no se ve afectada por las
+/// propias muestras atípicas mientras sean menos de la mitad.
+/// \return Residuo máximo de las muestras que se conservan.
+///
+float RobustEllipsoidFit::threshold()
+{
+    m_sorted = m_residuals;
+    std::vector<float>::iterator median = m_sorted.begin() + m_sorted.size() / 2;
+    std::nth_element(m_sorted.begin(), median, m_sorted.end());
+    return std::max(float(Sigmas * 1.4826 * *median), float(MinThreshold));
+}
+
+
+
+///
+/// \brief Descarta o recupera las muestras según el umbral y actualiza las ecuaciones normales sólo
+/// con las que han cambiado.
+/// \param threshold Residuo máximo de las muestras que se conservan.
+/// \param x Coordenadas x de las muestras.
+/// \param y Coordenadas y de las muestras.
+/// \param z Coordenadas z de las muestras.
+/// \param fit Ecuaciones normales de las muestras conservadas.
+/// \return Número de muestras que han cambiado.
+///
+size_t RobustEllipsoidFit::reweight(float threshold, const float* x, const float* y, const float* z, EllipsoidAccumulator& fit)
+{
+    // Las muestras que cambian se agrupan por bloques para el núcleo vectorial
+    float bx[2][SOA_BLOCK], by[2][SOA_BLOCK], bz[2][SOA_BLOCK];
+    size_t pending[2] = { 0, 0 };
+    EllipsoidAccumulator changed[2];
+    size_t changes = 0;
+
+    for (size_t i = 0; i < m_residuals.size(); ++i) {
+        const uint8_t reject = (m_residuals[i] > threshold) ? 1 : 0;
+        if (reject == m_rejected[i]) continue;
+        m_rejected[i] = reject;
+        ++changes;
+
+        size_t& n = pending[reject];
+        bx[reject][n] = x[i];
+        by[reject][n] = y[i];
+        bz[reject][n] = z[i];
+        if (++n == SOA_BLOCK) {
+            changed[reject].add(bx[reject], by[reject], bz[reject], n);
+            n = 0;
+        }
+    }
+    for (int k = 0; k < 2; ++k) {
+        changed[k].add(bx[k], by[k], bz[k], pending[k]);
+    }
+
+    // changed[0] son las recuperadas y changed[1] las recién descartadas
+    fit.merge(changed[0]);
+    fit.remove(changed[1]);
+    m_rejected_count = m_rejected_count + changed[1].count() - changed[0].count();
+    return changes;
+}
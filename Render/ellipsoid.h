@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include <QMatrix4x4>
+#include <QVector3D>
+
+#include "moments.h"
+
+
+
+///
+/// \brief Modelo de elipsoide que se ajusta.
+///
+/// EllipsoidAligned sólo corrige el desplazamiento y la escala de cada eje (hard-iron y ganancias).
+/// EllipsoidOriented añade los términos cruzados, así que también corrige la distorsión soft-iron y
+/// la falta de ortogonalidad entre ejes.
+///
+enum EllipsoidModel { EllipsoidAligned, EllipsoidOriented };
+
+
+
+///
+/// \brief Forma de una elipsoide ajustada, para mostrarla.
+///
+/// m_radii es la semiamplitud de la elipsoide a lo largo de cada eje del sensor, que en el modelo
+/// alineado coincide con sus radios. m_rms es el error cuadrático medio del radio corregido de las
+/// muestras respecto a 1, es decir, relativo al radio.
+///
+struct EllipsoidShape
+{
+    bool m_valid;
+    QVector3D m_center;
+    QVector3D m_radii;
+    double m_rms;
+};
+
+
+
+///
+/// \brief Acumulador de las ecuaciones normales del ajuste de una elipsoide.
+///
+/// Ajusta Ax² + By² + Cz² + 2Dxy + 2Exz + 2Fyz + 2Gx + 2Hy + 2Iz = 1. Cada elemento de AᵀA y de Aᵀ1
+/// es un momento de las muestras (ver EllipsoidMoments), así que sólo se suman los 34 momentos según
+/// llegan: la memoria no depende del número de muestras y solve() cuesta siempre lo mismo. El modelo
+/// alineado usa el subconjunto de columnas sin términos cruzados, de modo que se puede elegir el modelo
+/// después de capturar. Se guardan en double, sin tipos de Eigen, para poder copiarlo y usarlo en
+/// contenedores sin preocuparse de la alineación.
+///
+class EllipsoidAccumulator
+{
+public:
+    static const int Parameters = 9;
+
+    EllipsoidAccumulator();
+    void reset();
+    void add(const QVector3D& point);
+    void add(const std::vector<QVector3D>& points);
+    void add(const float* x, const float* y, const float* z, size_t count);
+    void merge(const EllipsoidAccumulator& other);
+    void remove(const EllipsoidAccumulator& other);
+    uint64_t count() const;
+    QMatrix4x4 solve(EllipsoidModel model) const;
+    EllipsoidShape shape(const QMatrix4x4& correction) const;
+
+private:
+    double m_moments[EllipsoidMoments];
+    uint64_t m_count;
+
+    double ata(int i, int j) const;
+    double atb(int i) const;
+    QMatrix4x4 solveAligned() const;
+    QMatrix4x4 solveOriented() const;
+};
+
+
+
+///
+/// \brief Ajuste de una elipsoide que descarta las muestras atípicas (golpes, perturbaciones magnéticas).
+///
+/// Es un ajuste por mínimos cuadrados reponderados con pesos 0 ó 1: en cada pasada calcula el residuo
+/// de cada muestra, ||Wx + o|| - 1 con la corrección actual, y descarta las que se alejan de la esfera
+/// unidad más de Sigmas veces la dispersión robusta (1.4826 veces la mediana de los residuos). Como
+/// los pesos son 0 ó 1, las ecuaciones normales no se recalculan en cada pasada: a las de la pasada
+/// anterior sólo se les restan los momentos de las muestras recién descartadas y se les suman los de
+/// las recuperadas, así que tras la primera pasada el coste lo marca el cálculo de los residuos.
+///
+class RobustEllipsoidFit
+{
+public:
+    static const int MaxIterations = 10;
+    static constexpr double Sigmas = 3.0;
+    static constexpr double MinThreshold = 1e-3;
+
+    RobustEllipsoidFit();
+    void setCancel(const std::atomic<bool>* cancel);
+    QMatrix4x4 solve(const float* x, const float* y, const float* z, size_t count, EllipsoidModel model);
+    QMatrix4x4 solve(const float* x, const float* y, const float* z, size_t count, EllipsoidModel model,
+                     const EllipsoidAccumulator& all);
+    const std::vector<uint8_t>& rejected() const;
+    size_t rejectedCount() const;
+    int iterations() const;
+
+private:
+    std::vector<float> m_residuals, m_sorted;
+    std::vector<uint8_t> m_rejected, m_previous;
+    size_t m_rejected_count;
+    int m_iterations;
+    const std::atomic<bool>* m_cancel;
+
+    void computeResiduals(const QMatrix4x4& correction, const float* x, const float* y, const float* z, size_t count);
+    float threshold();
+    size_t reweight(float threshold, const float* x, const float* y, const float* z, EllipsoidAccumulator& fit);
+};
@@ -0,0 +1,202 @@
+#include "moments.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define MOMENTS_X86
+#include <immintrin.h>
+#define MOMENTS_INLINE __attribute__((always_inline)) inline
+#define MOMENTS_TARGET(isa) __attribute__((target(isa)))
+#else
+#define MOMENTS_INLINE inline
+#endif
+
+
+
+///
+/// \brief Suma los momentos de un grupo de muestras.
+///
+/// Sirve igual para un double que para un vector de SSE2 o AVX2, porque GCC y Clang definen los
+/// operadores aritméticos sobre los tipos vectoriales. Al ser siempre inline, se compila con el
+/// conjunto de instrucciones de la función que la llama.
+/// \param x Coordenadas x.
+/// \param y Coordenadas y.
+/// \param z Coordenadas z.
+/// \param sum Sumas parciales, en el orden de EllipsoidMoments.
+///
+template <typename V>
+static MOMENTS_INLINE void AddTerms(const V& x, const V& y, const V& z, V* sum)
+{
+    const V xx = x*x, xy = x*y, xz = x*z, yy = y*y, yz = y*z, zz = z*z;
+
+    sum[0] += x;      sum[1] += y;      sum[2] += z;
+    sum[3] += xx;     sum[4] += xy;     sum[5] += xz;     sum[6] += yy;     sum[7] += yz;
+    sum[8] += zz;
+    sum[9] += xx*x;   sum[10] += xx*y;  sum[11] += xx*z;  sum[12] += xy*y;  sum[13] += xy*z;
+    sum[14] += xz*z;  sum[15] += yy*y;  sum[16] += yy*z;  sum[17] += yz*z;  sum[18] += zz*z;
+    sum[19] += xx*xx; sum[20] += xx*xy; sum[21] += xx*xz; sum[22] += xx*yy; sum[23] += xx*yz;
+    sum[24] += xx*zz; sum[25] += xy*yy; sum[26] += xy*yz; sum[27] += xy*zz; sum[28] += xz*zz;
+    sum[29] += yy*yy; sum[30] += yy*yz; sum[31] += yy*zz; sum[32] += yz*zz; sum[33] += zz*zz;
+}
+
+
+
+///
+/// \brief Momentos sin instrucciones vectoriales explícitas.
+///
+static void AccumulateScalar(const float* x, const float* y, const float* z, size_t count, double* moments)
+{
+    for (size_t i = 0; i < count; ++i) {
+        AddTerms<double>(x[i], y[i], z[i], moments);
+    }
+}
+
+
+
+#ifdef MOMENTS_X86
+
+///
+/// \brief Momentos con SSE2, de dos en dos muestras.
+///
+MOMENTS_TARGET("sse2")
+static void AccumulateSse2(const float* x, const float* y, const float* z, size_t count, double* moments)
+{
+    __m128d sum[EllipsoidMoments];
+    for (__m128d& value : sum) value = _mm_setzero_pd();
+
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        const __m128d vx = _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(x + i))));
+        const __m128d vy = _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(y + i))));
+        const __m128d vz = _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(z + i))));
+        AddTerms<__m128d>(vx, vy, vz, sum);
+    }
+
+    for (int k = 0; k < EllipsoidMoments; ++k) {
+        double lanes[2];
+        _mm_storeu_pd(lanes, sum[k]);
+        moments[k] += lanes[0] + lanes[1];
+    }
+    AccumulateScalar(x + i, y + i, z + i, count - i, moments);
+}
+
+
+
+///
+/// \brief Momentos con AVX2, de cuatro en cuatro muestras.
+///
+MOMENTS_TARGET("avx2")
+static void AccumulateAvx2(const float* x, const float* y, const float* z, size_t count, double* moments)
+{
+    __m256d sum[EllipsoidMoments];
+    for (__m256d& value : sum) value = _mm256_setzero_pd();
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m256d vx = _mm256_cvtps_pd(_mm_loadu_ps(x + i));
+        const __m256d vy = _mm256_cvtps_pd(_mm_loadu_ps(y + i));
+        const __m256d vz = _mm256_cvtps_pd(_mm_loadu_ps(z + i));
+        AddTerms<__m256d>(vx, vy, vz, sum);
+    }
+
+    for (int k = 0; k < EllipsoidMoments; ++k) {
+        double lanes[4];
+        _mm256_storeu_pd(lanes, sum[k]);
+        moments[k] += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    }
+    AccumulateScalar(x + i, y + i, z + i, count - i, moments);
+}
+
+#endif
+
+
+
+///
+/// \brief Posición de un momento en el orden de EllipsoidMoments.
+/// \param a Exponente de x.
+/// \param b Exponente de y.
+/// \param c Exponente de z.
+/// \return Índice del momento, o -1 si el grado no está entre 1 y 4.
+///
+int MomentIndex(int a, int b, int c)
+{
+    const int degree = a + b + c;
+    if ((a < 0) || (b < 0) || (c < 0) || (degree < 1) || (degree > 4)) return -1;
+
+    // Momentos de los grados anteriores: 3 + 6 + 10
+    static const int first[5] = { 0, 0, 3, 9, 19 };
+
+    // Dentro del grado, los exponentes de x mayores van antes
+    int index = first[degree];
+    for (int ax = degree; ax > a; --ax) index += degree - ax + 1;
+    return index + (degree - a - b);
+}
+
+
+
+///
+/// \brief Mejor implementación que admite el procesador.
+///
+MomentsKernel SupportedMomentsKernel()
+{
+#ifdef MOMENTS_X86
+    static const MomentsKernel kernel = []() {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) return MomentsAvx2;
+        if (__builtin_cpu_supports("sse2")) return MomentsSse2;
+        return MomentsScalar;
+    }();
+    return kernel;
+#else
+    return MomentsScalar;
+#endif
+}
+
+
+
+///
+/// \brief Nombre de una implementación, para los registros y las medidas.
+///
+const char* MomentsKernelName(MomentsKernel kernel)
+{
+    switch (kernel) {
+    case MomentsAvx2: return "avx2";
+    case MomentsSse2: return "sse2";
+    default: return "scalar";
+    }
+}
+
+
+
+///
+/// \brief Suma los momentos de un conjunto de muestras, con la mejor implementación disponible.
+/// \param x Coordenadas x de las muestras.
+/// \param y Coordenadas y de las muestras.
+/// \param z Coordenadas z de las muestras.
+/// \param count Número de muestras.
+/// \param moments Momentos, EllipsoidMoments valores, a los que se suman los de las muestras.
+///
+void AccumulateMoments(const float* x, const float* y, const float* z, size_t count, double* moments)
+{
+    AccumulateMoments(x, y, z, count, moments, SupportedMomentsKernel());
+}
+
+
+
+///
+/// \brief Suma los momentos de un conjunto de muestras con una implementación concreta.
+///
+/// Si el procesador no admite la implementación pedida, se usa la escalar.
+///
+void AccumulateMoments(const float* x, const float* y, const float* z, size_t count, double* moments, MomentsKernel kernel)
+{
+#ifdef MOMENTS_X86
+    if (kernel > SupportedMomentsKernel()) kernel = MomentsScalar;
+    switch (kernel) {
+    case MomentsAvx2: AccumulateAvx2(x, y, z, count, moments); return;
+    case MomentsSse2: AccumulateSse2(x, y, z, count, moments); return;
+    default: break;
+    }
+#else
+    (void)kernel;
+#endif
+    AccumulateScalar(x, y, z, count, moments);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+
+
+
+///
+/// \brief Número de momentos que necesita el ajuste de una elipsoide.
+///
+/// Son las sumas Σ xᵃyᵇzᶜ con 1 ≤ a+b+c ≤ 4, ordenadas por grado y, dentro de cada grado, por
+/// exponente de x y luego de y decrecientes: x, y, z, xx, xy, xz, yy, yz, zz, xxx, xxy, ... zzzz.
+/// Cada elemento de AᵀA y de Aᵀ1 es uno de estos momentos multiplicado por una constante.
+///
+static const int EllipsoidMoments = 34;
+
+
+
+///
+/// \brief Implementación del cálculo de momentos.
+///
+enum MomentsKernel { MomentsScalar, MomentsSse2, MomentsAvx2 };
+
+
+
+int MomentIndex(int a, int b, int c);
+MomentsKernel SupportedMomentsKernel();
+const char* MomentsKernelName(MomentsKernel kernel);
+void AccumulateMoments(const float* x, const float* y, const float* z, size_t count, double* moments);
+void AccumulateMoments(const float* x, const float* y, const float* z, size_t count, double* moments, MomentsKernel kernel);
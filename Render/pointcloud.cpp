@@ -1,78 +1,293 @@
-#include "pointcloud.h"
-
-
-
-static const char* vertex =
-    "#version 330\n"
-    "uniform mat4 proj_view_model_matrix;\n"
-    "in vec4 v_position;\n"
-    "out vec4 f_color;\n"
-    "void main() {\n"
-    "f_color.rgb = 0.5*normalize(v_position.xyz) + 0.5;\n"
-    "f_color.a = 1.0;\n"
-    "gl_Position = proj_view_model_matrix * v_position;\n"
-    "}\n";
-
-static const char* fragment =
-    "#version 330\n"
-    "in vec4 f_color;\n"
-    "void main() { gl_FragColor = f_color; }\n";
-
-
-
-///
-/// \brief PointCloud::PointCloud
-///
-PointCloud::PointCloud()
-{
-    initializeGLFunctions();
-    glGenBuffers(1, &m_point_buffer);
-    m_point_count = 0;
-
-    if (!m_shader.addShaderFromSourceCode(QGLShader::Vertex, vertex)) throw "wtf";
-    if (!m_shader.addShaderFromSourceCode(QGLShader::Fragment, fragment)) throw "wtf";
-    if (!m_shader.link()) throw "wtf";
-}
-
-
-
-///
-/// \brief PointCloud::~PointCloud
-///
-PointCloud::~PointCloud()
-{
-    glDeleteBuffers(1, &m_point_buffer);
-}
-
-
-
-///
-/// \brief PointCloud::update
-/// \param points
-///
-void PointCloud::update( const std::vector<QVector3D> &points )
-{
-    glBindBuffer(GL_ARRAY_BUFFER, m_point_buffer);
-    glBufferData(GL_ARRAY_BUFFER, points.size() * sizeof(QVector3D), points.data(), GL_DYNAMIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    m_point_count = points.size();
-}
-
-
-
-///
-/// \brief PointCloud::render
-/// \param shader
-///
-void PointCloud::render( const QMatrix4x4& pvmMatrix )
-{
-    m_shader.bind();
-    m_shader.setUniformValue("proj_view_model_matrix", pvmMatrix);
-
-    glBindBuffer(GL_ARRAY_BUFFER, m_point_buffer);
-    int positionLocation = m_shader.attributeLocation("v_position");
-    m_shader.enableAttributeArray(positionLocation);
-    glVertexAttribPointer(positionLocation, 3, GL_FLOAT, GL_FALSE, sizeof(QVector3D), 0);
-    glDrawArrays(GL_POINTS, 0, m_point_count);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-}
+#include "pointcloud.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+
+static const char* vertex =
+    "in vec4 v_position;\n"
+    "out vec4 f_color;\n"
+    "void main() {\n"
+    "f_color.rgb = 0.5*normalize(v_position.xyz) + 0.5;\n"
+    "f_color.a = 1.0;\n"
+    "gl_Position = viewPosition(v_position);\n"
+    "}\n";
+
+static const char* fragment =
+    "#version 330 core\n"
+    "uniform float alpha;\n"
+    "in vec4 f_color;\n"
+    "out vec4 frag_color;\n"
+    "void main() { frag_color = vec4(f_color.rgb, alpha * f_color.a); }\n";
+
+
+
+///
+/// \brief Clave del cubo de una rejilla que contiene un punto.
+/// \param point Punto.
+/// \param cell Lado de los cubos.
+/// \return Las tres coordenadas enteras del cubo, de 21 bits cada una, en un entero.
+///
+static quint64 CellKey(const QVector3D& point, float cell)
+{
+    const qint64 offset = qint64(1) << 20, mask = (qint64(1) << 21) - 1;
+    quint64 key = 0;
+    for(int axis=0 ; axis<3 ; ++axis) {
+        const qint64 index = std::min(std::max(qint64(std::floor(point[axis] / cell)) + offset, qint64(0)), mask);
+        key = (key << 21) | quint64(index);
+    }
+    return key;
+}
+
+
+
+///
+/// \brief PointCloud::PointCloud
+///
+PointCloud::PointCloud()
+{
+    m_uploaded_bytes = 0;
+    m_reallocations = 0;
+    link(vertex, fragment);
+    m_alpha = m_shader.uniformLocation("alpha");
+
+    glGenBuffers(1, &m_points.m_id);
+    m_points.m_count = 0;
+    m_points.m_capacity = 0;
+    setupVertexArray(m_points);
+    for(Buffer& level : m_levels) {
+        glGenBuffers(1, &level.m_id);
+        level.m_count = 0;
+        level.m_capacity = 0;
+        setupVertexArray(level);
+    }
+}
+
+
+
+///
+/// \brief PointCloud::~PointCloud
+///
+PointCloud::~PointCloud()
+{
+    m_points.m_vao.destroy();
+    glDeleteBuffers(1, &m_points.m_id);
+    for(Buffer& level : m_levels) {
+        level.m_vao.destroy();
+        glDeleteBuffers(1, &level.m_id);
+    }
+}
+
+
+
+///
+/// \brief Describe los vértices de un buffer en su VAO, que crea si no existe todavía.
+/// \param buffer Buffer.
+///
+void PointCloud::setupVertexArray( Buffer& buffer )
+{
+    if(!buffer.m_vao.isCreated()) buffer.m_vao.create();
+    buffer.m_vao.bind();
+    glBindBuffer(GL_ARRAY_BUFFER, buffer.m_id);
+    int positionLocation = m_shader.attributeLocation("v_position");
+    m_shader.enableAttributeArray(positionLocation);
+    glVertexAttribPointer(positionLocation, 3, GL_FLOAT, GL_FALSE, sizeof(QVector3D), 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    buffer.m_vao.release();
+}
+
+
+
+///
+/// \brief Sustituye todos los puntos de la nube.
+/// \param points Puntos nuevos.
+///
+void PointCloud::update( const std::vector<QVector3D> &points )
+{
+    upload(m_points, points, 0);
+    summarize(points, 0);
+}
+
+
+
+///
+/// \brief Sube sólo los puntos añadidos al final desde la última llamada.
+///
+/// Los puntos ya subidos tienen que seguir igual; si hay menos que antes, se sustituyen todos.
+/// \param points Todos los puntos de la nube.
+///
+void PointCloud::append( const std::vector<QVector3D>& points )
+{
+    const size_t count = size_t(m_points.m_count);
+    if(points.size() < count) update(points);
+    else if(points.size() > count) {
+        upload(m_points, points, count);
+        summarize(points, count);
+    }
+}
+
+
+
+///
+/// \brief Sube los puntos a partir de uno, haciendo crecer el buffer si no caben.
+/// \param buffer Buffer de destino.
+/// \param points Todos los puntos del buffer.
+/// \param first Primer punto que se sube; los anteriores ya están en el buffer.
+///
+void PointCloud::upload( Buffer& buffer, const std::vector<QVector3D>& points, size_t first )
+{
+    glBindBuffer(GL_ARRAY_BUFFER, buffer.m_id);
+    if(points.size() > buffer.m_capacity) {
+        // El buffer nuevo nace vacío, así que hay que volver a subirlo todo
+        buffer.m_capacity = std::max(std::max(points.size(), 2 * buffer.m_capacity), MinCapacity);
+        glBufferData(GL_ARRAY_BUFFER, buffer.m_capacity * sizeof(QVector3D), nullptr, GL_DYNAMIC_DRAW);
+        ++m_reallocations;
+        first = 0;
+    }
+    if(points.size() > first) {
+        const size_t bytes = (points.size() - first) * sizeof(QVector3D);
+        glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(QVector3D), bytes, points.data() + first);
+        m_uploaded_bytes += bytes;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    buffer.m_count = GLsizei(points.size());
+}
+
+
+
+///
+/// \brief Añade al resumen por niveles los puntos a partir de uno y sube los representantes nuevos.
+/// \param points Todos los puntos de la nube.
+/// \param first Primer punto nuevo; con 0 el resumen se empieza de cero.
+///
+void PointCloud::summarize( const std::vector<QVector3D>& points, size_t first )
+{
+    size_t previous[Levels];
+    for(int level=0 ; level<Levels ; ++level) {
+        if(first == 0) {
+            m_level_points[level].clear();
+            m_level_cells[level].clear();
+        }
+        previous[level] = m_level_points[level].size();
+    }
+
+    // El punto representa a su cubo en su nivel y en todos los más finos, donde también se dibuja
+    for(size_t i=first ; i<points.size() ; ++i) {
+        bool placed = false;
+        float cell = CellSize;
+        for(int level=0 ; level<Levels ; ++level, cell *= 0.5f) {
+            if(m_level_cells[level].insert(CellKey(points[i], cell)).second && !placed) {
+                m_level_points[level].push_back(points[i]);
+                placed = true;
+            }
+        }
+    }
+
+    for(int level=0 ; level<Levels ; ++level) {
+        if((first == 0) || (m_level_points[level].size() > previous[level])) {
+            upload(m_levels[level], m_level_points[level], first == 0 ? 0 : previous[level]);
+        }
+    }
+}
+
+
+
+///
+/// \brief Renderiza la nube en varias vistas del ViewSet activo, con una sola llamada por nivel de detalle.
+///
+/// Los niveles cuyos cubos miden al menos spacing se dibujan opacos. El siguiente se mezcla con una
+/// transparencia que va de 0 a 1 mientras spacing baja a la mitad, así que los puntos aparecen poco a
+/// poco. Tras el último nivel se pasa igual a la nube entera, que incluye a todos los representantes.
+/// \param first Primera vista.
+/// \param count Número de vistas.
+/// \param spacing Tamaño de un punto en pantalla, en unidades de la nube; 0 para dibujar la nube entera.
+/// \return Número de puntos dibujados, contando los de todas las vistas.
+///
+GLsizei PointCloud::render( int first, int count, float spacing )
+{
+    m_shader.bind();
+    m_shader.setUniformValue(uniform("first_view", m_first_view), first);
+
+    const float detail = (spacing > 0.0f) ? std::log2(CellSize / spacing) : float(Levels);
+    if(detail >= Levels) return drawBuffer(m_points, 1.0f, count);
+
+    const int level = std::max(int(std::floor(detail)), 0);
+    GLsizei drawn = 0;
+    for(int i=0 ; i<=level ; ++i) {
+        drawn += drawBuffer(m_levels[i], 1.0f, count);
+    }
+
+    // Los puntos que aparecen no tapan a los opacos
+    const float fade = detail - level;
+    if(fade > 0.0f) {
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glDepthMask(GL_FALSE);
+        drawn += drawBuffer((level + 1 < Levels) ? m_levels[level + 1] : m_points, fade, count);
+        glDepthMask(GL_TRUE);
+        glDisable(GL_BLEND);
+    }
+    return drawn;
+}
+
+
+
+///
+/// \brief Dibuja todos los puntos de un buffer con el programa ya activo.
+/// \param buffer Buffer.
+/// \param alpha Opacidad de los puntos.
+/// \param count Número de vistas.
+/// \return Número de puntos dibujados.
+///
+GLsizei PointCloud::drawBuffer( Buffer& buffer, float alpha, int count )
+{
+    if(buffer.m_count == 0) return 0;
+    m_shader.setUniformValue(uniform("alpha", m_alpha), alpha);
+
+    if(!cachedState()) setupVertexArray(buffer);
+    buffer.m_vao.bind();
+    glDrawArraysInstanced(GL_POINTS, 0, buffer.m_count, count);
+    buffer.m_vao.release();
+    return buffer.m_count * count;
+}
+
+
+
+///
+/// \brief Número de puntos de la nube.
+///
+size_t PointCloud::size() const
+{
+    return size_t(m_points.m_count);
+}
+
+
+
+///
+/// \brief Número de puntos que caben en el buffer sin hacerlo crecer.
+///
+size_t PointCloud::capacity() const
+{
+    return m_points.m_capacity;
+}
+
+
+
+///
+/// \brief Bytes subidos a la GPU desde que se creó la nube, contando los niveles de detalle.
+///
+quint64 PointCloud::uploadedBytes() const
+{
+    return m_uploaded_bytes;
+}
+
+
+
+///
+/// \brief Veces que ha crecido algún buffer desde que se creó la nube.
+///
+quint64 PointCloud::reallocations() const
+{
+    return m_reallocations;
+}
@@ -1,23 +1,66 @@
-#pragma once
-
-#include "types.h"
-
-
-
-///
-/// \brief The PointCloud class
-///
-class PointCloud : protected QGLFunctions
-{
-public:
-    PointCloud();
-    ~PointCloud();
-
-    void update( const std::vector<QVector3D>& points );
-    void render( const QMatrix4x4& pvmMatrix );
-
-private:
-    GLuint m_point_count;
-    GLuint m_point_buffer;
-    QGLShaderProgram m_shader;
-};
+#pragma once
+
+#include <unordered_set>
+
+#include "renderobject.h"
+
+
+
+///
+/// \brief Nube de puntos en un buffer de la GPU al que sólo se añaden puntos por el final.
+///
+/// La capacidad del buffer crece al doble cuando se llena, así que append() sólo sube los puntos
+/// nuevos con glBufferSubData() y el coste total de subir N puntos, uno a uno, es O(N). Al crecer se
+/// vuelve a subir todo, y update() lo sube todo siempre, para cuando cambian los puntos ya subidos.
+///
+/// Además guarda un resumen de la nube en Levels niveles de detalle: rejillas de cubos de lado
+/// CellSize, CellSize/2, ... en las que cada cubo ocupado tiene un único punto representante, el
+/// primero que cayó en él. Cada punto nuevo va al nivel más grueso en el que su cubo estaba vacío, o a
+/// ninguno, y cada nivel es otro buffer al que sólo se añaden puntos. Como la nube está sobre una
+/// superficie, el número de cubos ocupados de cada nivel está acotado aunque lleguen millones de
+/// puntos. Al dibujar se eligen los niveles cuyos cubos no son más pequeños que un punto en pantalla,
+/// y el siguiente nivel, o la nube entera tras el último, aparece poco a poco según se acerca la cámara.
+///
+class PointCloud : public RenderObject
+{
+public:
+    static const size_t MinCapacity = 4096;
+    static const int Levels = 4;
+    static constexpr float CellSize = 0.08f;
+
+    PointCloud();
+    ~PointCloud();
+
+    void update( const std::vector<QVector3D>& points );
+    void append( const std::vector<QVector3D>& points );
+    GLsizei render( int first, int count, float spacing = 0.0f );
+    size_t size() const;
+    size_t capacity() const;
+    quint64 uploadedBytes() const;
+    quint64 reallocations() const;
+
+private:
+    ///
+    /// \brief Buffer de la GPU al que sólo se añaden puntos, con su VAO.
+    ///
+    struct Buffer
+    {
+        GLuint m_id;
+        GLsizei m_count;
+        size_t m_capacity;
+        QOpenGLVertexArrayObject m_vao;
+    };
+
+    Buffer m_points;
+    Buffer m_levels[Levels];
+    std::vector<QVector3D> m_level_points[Levels];
+    std::unordered_set<quint64> m_level_cells[Levels];
+    quint64 m_uploaded_bytes;
+    quint64 m_reallocations;
+    int m_alpha;
+
+    void setupVertexArray( Buffer& buffer );
+    void upload( Buffer& buffer, const std::vector<QVector3D>& points, size_t first );
+    void summarize( const std::vector<QVector3D>& points, size_t first );
+    GLsizei drawBuffer( Buffer& buffer, float alpha, int count );
+};
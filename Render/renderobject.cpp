@@ -0,0 +1,77 @@
+#include "renderobject.h"
+
+
+
+static bool CachedState = true;
+
+
+
+///
+/// \brief Elige si los objetos usan las posiciones y los VAOs guardados o lo buscan todo en cada dibujo.
+/// \param cached Verdadero para el camino normal; falso para repetir el trabajo en cada dibujo.
+///
+void RenderObject::setCachedState(bool cached)
+{
+    CachedState = cached;
+}
+
+
+
+///
+/// \brief Verdadero si los objetos usan las posiciones y los VAOs guardados.
+///
+bool RenderObject::cachedState()
+{
+    return CachedState;
+}
+
+
+
+///
+/// \brief Constructor, necesita activo un contexto de OpenGL 3.3 o posterior.
+///
+/// Renderer::initializeGL() comprueba el contexto antes de crear ningún objeto.
+///
+RenderObject::RenderObject() : m_first_view(-1)
+{
+    const bool resolved = initializeOpenGLFunctions();
+    Q_ASSERT(resolved);
+    Q_UNUSED(resolved);
+}
+
+
+
+///
+/// \brief Compila y enlaza el programa del objeto.
+///
+/// Al vertex shader se le antepone ViewSet::vertexHeader(), los atributos v_position, v_normal y
+/// v_color se fijan en las posiciones de VertexAttribute y el bloque "Views" se asocia a ViewSet::Binding.
+/// \param vertex Vertex shader, sin #version; llama a viewPosition() en lugar de multiplicar por la cámara.
+/// \param fragment Fragment shader completo.
+///
+void RenderObject::link(const QByteArray& vertex, const QByteArray& fragment)
+{
+    const QByteArray source = ViewSet::vertexHeader().append(vertex);
+    if (!m_shader.addShaderFromSourceCode(QOpenGLShader::Vertex, source.constData())) throw "wtf";
+    if (!m_shader.addShaderFromSourceCode(QOpenGLShader::Fragment, fragment.constData())) throw "wtf";
+    m_shader.bindAttributeLocation("v_position", PositionAttribute);
+    m_shader.bindAttributeLocation("v_normal", NormalAttribute);
+    m_shader.bindAttributeLocation("v_color", ColorAttribute);
+    if (!m_shader.link()) throw "wtf";
+
+    glUniformBlockBinding(m_shader.programId(), glGetUniformBlockIndex(m_shader.programId(), "Views"), ViewSet::Binding);
+    m_first_view = m_shader.uniformLocation("first_view");
+}
+
+
+
+///
+/// \brief Posición de un uniform del programa.
+/// \param name Nombre del uniform.
+/// \param location Posición guardada al enlazar.
+/// \return La posición guardada, o la que se busca ahora por nombre si no se usan las guardadas.
+///
+int RenderObject::uniform(const char* name, int location) const
+{
+    return CachedState ? location : m_shader.uniformLocation(name);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <QOpenGLShaderProgram>
+#include <QOpenGLVertexArrayObject>
+
+#include "types.h"
+#include "viewset.h"
+
+
+
+///
+/// \brief Atributos de los vértices, con la misma posición en todos los programas.
+///
+enum VertexAttribute { PositionAttribute, NormalAttribute, ColorAttribute };
+
+
+
+///
+/// \brief Base de los objetos que se dibujan en las vistas de un ViewSet, con el perfil core de OpenGL 3.3.
+///
+/// Cada objeto tiene un programa, con las cámaras en el bloque "Views", y un vertex array object por
+/// buffer de vértices, que guarda su formato; las posiciones de los uniforms se buscan una sola vez al
+/// enlazar. Así un dibujo sólo cambia el programa, el VAO y los uniforms propios del objeto.
+///
+/// Con setCachedState(false) cada dibujo vuelve a buscar por nombre los uniforms y los atributos y a
+/// describir los vértices, como se hacía con QGLShaderProgram, para medir lo que cuesta.
+///
+class RenderObject : protected QOpenGLFunctions_3_3_Core
+{
+public:
+    static void setCachedState(bool cached);
+    static bool cachedState();
+
+protected:
+    QOpenGLShaderProgram m_shader;
+    int m_first_view;
+
+    RenderObject();
+    void link(const QByteArray& vertex, const QByteArray& fragment);
+    int uniform(const char* name, int location) const;
+};
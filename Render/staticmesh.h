@@ -1,27 +1,29 @@
-#pragma once
-
-#include "types.h"
-
-
-
-///
-/// \brief Malla estática, sin animaciones de ningún tipo.
-///
-class StaticMesh : protected QGLFunctions
-{
-public:
-    StaticMesh();
-    ~StaticMesh();
-
-    void load( const QString& fileName );
-    void update( const std::vector<VertexData>& vertices, const std::vector<TriangleData>& faces );
-    void render( const QMatrix4x4& camMatrix, const QMatrix4x4& modelMatrix );
-
-private:
-    GLuint m_vertex_count;
-    GLuint m_vertex_buffer;
-    GLuint m_face_count;
-    GLuint m_face_buffer;
-
-    QGLShaderProgram m_shader;
-};
+#pragma once
+
+#include "renderobject.h"
+
+
+
+///
+/// \brief Malla estática, sin animaciones de ningún tipo.
+///
+class StaticMesh : public RenderObject
+{
+public:
+    StaticMesh();
+    ~StaticMesh();
+
+    void load( const QString& fileName );
+    void update( const std::vector<VertexData>& vertices, const std::vector<TriangleData>& faces );
+    void render( int first, int count, const QMatrix4x4& modelMatrix, const QVector3D& color = QVector3D(1.0f, 1.0f, 1.0f) );
+
+private:
+    GLuint m_vertex_count;
+    GLuint m_vertex_buffer;
+    GLuint m_face_count;
+    GLuint m_face_buffer;
+    QOpenGLVertexArrayObject m_vao;
+    int m_model_matrix, m_normal_matrix, m_light_direction, m_light_color;
+
+    void setupVertexArray();
+};
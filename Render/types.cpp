@@ -1,179 +1,178 @@
-#include "types.h"
-
-#include "eigen3/Eigen/Dense"
-
-
-
-///
-/// \brief Ajusta una elipsoide a una nube de puntos.
-/// \param data Nube de puntos, potencialmente con ruido.
-/// \return Matriz de corrección que, al multiplicar cada punto, da una esfera de radio 1.
-///
-QMatrix4x4 FitAlignedEllipsoid(const std::vector<QVector3D>& data)
-{
-    // Si no hay suficientes datos, se devuelve una matriz identidad
-    if (data.size() < 6)
-    {
-        return QMatrix4x4();
-    }
-
-    // Ajusta una elipsoide del tipo Ax^2 + By^2 + Cz^2 + 2Gx + 2Hy + 2Iz = 1
-    Eigen::MatrixXd equation_params( data.size(), 6 );
-    for (size_t i = 0; i < data.size(); ++i)
-    {
-        auto row = data[i];
-        equation_params.row(i) <<
-            row.x()*row.x(),
-            row.y()*row.y(),
-            row.z()*row.z(),
-            2*row.x(),
-            2*row.y(),
-            2*row.z();
-    }
-
-    // Resuelve el sistema de ecuaciones
-    Eigen::MatrixXd mA = equation_params.transpose() * equation_params;
-    Eigen::VectorXd mB = equation_params.colwise().sum();
-    Eigen::VectorXd v1 = mA.fullPivLu().solve(mB);
-    Eigen::VectorXd v2(9);
-    v2 << v1[0], v1[1], v1[2], 0.0, 0.0, 0.0, v1[3], v1[4], v1[5];
-
-    // Calcula el centro de la elipsoide
-    Eigen::Vector3d center(-v2[6] / v2[0], -v2[7] / v2[1], -v2[8] / v2[2]);
-    double gam = 1.0 + (v2[6] * v2[6] / v2[0] + v2[7] * v2[7] / v2[1] + v2[8] * v2[8] / v2[2]);
-    Eigen::Vector3d radii(sqrt( gam / v2[0] ), sqrt( gam / v2[1] ), sqrt( gam / v2[2] ));
-    //Eigen::Vector3f scale(radii.maxCoeff() / radii[0], radii.maxCoeff() / radii[1], radii.maxCoeff() / radii[2]);
-    Eigen::Vector3d scale(1.0 / radii[0], 1.0 / radii[1], 1.0 / radii[2]);
-
-    // Matriz de corrección
-    return QMatrix4x4(
-        scale.x(), 0.0, 0.0, -center.x()*scale.x(),
-        0.0, scale.y(), 0.0, -center.y()*scale.y(),
-        0.0, 0.0, scale.z(), -center.z()*scale.z(),
-        0.0, 0.0, 0.0, 1.0);
-}
-
-
-
-/*
-///
-/// \brief Ajusta una elipsoide a una nube de puntos.
-/// \param data Nube de puntos, potencialmente con ruido.
-/// \return Matriz de corrección que, al multiplicar cada punto, da una esfera de radio 1.
-///
-QMatrix4x4 FitOrientedEllipsoid(const std::vector<QVector3D>& data)
-{
-    // Si no hay suficientes datos, se devuelve una matriz identidad
-    if (data.size() < 6)
-    {
-        return QMatrix4x4();
-    }
-
-    // Ajusta una elipsoide del tipo Ax^2 + By^2 + Cz^2 + 2Dxy + 2Exz + 2Fyz + 2Gx + 2Hy + 2Iz = 1
-    Eigen::MatrixXf equation_params( data.size(), 9 );
-    for (size_t i = 0; i < data.size(); ++i)
-    {
-        auto row = data[i];
-        equation_params.row(i) <<
-            row.x()*row.x(),
-            row.y()*row.y(),
-            row.z()*row.z(),
-            2*row.x()*row.y(),
-            2*row.x()*row.z(),
-            2*row.y()*row.z(),
-            2*row.x(),
-            2*row.y(),
-            2*row.z();
-    }
-
-    // Resuelve el sistema de ecuaciones
-    Eigen::MatrixXf mA = equation_params.transpose() * equation_params;
-    Eigen::VectorXf mB = mA.colwise().sum();
-    Eigen::VectorXf v = mA.fullPivLu().solve(mB);
-
-    // Forma algebraica de la elipsoide
-    Eigen::Matrix4f A;
-    A << v[0], v[3], v[4], v[6],
-         v[3], v[1], v[5], v[7],
-         v[4], v[5], v[2], v[8],
-         v[6], v[7], v[8], -1;
-
-    // Calcula el centro de la elipsoide
-    Eigen::Vector3f center = -A.block(0,0,3,3).inverse() * Eigen::Vector3f(v[6], v[7], v[8]);
-
-    // Calcula la matriz de traslación
-    Eigen::Matrix4f T;
-    T << 1, 0, 0, 0,
-         0, 1, 0, 0,
-         0, 0, 1, 0,
-         center[0], center[1], center[2], 1;
-
-    // Traslada al centro
-    Eigen::Matrix4f R = T * A * T.transpose();
-
-    // Resuelve el eigenproblema
-    auto es = Eigen::EigenSolver<Eigen::MatrixXf>(R.block(0, 0, 3, 3) / -R(3, 3));
-    auto evals = es.eigenvalues();
-    auto evecs = es.eigenvectors();
-    Eigen::Vector3f radii(
-        1.0 / sqrt(std::abs(evals(0))),
-        1.0 / sqrt(std::abs(evals(1))),
-        1.0 / sqrt(std::abs(evals(2))));
-    Eigen::Vector3f scale(
-        radii.maxCoeff() / radii[0],
-        radii.maxCoeff() / radii[1],
-        radii.maxCoeff() / radii[2]);
-
-    // Matriz de traslación
-    Eigen::Matrix4f mt;
-    mt << 1.0, 0.0, 0.0, -center[0],
-          0.0, 1.0, 0.0, -center[1],
-          0.0, 0.0, 1.0, -center[2],
-          0.0, 0.0, 0.0, 1.0;
-
-    // Matriz de rotación
-    auto rot = evecs.inverse();
-    Eigen::Matrix4f mr;
-    mr << std::abs(rot(0,0)), std::abs(rot(0,1)), std::abs(rot(0,2)), 0.0f,
-          std::abs(rot(1,0)), std::abs(rot(1,1)), std::abs(rot(1,2)), 0.0f,
-          std::abs(rot(2,0)), std::abs(rot(2,1)), std::abs(rot(2,2)), 0.0f,
-          0.0f, 0.0f, 0.0f, 1.0f;
-
-    // Matriz de escalado
-    Eigen::Matrix4f ms;
-    ms << scale[0], 0.0, 0.0, 0.0,
-          0.0, scale[1], 0.0, 0.0,
-          0.0, 0.0, scale[2], 0.0,
-          0.0, 0.0, 0.0, 1.0;
-
-    // Matriz final
-    auto what = ms * mr * mt;
-    return QMatrix4x4();
-}
-*/
-
-
-
-///
-/// \brief Trocea una línea en clave y valores.
-/// \param line Línea de texto.
-/// \return Par clave-valores.
-///
-std::tuple<QString, QList<float>> ParseLine(const QString& line)
-{
-    // Ignora los comentarios y las líneas vacías
-    if (line.isNull() || line.isEmpty() || (line[0] == '#'))
-        return std::make_tuple(QString(), QList<float>());
-
-    // Trocea la línea en clave y valores
-    const auto fields = line.trimmed().split(' ');
-    const auto header = fields[0].toLower();
-    QList<float> values;
-    for( int i=1 ; i<fields.size() ; ++i ) {
-        bool ok;
-        float val = QString(fields[i]).toFloat(&ok);
-        if( ok ) values.append(val);
-        else values.append(NAN);
-    }
-    return std::make_tuple(header, values);
-}
+#include "types.h"
+
+#include <cctype>
+#include <cmath>
+
+
+
+///
+/// \brief Compara una cabecera con una clave en minúsculas, sin distinguir mayúsculas.
+/// \param header Cabecera recibida.
+/// \param key Clave en minúsculas, de la misma longitud que la cabecera.
+/// \param size Longitud de ambas cadenas.
+/// \return Verdadero si coinciden.
+///
+static bool HeaderEquals(const char* header, const char* key, int size)
+{
+    for (int i = 0; i < size; ++i) {
+        char c = header[i];
+        if ((c >= 'A') && (c <= 'Z')) c += 'a' - 'A';
+        if (c != key[i]) return false;
+    }
+    return true;
+}
+
+
+
+///
+/// \brief Identifica el tipo de muestra a partir de la cabecera de la línea.
+/// \param header Cabecera, sin terminar en nulo.
+/// \param size Longitud de la cabecera.
+/// \return Tipo de muestra, o SampleNone si la cabecera es desconocida.
+///
+static SampleType ClassifyHeader(const char* header, int size)
+{
+    // Las cabeceras se distinguen por su longitud y, a igual longitud, por un solo carácter
+    switch (size) {
+    case 4:
+        return HeaderEquals(header, "wxyz", 4) ? SampleOrientation : SampleNone;
+    case 5:
+        return HeaderEquals(header, "force", 5) ? SampleForce : SampleNone;
+    case 7:
+        switch (header[4] | 0x20) {
+        case 'a': return HeaderEquals(header, "raw_adc", 7) ? SampleRawAnalog : SampleNone;
+        case 'g': return HeaderEquals(header, "raw_gam", 7) ? SampleRawSensors : SampleNone;
+        default: return SampleNone;
+        }
+    default:
+        return SampleNone;
+    }
+}
+
+
+
+///
+/// \brief Número de valores que acompañan a cada tipo de muestra.
+/// \param type Tipo de muestra.
+/// \return Número de valores esperados.
+///
+static int ExpectedValues(SampleType type)
+{
+    switch (type) {
+    case SampleOrientation: return 4;
+    case SampleForce: return 4;
+    case SampleRawAnalog: return 6;
+    case SampleRawSensors: return 9;
+    default: return 0;
+    }
+}
+
+
+
+///
+/// \brief Convierte un campo de texto a número real, sin depender de la configuración regional.
+/// \param begin Primer carácter del campo.
+/// \param end Carácter siguiente al último del campo.
+/// \return Valor del campo, o NAN si no es un número válido.
+///
+static float ParseField(const char* begin, const char* end)
+{
+    static const double powers[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+    const char* p = begin;
+    bool negative = false;
+    if ((p != end) && ((*p == '-') || (*p == '+'))) {
+        negative = (*p == '-');
+        ++p;
+    }
+
+    // Mantisa, acumulada como entero mientras quepa en 19 cifras
+    uint64_t mantissa = 0;
+    int exponent = 0, digits = 0;
+    for (; (p != end) && (*p >= '0') && (*p <= '9'); ++p, ++digits) {
+        if (mantissa < 1000000000000000000ull) mantissa = 10 * mantissa + (*p - '0');
+        else ++exponent;
+    }
+    if ((p != end) && (*p == '.')) {
+        for (++p; (p != end) && (*p >= '0') && (*p <= '9'); ++p, ++digits) {
+            if (mantissa < 1000000000000000000ull) {
+                mantissa = 10 * mantissa + (*p - '0');
+                --exponent;
+            }
+        }
+    }
+    if (digits == 0) return NAN;
+
+    // Exponente decimal opcional
+    if ((p != end) && ((*p == 'e') || (*p == 'E'))) {
+        ++p;
+        bool negativeExp = false;
+        if ((p != end) && ((*p == '-') || (*p == '+'))) {
+            negativeExp = (*p == '-');
+            ++p;
+        }
+        if ((p == end) || (*p < '0') || (*p > '9')) return NAN;
+        int value = 0;
+        for (; (p != end) && (*p >= '0') && (*p <= '9'); ++p) {
+            if (value < 10000) value = 10 * value + (*p - '0');
+        }
+        exponent += negativeExp ? -value : value;
+    }
+    if (p != end) return NAN;
+
+    double result = double(mantissa);
+    if ((exponent >= -22) && (exponent <= 22)) {
+        result = (exponent < 0) ? result / powers[-exponent] : result * powers[exponent];
+    }
+    else {
+        result *= std::pow(10.0, exponent);
+    }
+    return float(negative ? -result : result);
+}
+
+
+
+///
+/// \brief Interpreta una línea de telemetría directamente sobre los bytes recibidos, sin reservar memoria.
+/// \param line Bytes de la línea, no necesariamente terminados en nulo.
+/// \param size Número de bytes de la línea.
+/// \param sample Muestra donde se escribe el resultado.
+/// \return Verdadero si la línea es una muestra conocida con el número correcto de valores.
+///
+bool ParseTelemetry(const char* line, int size, TelemetrySample& sample)
+{
+    sample.m_type = SampleNone;
+    sample.m_count = 0;
+
+    // Recorta los espacios y el fin de línea
+    const char* p = line;
+    const char* end = line + size;
+    while ((p != end) && isspace(static_cast<unsigned char>(*p))) ++p;
+    while ((end != p) && isspace(static_cast<unsigned char>(end[-1]))) --end;
+
+    // Ignora los comentarios y las líneas vacías
+    if ((p == end) || (*p == '#'))
+        return false;
+
+    // Cabecera
+    const char* header = p;
+    while ((p != end) && !isspace(static_cast<unsigned char>(*p))) ++p;
+    const SampleType type = ClassifyHeader(header, int(p - header));
+    if (type == SampleNone)
+        return false;
+
+    // Valores
+    while (p != end) {
+        while ((p != end) && isspace(static_cast<unsigned char>(*p))) ++p;
+        const char* field = p;
+        while ((p != end) && !isspace(static_cast<unsigned char>(*p))) ++p;
+        if (field == p) break;
+        if (sample.m_count == TelemetrySample::MaxValues) return false;
+        sample.m_values[sample.m_count++] = ParseField(field, p);
+    }
+
+    sample.m_type = type;
+    return sample.m_count == ExpectedValues(type);
+}
@@ -0,0 +1,147 @@
+#include "viewset.h"
+
+#include <algorithm>
+
+
+
+// Se antepone al vertex shader de los objetos; éste llama a viewPosition() en lugar de multiplicar por la cámara
+static const char* header =
+    "layout(std140) uniform Views {\n"
+    "mat4 view_matrix[MAX_VIEWS];\n"
+    "vec4 view_rect[MAX_VIEWS];\n"
+    "};\n"
+    "uniform int first_view;\n"
+    "out float gl_ClipDistance[4];\n"
+    "vec4 viewPosition(vec4 position) {\n"
+    "int view = first_view + gl_InstanceID;\n"
+    "vec4 p = view_matrix[view] * position;\n"
+    "vec4 r = view_rect[view];\n"
+    "p.xy = 0.5*(r.zw - r.xy)*p.xy + 0.5*(r.zw + r.xy)*p.w;\n"
+    "gl_ClipDistance[0] = p.x - r.x*p.w;\n"
+    "gl_ClipDistance[1] = r.z*p.w - p.x;\n"
+    "gl_ClipDistance[2] = p.y - r.y*p.w;\n"
+    "gl_ClipDistance[3] = r.w*p.w - p.y;\n"
+    "return p;\n"
+    "}\n";
+
+
+
+///
+/// \brief Constructor, necesita activo un contexto de OpenGL 3.3 o posterior.
+///
+/// Renderer::initializeGL() comprueba el contexto antes de crear ningún objeto.
+///
+ViewSet::ViewSet() : m_count(0)
+{
+    const bool resolved = initializeOpenGLFunctions();
+    Q_ASSERT(resolved);
+    Q_UNUSED(resolved);
+    glGenBuffers(1, &m_buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(Block), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+
+
+///
+/// \brief Destructor.
+///
+ViewSet::~ViewSet()
+{
+    glDeleteBuffers(1, &m_buffer);
+}
+
+
+
+///
+/// \brief Quita todas las vistas.
+///
+void ViewSet::clear()
+{
+    m_count = 0;
+}
+
+
+
+///
+/// \brief Añade una vista.
+/// \param pvMatrix Proyección y vista.
+/// \param x, y Esquina inferior izquierda de la vista en la ventana, en píxeles.
+/// \param width, height Tamaño de la vista en píxeles.
+/// \return Índice de la vista, o -1 si ya hay MaxViews.
+///
+int ViewSet::add(const QMatrix4x4& pvMatrix, int x, int y, int width, int height)
+{
+    if(m_count >= MaxViews) return -1;
+    std::copy(pvMatrix.constData(), pvMatrix.constData() + 16, m_block.m_matrix[m_count]);
+    m_block.m_rect[m_count][0] = GLfloat(x);
+    m_block.m_rect[m_count][1] = GLfloat(y);
+    m_block.m_rect[m_count][2] = GLfloat(x + width);
+    m_block.m_rect[m_count][3] = GLfloat(y + height);
+    return m_count++;
+}
+
+
+
+///
+/// \brief Número de vistas.
+///
+int ViewSet::size() const
+{
+    return m_count;
+}
+
+
+
+///
+/// \brief Sube las vistas y prepara el dibujo con instancias; el viewport tiene que cubrir toda la ventana.
+/// \param width, height Tamaño de la ventana en píxeles.
+///
+void ViewSet::bind(int width, int height)
+{
+    // Los rectángulos se guardan en píxeles y se suben en coordenadas normalizadas
+    Block block = m_block;
+    for(int i=0 ; i<m_count ; ++i) {
+        block.m_rect[i][0] = 2.0f * block.m_rect[i][0] / std::max(width, 1) - 1.0f;
+        block.m_rect[i][1] = 2.0f * block.m_rect[i][1] / std::max(height, 1) - 1.0f;
+        block.m_rect[i][2] = 2.0f * block.m_rect[i][2] / std::max(width, 1) - 1.0f;
+        block.m_rect[i][3] = 2.0f * block.m_rect[i][3] / std::max(height, 1) - 1.0f;
+    }
+
+    glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Block), &block);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, Binding, m_buffer);
+
+    glEnable(GL_CLIP_DISTANCE0);
+    glEnable(GL_CLIP_DISTANCE1);
+    glEnable(GL_CLIP_DISTANCE2);
+    glEnable(GL_CLIP_DISTANCE3);
+}
+
+
+
+///
+/// \brief Termina el dibujo con instancias.
+///
+void ViewSet::release()
+{
+    glDisable(GL_CLIP_DISTANCE0);
+    glDisable(GL_CLIP_DISTANCE1);
+    glDisable(GL_CLIP_DISTANCE2);
+    glDisable(GL_CLIP_DISTANCE3);
+}
+
+
+
+///
+/// \brief Principio de los vertex shaders que dibujan con instancias en las vistas de un ViewSet.
+/// \return La línea #version, la declaración del bloque "Views" y la de viewPosition().
+///
+QByteArray ViewSet::vertexHeader()
+{
+    QByteArray source("#version 330 core\n");
+    source.append("#define MAX_VIEWS ").append(QByteArray::number(MaxViews)).append('\n');
+    return source.append(header);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <QOpenGLFunctions_3_3_Core>
+
+#include "types.h"
+
+
+
+///
+/// \brief Varias vistas de la misma escena, dibujadas con una sola llamada por objeto.
+///
+/// Guarda la proyección y vista de cada una y su rectángulo en la ventana en un uniform buffer, el
+/// bloque "Views" de los shaders. Los objetos se dibujan con instancias, una por vista: el shader toma
+/// la matriz de la vista first_view + gl_InstanceID, lleva el resultado a su rectángulo y lo recorta
+/// con gl_ClipDistance, lo mismo que hacían glViewport() y el recorte del volumen de visión. Así se
+/// ahorran los cambios de viewport y de uniforms y casi todas las llamadas de dibujo. Como las cámaras
+/// de todas las vistas están en el bloque, los objetos no tienen uniforms de cámara.
+///
+class ViewSet : protected QOpenGLFunctions_3_3_Core
+{
+public:
+    static const int MaxViews = 8;
+    static const GLuint Binding = 0;
+
+    ViewSet();
+    ~ViewSet();
+
+    void clear();
+    int add(const QMatrix4x4& pvMatrix, int x, int y, int width, int height);
+    int size() const;
+    void bind(int width, int height);
+    void release();
+
+    static QByteArray vertexHeader();
+
+private:
+    ///
+    /// \brief Contenido del bloque "Views", con la disposición std140.
+    ///
+    struct Block
+    {
+        GLfloat m_matrix[MaxViews][16];
+        GLfloat m_rect[MaxViews][4];
+    };
+
+    GLuint m_buffer;
+    Block m_block;
+    int m_count;
+};
@@ -0,0 +1,102 @@
+#include "wireframe.h"
+
+#include <cmath>
+#include <vector>
+
+
+
+static const char* vertex =
+    "uniform mat4 model_matrix;\n"
+    "in vec4 v_position;\n"
+    "void main() { gl_Position = viewPosition(model_matrix * v_position); }\n";
+
+static const char* fragment =
+    "#version 330 core\n"
+    "uniform vec4 color;\n"
+    "out vec4 frag_color;\n"
+    "void main() { frag_color = color; }\n";
+
+
+
+///
+/// \brief Constructor, genera los círculos de la esfera.
+///
+Wireframe::Wireframe()
+{
+    std::vector<QVector3D> lines;
+    for (int i = 0; i < Circles; ++i) {
+        // Meridiano, en el plano que contiene al eje z con azimut i·π/Circles
+        const float azimuth = i * M_PI / Circles;
+        // Paralelo, a la latitud i·π/Circles; el i = 0 sería el polo
+        const float polar = i * M_PI / Circles;
+        for (int j = 0; j < Segments; ++j) {
+            const float a0 = j * 2.0 * M_PI / Segments, a1 = (j + 1) * 2.0 * M_PI / Segments;
+            lines.push_back(QVector3D(cos(azimuth) * sin(a0), sin(azimuth) * sin(a0), cos(a0)));
+            lines.push_back(QVector3D(cos(azimuth) * sin(a1), sin(azimuth) * sin(a1), cos(a1)));
+            if (i == 0) continue;
+            lines.push_back(QVector3D(sin(polar) * cos(a0), sin(polar) * sin(a0), cos(polar)));
+            lines.push_back(QVector3D(sin(polar) * cos(a1), sin(polar) * sin(a1), cos(polar)));
+        }
+    }
+    m_vertex_count = GLsizei(lines.size());
+
+    glGenBuffers(1, &m_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    glBufferData(GL_ARRAY_BUFFER, lines.size() * sizeof(QVector3D), lines.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    link(vertex, fragment);
+    m_model_matrix = m_shader.uniformLocation("model_matrix");
+    m_color = m_shader.uniformLocation("color");
+    m_vao.create();
+    m_vao.bind();
+    setupVertexArray();
+    m_vao.release();
+}
+
+
+
+///
+/// \brief Destructor.
+///
+Wireframe::~Wireframe()
+{
+    m_vao.destroy();
+    glDeleteBuffers(1, &m_buffer);
+}
+
+
+
+///
+/// \brief Describe los vértices en el VAO activo.
+///
+void Wireframe::setupVertexArray()
+{
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    int positionLocation = m_shader.attributeLocation("v_position");
+    m_shader.enableAttributeArray(positionLocation);
+    glVertexAttribPointer(positionLocation, 3, GL_FLOAT, GL_FALSE, sizeof(QVector3D), 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+
+
+///
+/// \brief Renderiza la esfera en varias vistas del ViewSet activo con una sola llamada.
+/// \param first Primera vista.
+/// \param count Número de vistas.
+/// \param modelMatrix Modelo, que convierte la esfera unidad en la elipsoide.
+/// \param color Color de las líneas.
+///
+void Wireframe::render(int first, int count, const QMatrix4x4& modelMatrix, const QVector4D& color)
+{
+    m_shader.bind();
+    m_shader.setUniformValue(uniform("first_view", m_first_view), first);
+    m_shader.setUniformValue(uniform("model_matrix", m_model_matrix), modelMatrix);
+    m_shader.setUniformValue(uniform("color", m_color), color);
+
+    m_vao.bind();
+    if(!cachedState()) setupVertexArray();
+    glDrawArraysInstanced(GL_LINES, 0, m_vertex_count, count);
+    m_vao.release();
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "renderobject.h"
+
+
+
+///
+/// \brief Esfera unidad en alambre, para dibujar elipsoides ajustadas con su matriz de modelo.
+///
+/// Son Circles meridianos y Circles-1 paralelos, cada uno con Segments segmentos, en un único búfer
+/// estático de líneas.
+///
+class Wireframe : public RenderObject
+{
+public:
+    static const int Circles = 12;
+    static const int Segments = 48;
+
+    Wireframe();
+    ~Wireframe();
+    void render(int first, int count, const QMatrix4x4& modelMatrix, const QVector4D& color);
+
+private:
+    GLuint m_buffer;
+    GLsizei m_vertex_count;
+    QOpenGLVertexArrayObject m_vao;
+    int m_model_matrix, m_color;
+
+    void setupVertexArray();
+};
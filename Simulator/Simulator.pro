@@ -0,0 +1,25 @@
+#-------------------------------------------------
+#
+# IMU simulator on a Linux pseudo-terminal
+#
+#-------------------------------------------------
+
+QT += core gui
+QT -= widgets
+
+CONFIG += console c++17
+CONFIG -= app_bundle
+QMAKE_CXXFLAGS += -std=c++17
+
+TARGET = imu-simulator
+
+TEMPLATE = app
+
+INCLUDEPATH += ..
+
+SOURCES += main.cpp \
+    imusimulator.cpp \
+    ../binaryprotocol.cpp
+
+HEADERS += imusimulator.h \
+    ../binaryprotocol.h
@@ -0,0 +1,475 @@
+#include "imusimulator.h"
+
+#include <QFile>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "binaryprotocol.h"
+
+static const float PI = 3.14159265358979f;
+static const QVector3D MAGNETIC_FIELD(0.0f, 0.5f, -0.866f);
+
+
+
+///
+/// \brief Transformación que lleva la esfera unidad a la elipsoide de un sensor.
+/// \param radii Diagonal de la matriz de distorsión.
+/// \param cross Elementos xy, xz e yz de la matriz de distorsión, que es simétrica.
+/// \param center Centro.
+/// \return Matriz de distorsión con la traslación.
+///
+static QMatrix4x4 Distortion(const QVector3D& radii, const QVector3D& cross, const QVector3D& center)
+{
+    return QMatrix4x4(
+        radii.x(), cross.x(), cross.y(), center.x(),
+        cross.x(), radii.y(), cross.z(), center.y(),
+        cross.y(), cross.z(), radii.z(), center.z(),
+        0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+
+
+///
+/// \brief Constructor.
+/// \param options Configuración del simulador.
+/// \param parent Objeto padre.
+///
+ImuSimulator::ImuSimulator(const SimulatorOptions& options, QObject* parent) :
+    QObject(parent),
+    m_options(options),
+    m_master(-1),
+    m_slave(-1),
+    m_notifier(nullptr),
+    m_write_notifier(nullptr),
+    m_random(12345),
+    m_gaussian(0.0f, float(options.m_noise))
+{
+    m_streaming = StreamNone;
+    m_binary = false;
+    m_stream_start = 0;
+    m_samples_due = 0;
+    m_samples_sent = 0;
+    m_samples_dropped = 0;
+    m_bytes_budget = 0.0;
+    m_budget_time = 0;
+    m_bytes_sent = 0;
+    m_last_bytes = 0;
+    m_last_samples = 0;
+    m_acc_distortion = Distortion(options.m_acc_radii, options.m_acc_cross, options.m_acc_center);
+    m_mag_distortion = Distortion(options.m_mag_radii, options.m_mag_cross, options.m_mag_center);
+
+    m_timer.setTimerType(Qt::PreciseTimer);
+    connect(&m_timer, &QTimer::timeout, this, &ImuSimulator::stream);
+    connect(&m_report_timer, &QTimer::timeout, this, &ImuSimulator::report);
+}
+
+
+
+///
+/// \brief Destructor, cierra el pseudoterminal.
+///
+ImuSimulator::~ImuSimulator()
+{
+    delete m_notifier;
+    delete m_write_notifier;
+    if(m_slave >= 0) ::close(m_slave);
+    if(m_master >= 0) ::close(m_master);
+    if(!m_options.m_link.isEmpty()) QFile::remove(m_options.m_link);
+}
+
+
+
+///
+/// \brief Crea el pseudoterminal y empieza a atender comandos.
+/// \return Falso si no se ha podido crear.
+///
+bool ImuSimulator::open()
+{
+    m_master = posix_openpt(O_RDWR | O_NOCTTY);
+    if((m_master < 0) || (grantpt(m_master) != 0) || (unlockpt(m_master) != 0)) {
+        perror("posix_openpt");
+        return false;
+    }
+    fcntl(m_master, F_SETFL, fcntl(m_master, F_GETFL) | O_NONBLOCK);
+    m_port_name = QString::fromLocal8Bit(ptsname(m_master));
+
+    // El extremo esclavo se mantiene abierto para que el maestro no dé EIO entre conexiones
+    m_slave = ::open(ptsname(m_master), O_RDWR | O_NOCTTY);
+    if(m_slave < 0) {
+        perror("open slave");
+        return false;
+    }
+    termios tio;
+    tcgetattr(m_slave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(m_slave, TCSANOW, &tio);
+
+    if(!m_options.m_link.isEmpty()) {
+        QFile::remove(m_options.m_link);
+        if(!QFile::link(m_port_name, m_options.m_link)) {
+            fprintf(stderr, "Couldn't create the link %s\n", qPrintable(m_options.m_link));
+        }
+    }
+
+    m_notifier = new QSocketNotifier(m_master, QSocketNotifier::Read);
+    connect(m_notifier, &QSocketNotifier::activated, this, &ImuSimulator::readCommands);
+    m_write_notifier = new QSocketNotifier(m_master, QSocketNotifier::Write);
+    m_write_notifier->setEnabled(false);
+    connect(m_write_notifier, &QSocketNotifier::activated, this, &ImuSimulator::flushPending);
+    m_clock.start();
+    m_report_timer.start(1000);
+    return true;
+}
+
+
+
+///
+/// \brief Nombre del pseudoterminal, para abrirlo desde la aplicación.
+///
+QString ImuSimulator::portName() const
+{
+    return m_port_name;
+}
+
+
+
+///
+/// \brief Calibración exacta para una elipsoide, en el mismo formato que los ajustes de elipsoide.
+/// \param radii Diagonal de la matriz de distorsión.
+/// \param cross Elementos xy, xz e yz de la matriz de distorsión.
+/// \param center Centro.
+/// \return Matriz que lleva la elipsoide a la esfera unidad. Como la distorsión es simétrica, su
+/// inversa también lo es y coincide con la que da el ajuste orientado (EllipsoidOriented).
+///
+QMatrix4x4 ImuSimulator::expectedCalibration(const QVector3D& radii, const QVector3D& cross, const QVector3D& center) const
+{
+    return Distortion(radii, cross, center).inverted();
+}
+
+
+
+///
+/// \brief Lee los comandos recibidos y los procesa línea a línea.
+///
+void ImuSimulator::readCommands()
+{
+    char buffer[256];
+    ssize_t size;
+    while((size = ::read(m_master, buffer, sizeof(buffer))) > 0) {
+        for(ssize_t i=0 ; i<size ; ++i) {
+            if((buffer[i] == '\n') || (buffer[i] == '\r')) {
+                if(!m_command.trimmed().isEmpty()) processCommand(m_command.trimmed().toLower());
+                m_command.clear();
+            }
+            else {
+                m_command.append(buffer[i]);
+            }
+        }
+    }
+}
+
+
+
+///
+/// \brief Responde a un comando, igual que el firmware del IMU.
+/// \param command Comando, sin fin de línea.
+///
+void ImuSimulator::processCommand(const QByteArray& command)
+{
+    printf("> %s\n", command.constData());
+    fflush(stdout);
+
+    const QList<QByteArray> fields = command.split(' ');
+    const QByteArray verb = fields.value(0);
+    const QByteArray target = fields.value(1);
+
+    if(verb == "reset") {
+        startStreaming(StreamNone);
+        m_binary = false;
+    }
+    else if((verb == "read") && (target == "uid")) {
+        reply("uid " + m_options.m_uid.toLatin1());
+    }
+    else if((verb == "read") && ((target == "acc") || (target == "mag") || (target == "gyr"))) {
+        const QMatrix4x4& calib = (target == "acc") ? m_acc_calib : (target == "mag") ? m_mag_calib : m_gyr_calib;
+        QByteArray line = target;
+        for(int i=0 ; i<12 ; ++i) {
+            line += ' ' + QByteArray::number(calib(i / 4, i % 4), 'f', 6);
+        }
+        reply(line);
+    }
+    else if((verb == "write") && ((target == "acc") || (target == "mag") || (target == "gyr")) && (fields.size() == 14)) {
+        QMatrix4x4& calib = (target == "acc") ? m_acc_calib : (target == "mag") ? m_mag_calib : m_gyr_calib;
+        for(int i=0 ; i<12 ; ++i) {
+            calib(i / 4, i % 4) = fields[i + 2].toFloat();
+        }
+    }
+    else if((verb == "start") && (target == "ori")) {
+        startStreaming(StreamOrientation);
+    }
+    else if((verb == "start") && (target == "cal")) {
+        startStreaming(StreamCalibration);
+    }
+    else if((verb == "start") && (target == "all")) {
+        startStreaming(StreamAll);
+    }
+    else if(verb == "stop") {
+        startStreaming(StreamNone);
+    }
+    else if((verb == "format") && ((target == "bin") || (target == "txt"))) {
+        // El cambio se confirma todavía en el formato anterior
+        reply(command);
+        reply("ready");
+        m_binary = (target == "bin");
+        return;
+    }
+    else {
+        reply("error: unknown command");
+    }
+    reply("ready");
+}
+
+
+
+///
+/// \brief Envía una línea de respuesta, como texto o como trama de texto.
+/// \param line Línea, sin fin de línea.
+///
+/// Las respuestas consumen ancho de banda del enlace pero nunca se descartan.
+///
+void ImuSimulator::reply(const QByteArray& line)
+{
+    if(m_binary) {
+        uint8_t frame[FRAME_MAX_SIZE];
+        const int size = EncodeTextFrame(line.constData(), line.size(), frame);
+        writeAll(reinterpret_cast<const char*>(frame), size);
+        m_bytes_budget -= size;
+    }
+    else {
+        const QByteArray data = line + "\r\n";
+        writeAll(data.constData(), data.size());
+        m_bytes_budget -= data.size();
+    }
+}
+
+
+
+///
+/// \brief Cambia la telemetría que se emite.
+/// \param streaming Tipo de telemetría, o StreamNone para pararla.
+///
+void ImuSimulator::startStreaming(Streaming streaming)
+{
+    m_streaming = streaming;
+    m_stream_start = m_clock.nsecsElapsed();
+    m_budget_time = m_stream_start;
+    m_bytes_budget = 0.0;
+    m_samples_due = 0;
+    if(streaming == StreamNone) m_timer.stop();
+    else m_timer.start(1);
+}
+
+
+
+///
+/// \brief Emite las muestras que tocan hasta el instante actual, dentro del ancho de banda del enlace.
+///
+/// Si el enlace está saturado la muestra se descarta, como haría el firmware con su cola llena.
+///
+void ImuSimulator::stream()
+{
+    const qint64 now = m_clock.nsecsElapsed();
+    if(m_options.m_baud > 0) {
+        // 10 bits por byte, con una ráfaga máxima de 10 ms
+        const double bytesPerSecond = m_options.m_baud / 10.0;
+        m_bytes_budget = std::min(m_bytes_budget + (now - m_budget_time) * 1e-9 * bytesPerSecond, bytesPerSecond * 0.01);
+        m_budget_time = now;
+    }
+
+    const quint64 due = quint64((now - m_stream_start) * 1e-9 * m_options.m_rate);
+    while(m_samples_due < due) {
+        const double t = ++m_samples_due / m_options.m_rate;
+        const QQuaternion q = orientation(t);
+
+        // "start all" emite a la vez la orientación del firmware y las medidas para fusionarlas en el PC
+        if((m_streaming == StreamOrientation) || (m_streaming == StreamAll)) {
+            const float ori[4] = { q.scalar(), q.x(), q.y(), q.z() };
+            const float force[4] = {
+                0.2f * std::sin(float(t)), 0.1f * std::cos(float(t)),
+                1.0f + 0.05f * std::sin(3.0f * float(t)), 0.01f * std::sin(0.5f * float(t))
+            };
+            sendSample(FrameOrientation, "wxyz", ori, 4);
+            sendSample(FrameForce, "force", force, 4);
+        }
+        if((m_streaming == StreamCalibration) || (m_streaming == StreamAll)) {
+            // Velocidad angular a partir de la orientación en el instante siguiente
+            const double dt = 1.0 / m_options.m_rate;
+            const QQuaternion dq = q.conjugated() * orientation(t + dt);
+            QVector3D axis;
+            float angle;
+            dq.getAxisAndAngle(&axis, &angle);
+            const QVector3D gyr = axis * (angle * PI / 180.0f / float(dt)) + m_options.m_gyr_bias;
+
+            const QVector3D acc = distort(q.conjugated().rotatedVector(QVector3D(0.0f, 0.0f, 1.0f)), m_acc_distortion);
+            const QVector3D mag = distort(q.conjugated().rotatedVector(MAGNETIC_FIELD), m_mag_distortion);
+            const float raw[9] = {
+                gyr.x() + m_gaussian(m_random), gyr.y() + m_gaussian(m_random), gyr.z() + m_gaussian(m_random),
+                acc.x(), acc.y(), acc.z(),
+                mag.x(), mag.y(), mag.z()
+            };
+            float adc[6];
+            for(int i=0 ; i<6 ; ++i) {
+                adc[i] = 1650.0f + 100.0f * std::sin(float(t) + i) + 1000.0f * m_gaussian(m_random);
+            }
+            sendSample(FrameRawSensors, "raw_gam", raw, 9);
+            sendSample(FrameRawAnalog, "raw_adc", adc, 6);
+        }
+    }
+}
+
+
+
+///
+/// \brief Muestra una vez por segundo el tráfico emitido.
+///
+void ImuSimulator::report()
+{
+    if(m_streaming == StreamNone) return;
+
+    const quint64 bytes = m_bytes_sent - m_last_bytes;
+    const quint64 samples = m_samples_sent - m_last_samples;
+    const double load = (m_options.m_baud > 0) ? 100.0 * bytes * 10.0 / m_options.m_baud : 0.0;
+    printf("%llu samples/s | %llu B/s | link %.0f%% | %llu dropped\n",
+           samples, bytes, load, m_samples_dropped);
+    fflush(stdout);
+    m_last_bytes = m_bytes_sent;
+    m_last_samples = m_samples_sent;
+}
+
+
+
+///
+/// \brief Envía una muestra en el formato activo.
+/// \param type Tipo de trama binaria.
+/// \param header Cabecera de la línea de texto.
+/// \param values Valores de la muestra.
+/// \param count Número de valores.
+/// \return Falso si la muestra se ha descartado por falta de ancho de banda.
+///
+bool ImuSimulator::sendSample(uint8_t type, const char* header, const float* values, int count)
+{
+    char buffer[FRAME_MAX_SIZE];
+    int size;
+    if(m_binary) {
+        if(m_options.m_packed) type |= FramePacked;
+        size = EncodeFrame(type, values, count, reinterpret_cast<uint8_t*>(buffer));
+    }
+    else {
+        size = snprintf(buffer, sizeof(buffer), "%s", header);
+        for(int i=0 ; i<count ; ++i) {
+            size += snprintf(buffer + size, sizeof(buffer) - size, " %.6f", values[i]);
+        }
+        size += snprintf(buffer + size, sizeof(buffer) - size, "\r\n");
+    }
+
+    // Si el pseudoterminal no ha vaciado lo anterior la muestra se descarta entera, como un enlace saturado
+    if(((m_options.m_baud > 0) && (size > m_bytes_budget)) || !m_pending.isEmpty()) {
+        ++m_samples_dropped;
+        return false;
+    }
+    m_bytes_budget -= size;
+    writeAll(buffer, size);
+    ++m_samples_sent;
+    return true;
+}
+
+
+
+///
+/// \brief Orientación sintética: tres giros de frecuencias inconmensurables, que recorren toda la esfera.
+/// \param seconds Instante.
+/// \return Orientación del IMU respecto al sistema ENU; la inicial si el IMU está quieto.
+///
+QQuaternion ImuSimulator::orientation(double seconds) const
+{
+    if(m_options.m_still) seconds = 0.0;
+    const float t = float(seconds);
+    return QQuaternion::fromAxisAndAngle(0.0f, 0.0f, 1.0f, 37.0f * t) *
+           QQuaternion::fromAxisAndAngle(1.0f, 0.0f, 0.0f, 23.0f * t) *
+           QQuaternion::fromAxisAndAngle(0.0f, 1.0f, 0.0f, 11.0f * t);
+}
+
+
+
+///
+/// \brief Aplica la distorsión de un sensor y el ruido a una dirección.
+/// \param direction Dirección unitaria en ejes del IMU.
+/// \param distortion Transformación de la esfera unidad a la elipsoide del sensor.
+/// \return Lectura del sensor sin calibrar.
+///
+QVector3D ImuSimulator::distort(const QVector3D& direction, const QMatrix4x4& distortion)
+{
+    const QVector3D noise(m_gaussian(m_random), m_gaussian(m_random), m_gaussian(m_random));
+    return distortion.map(direction.normalized()) + noise;
+}
+
+
+
+///
+/// \brief Escribe todos los bytes en el pseudoterminal, sin perder ninguno.
+/// \param data Bytes.
+/// \param size Número de bytes.
+///
+/// El maestro no es bloqueante: lo que no cabe en el buffer del pseudoterminal se guarda en m_pending y se
+/// envía cuando vuelve a admitir escrituras, para no cortar una trama a medias.
+///
+void ImuSimulator::writeAll(const char* data, int size)
+{
+    // Con datos pendientes se encola detrás, para conservar el orden
+    if(m_pending.isEmpty()) {
+        while(size > 0) {
+            const ssize_t written = ::write(m_master, data, size);
+            if(written < 0) {
+                if(errno == EINTR) continue;
+                if((errno != EAGAIN) && (errno != EWOULDBLOCK)) perror("write");
+                break;
+            }
+            data += written;
+            size -= int(written);
+            m_bytes_sent += written;
+        }
+    }
+    if(size > 0) {
+        m_pending.append(data, size);
+        m_write_notifier->setEnabled(true);
+    }
+}
+
+
+
+///
+/// \brief Envía los bytes pendientes cuando el pseudoterminal vuelve a admitir escrituras.
+///
+void ImuSimulator::flushPending()
+{
+    int offset = 0;
+    while(offset < m_pending.size()) {
+        const ssize_t written = ::write(m_master, m_pending.constData() + offset, m_pending.size() - offset);
+        if(written < 0) {
+            if(errno == EINTR) continue;
+            if((errno != EAGAIN) && (errno != EWOULDBLOCK)) perror("write");
+            break;
+        }
+        offset += int(written);
+        m_bytes_sent += written;
+    }
+    m_pending.remove(0, offset);
+    m_write_notifier->setEnabled(!m_pending.isEmpty());
+}
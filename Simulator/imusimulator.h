@@ -0,0 +1,96 @@
+#pragma once
+
+#include <QElapsedTimer>
+#include <QMatrix4x4>
+#include <QObject>
+#include <QQuaternion>
+#include <QSocketNotifier>
+#include <QTimer>
+#include <QVector3D>
+
+#include <random>
+
+
+
+///
+/// \brief Configuración del simulador.
+///
+/// La tasa es de muestras por segundo de cada tipo; la velocidad del enlace, en baudios, con 0 para no
+/// limitarla. Las elipsoides de los sensores se dan por sus semiejes y su centro, en las unidades del
+/// sensor, y el ruido es la desviación típica de un ruido gaussiano en esas mismas unidades. Los términos
+/// cruzados (xy, xz, yz) son los elementos fuera de la diagonal de la matriz de distorsión, que es
+/// simétrica; con ellos distintos de cero la elipsoide está girada, como con la distorsión soft-iron.
+/// El giróscopo suma un sesgo constante, en radianes/s; quieto, el IMU no gira y el giróscopo sólo mide
+/// su sesgo y su ruido.
+///
+struct SimulatorOptions
+{
+    QString m_link;
+    QString m_uid;
+    double m_rate;
+    int m_baud;
+    double m_noise;
+    bool m_packed;
+    bool m_still;
+    QVector3D m_gyr_bias;
+    QVector3D m_acc_radii, m_acc_cross, m_acc_center;
+    QVector3D m_mag_radii, m_mag_cross, m_mag_center;
+};
+
+
+
+///
+/// \brief IMU simulado sobre un pseudoterminal de Linux.
+///
+/// Responde a los mismos comandos que el firmware del IMU, con sus "ready", y emite telemetría
+/// sintética en texto o en tramas binarias. El enlace se limita a la velocidad configurada, de forma
+/// que con tasas altas se satura igual que el puerto serie real.
+///
+class ImuSimulator : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ImuSimulator(const SimulatorOptions& options, QObject* parent = 0);
+    ~ImuSimulator();
+    bool open();
+    QString portName() const;
+    QMatrix4x4 expectedCalibration(const QVector3D& radii, const QVector3D& cross, const QVector3D& center) const;
+
+private:
+    enum Streaming { StreamNone, StreamOrientation, StreamCalibration, StreamAll };
+
+    SimulatorOptions m_options;
+    int m_master, m_slave;
+    QString m_port_name;
+    QSocketNotifier* m_notifier;
+    QSocketNotifier* m_write_notifier;
+    QByteArray m_pending;
+    QTimer m_timer, m_report_timer;
+    QElapsedTimer m_clock;
+    std::mt19937 m_random;
+    std::normal_distribution<float> m_gaussian;
+
+    QByteArray m_command;
+    Streaming m_streaming;
+    bool m_binary;
+    QMatrix4x4 m_acc_calib, m_mag_calib, m_gyr_calib;
+    QMatrix4x4 m_acc_distortion, m_mag_distortion;
+    qint64 m_stream_start;
+    quint64 m_samples_due, m_samples_sent, m_samples_dropped;
+    double m_bytes_budget;
+    qint64 m_budget_time;
+    quint64 m_bytes_sent, m_last_bytes, m_last_samples;
+
+    void readCommands();
+    void processCommand(const QByteArray& command);
+    void reply(const QByteArray& line);
+    void startStreaming(Streaming streaming);
+    void stream();
+    void report();
+    bool sendSample(uint8_t type, const char* header, const float* values, int count);
+    QQuaternion orientation(double seconds) const;
+    QVector3D distort(const QVector3D& direction, const QMatrix4x4& distortion);
+    void writeAll(const char* data, int size);
+    void flushPending();
+};
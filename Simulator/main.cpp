@@ -0,0 +1,99 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+
+#include <cstdio>
+
+#include "imusimulator.h"
+
+
+
+///
+/// \brief Lee un vector "x,y,z" de la línea de comandos.
+/// \param text Texto con las tres componentes.
+/// \param fallback Valor si el texto no es válido.
+/// \return Vector leído.
+///
+static QVector3D ParseVector(const QString& text, const QVector3D& fallback)
+{
+    const QStringList fields = text.split(',');
+    if(fields.size() != 3) return fallback;
+    return QVector3D(fields[0].toFloat(), fields[1].toFloat(), fields[2].toFloat());
+}
+
+
+
+///
+/// \brief Escribe una calibración en el formato de los comandos "write acc", "write mag" y "write gyr".
+/// \param name Nombre del sensor.
+/// \param calib Matriz de calibración.
+///
+static void PrintCalibration(const char* name, const QMatrix4x4& calib)
+{
+    printf("expected %s calibration:", name);
+    for(int i=0 ; i<12 ; ++i) printf(" %f", calib(i / 4, i % 4));
+    printf("\n");
+}
+
+
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("imu-simulator");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Simulated IMU on a pseudo-terminal");
+    parser.addHelpOption();
+    parser.addOptions({
+        { "link", "Symlink to create for the pseudo-terminal.", "path" },
+        { "uid", "Unique id returned by \"read uid\".", "uid", "5151AB00" },
+        { "rate", "Samples per second of each type.", "hz", "200" },
+        { "baud", "Emulated link speed, 0 for unlimited.", "baud", "460800" },
+        { "noise", "Standard deviation of the sensor noise.", "sigma", "0.01" },
+        { "packed", "Send binary frames as int16 values." },
+        { "acc-radii", "Accelerometer ellipsoid semi-axes.", "x,y,z", "1.02,0.98,1.01" },
+        { "acc-cross", "Accelerometer cross-axis terms.", "xy,xz,yz", "0,0,0" },
+        { "acc-center", "Accelerometer ellipsoid center.", "x,y,z", "0.02,-0.01,0.03" },
+        { "mag-radii", "Magnetometer ellipsoid semi-axes.", "x,y,z", "0.9,1.1,1.05" },
+        { "mag-cross", "Magnetometer soft-iron cross terms.", "xy,xz,yz", "0,0,0" },
+        { "mag-center", "Magnetometer ellipsoid center.", "x,y,z", "0.2,-0.1,0.05" },
+        { "gyr-bias", "Gyroscope bias in rad/s.", "x,y,z", "0.01,-0.02,0.005" },
+        { "still", "Keep the IMU still, for the gyroscope calibration." },
+    });
+    parser.process(a);
+
+    SimulatorOptions options;
+    options.m_link = parser.value("link");
+    options.m_uid = parser.value("uid");
+    options.m_rate = parser.value("rate").toDouble();
+    options.m_baud = parser.value("baud").toInt();
+    options.m_noise = parser.value("noise").toDouble();
+    options.m_packed = parser.isSet("packed");
+    options.m_still = parser.isSet("still");
+    options.m_gyr_bias = ParseVector(parser.value("gyr-bias"), QVector3D());
+    options.m_acc_radii = ParseVector(parser.value("acc-radii"), QVector3D(1.0f, 1.0f, 1.0f));
+    options.m_acc_cross = ParseVector(parser.value("acc-cross"), QVector3D());
+    options.m_acc_center = ParseVector(parser.value("acc-center"), QVector3D());
+    options.m_mag_radii = ParseVector(parser.value("mag-radii"), QVector3D(1.0f, 1.0f, 1.0f));
+    options.m_mag_cross = ParseVector(parser.value("mag-cross"), QVector3D());
+    options.m_mag_center = ParseVector(parser.value("mag-center"), QVector3D());
+    if(options.m_rate <= 0.0) {
+        fprintf(stderr, "The rate must be positive\n");
+        return 1;
+    }
+
+    ImuSimulator simulator(options);
+    if(!simulator.open()) return 1;
+
+    printf("IMU simulator on %s", qPrintable(simulator.portName()));
+    if(!options.m_link.isEmpty()) printf(" (%s)", qPrintable(options.m_link));
+    printf("\n");
+    PrintCalibration("acc", simulator.expectedCalibration(options.m_acc_radii, options.m_acc_cross, options.m_acc_center));
+    PrintCalibration("mag", simulator.expectedCalibration(options.m_mag_radii, options.m_mag_cross, options.m_mag_center));
+    QMatrix4x4 gyr;
+    for(int i=0 ; i<3 ; ++i) gyr(i, 3) = -options.m_gyr_bias[i];
+    PrintCalibration("gyr", gyr);
+    fflush(stdout);
+
+    return a.exec();
+}
@@ -0,0 +1,329 @@
+#include "batchfit.h"
+
+#include <QtConcurrent>
+
+#include <algorithm>
+
+#include "streamrecorder.h"
+#include "telemetrydecoder.h"
+
+
+
+///
+/// \brief Número de muestras.
+///
+size_t FitDataset::size() const
+{
+    return m_acc[0].size();
+}
+
+
+
+///
+/// \brief Añade una muestra.
+/// \param acc Acelerómetro, tres valores.
+/// \param mag Magnetómetro, tres valores.
+///
+void FitDataset::append(const float* acc, const float* mag)
+{
+    for(int i=0 ; i<3 ; ++i) {
+        m_acc[i].push_back(acc[i]);
+        m_mag[i].push_back(mag[i]);
+    }
+}
+
+
+
+///
+/// \brief Decodifica una grabación del puerto serie y entrega sus muestras según se leen.
+///
+/// La decodifica igual que una reproducción, siguiendo los cambios de formato, sin guardar nada en memoria.
+/// \param fileName Ruta de la grabación.
+/// \param onSample Manejador de cada muestra, con el instante de llegada de su bloque en µs.
+/// \param error Si no es nulo, motivo del fallo.
+/// \return Falso si no se ha podido abrir o no es una grabación.
+///
+bool ReadRecording(const QString& fileName, const RecordingHandler& onSample, QString* error)
+{
+    StreamPlayer player;
+    if(!player.open(fileName)) {
+        if(error) *error = "Not a recording";
+        return false;
+    }
+
+    RecordChunk chunk;
+    TelemetryDecoder decoder;
+    decoder.setInferFormat(true);
+    decoder.setHandlers([&onSample, &chunk](TelemetrySample& sample) {
+        onSample(sample, chunk.m_time);
+    }, TelemetryDecoder::ResponseHandler());
+
+    while(player.next(chunk)) {
+        switch(chunk.m_type) {
+        case RecordText: decoder.setBinary(false); break;
+        case RecordBinary: decoder.setBinary(true); break;
+        case RecordData: decoder.decode(chunk.m_data.constData(), chunk.m_data.size()); break;
+        }
+    }
+    return true;
+}
+
+
+
+///
+/// \brief Lee las medidas de los sensores de una grabación del puerto serie.
+///
+/// Se queda con las muestras "raw_gam" de la grabación.
+/// \param fileName Ruta de la grabación.
+/// \param dataset Medidas leídas; su nombre es la ruta.
+/// \param error Si no es nulo, motivo del fallo.
+/// \return Falso si no se ha podido abrir o no es una grabación.
+///
+bool LoadRecording(const QString& fileName, FitDataset& dataset, QString* error)
+{
+    dataset.m_name = fileName;
+    return ReadRecording(fileName, [&dataset](TelemetrySample& sample, qint64) {
+        if(sample.m_type == SampleRawSensors) dataset.append(sample.m_values + 3, sample.m_values + 6);
+    }, error);
+}
+
+
+
+///
+/// \brief Constructor.
+/// \param threads Número de hilos del pool.
+///
+BatchFitter::BatchFitter(int threads) :
+    m_model(EllipsoidAligned),
+    m_chunk_size(DefaultChunk),
+    m_loading(0),
+    m_next_source(0),
+    m_sources(0),
+    m_datasets(nullptr)
+{
+    m_pool.setMaxThreadCount(std::max(1, threads));
+}
+
+
+
+///
+/// \brief Elige el modelo de elipsoide.
+///
+void BatchFitter::setModel(EllipsoidModel model)
+{
+    m_model = model;
+}
+
+
+
+///
+/// \brief Cambia el número de muestras de cada bloque.
+///
+void BatchFitter::setChunkSize(size_t samples)
+{
+    m_chunk_size = std::max<size_t>(1, samples);
+}
+
+
+
+///
+/// \brief Número de hilos del pool.
+///
+int BatchFitter::threads() const
+{
+    return m_pool.maxThreadCount();
+}
+
+
+
+///
+/// \brief Recalcula las calibraciones de un conjunto de grabaciones.
+/// \param files Rutas de las grabaciones.
+/// \return Una calibración por grabación, en el mismo orden.
+///
+std::vector<FitResult> BatchFitter::fitRecordings(const QStringList& files)
+{
+    m_files = files;
+    m_datasets = nullptr;
+    return run(size_t(files.size()));
+}
+
+
+
+///
+/// \brief Recalcula las calibraciones de un conjunto de medidas ya cargadas.
+/// \param datasets Medidas de cada IMU.
+/// \return Una calibración por conjunto de medidas, en el mismo orden.
+///
+std::vector<FitResult> BatchFitter::fitDatasets(const std::vector<FitDataset>& datasets)
+{
+    m_files.clear();
+    m_datasets = &datasets;
+    return run(datasets.size());
+}
+
+
+
+///
+/// \brief Lanza un trabajador por hilo y espera a que se acaben todas las sesiones.
+/// \param sources Número de sesiones.
+///
+std::vector<FitResult> BatchFitter::run(size_t sources)
+{
+    m_results.assign(sources, FitResult());
+    m_chunks.clear();
+    m_loading = 0;
+    m_next_source = 0;
+    m_sources = sources;
+
+    std::vector<QFuture<void>> workers;
+    for(int i=0 ; i<threads() ; ++i) {
+        workers.push_back(QtConcurrent::run(&m_pool, [this]() { work(); }));
+    }
+    for(auto& worker : workers) {
+        worker.waitForFinished();
+    }
+
+    std::vector<FitResult> results;
+    results.swap(m_results);
+    return results;
+}
+
+
+
+///
+/// \brief Bucle de cada hilo: procesa bloques pendientes y, si no los hay, carga la siguiente sesión.
+///
+void BatchFitter::work()
+{
+    Chunk chunk;
+    size_t source;
+    while(nextChunk(chunk, source)) {
+        if(chunk.m_job) {
+            fitChunk(chunk);
+            chunk.m_job.reset();
+            continue;
+        }
+
+        // Carga la sesión; si la grabación no se puede leer, se queda sin muestras
+        std::shared_ptr<Job> job = std::make_shared<Job>();
+        job->m_result = source;
+        if(m_datasets) {
+            job->m_dataset = &(*m_datasets)[source];
+        }
+        else {
+            job->m_owned.reset(new FitDataset);
+            if(!LoadRecording(m_files[int(source)], *job->m_owned, &m_results[source].m_error)) {
+                *job->m_owned = FitDataset();
+                job->m_owned->m_name = m_files[int(source)];
+            }
+            job->m_dataset = job->m_owned.get();
+        }
+        m_results[source].m_name = job->m_dataset->m_name;
+        schedule(job);
+    }
+}
+
+
+
+///
+/// \brief Saca el siguiente trabajo de la cola compartida.
+///
+/// Los bloques pendientes van antes que las sesiones nuevas. Si no hay ninguno pero otro hilo está
+/// cargando una sesión, se espera a sus bloques en vez de terminar.
+/// \param chunk Bloque a procesar, o vacío si lo que toca es cargar una sesión.
+/// \param source Sesión a cargar.
+/// \return Falso cuando ya no queda nada.
+///
+bool BatchFitter::nextChunk(Chunk& chunk, size_t& source)
+{
+    QMutexLocker lock(&m_lock);
+    for(;;) {
+        if(!m_chunks.empty()) {
+            chunk = m_chunks.front();
+            m_chunks.pop_front();
+            return true;
+        }
+        if(m_next_source < m_sources) {
+            source = m_next_source++;
+            ++m_loading;
+            chunk.m_job.reset();
+            return true;
+        }
+        if(!m_loading) return false;
+        m_ready.wait(&m_lock);
+    }
+}
+
+
+
+///
+/// \brief Trocea una sesión recién cargada y pone sus bloques en la cola.
+/// \param job Sesión.
+///
+void BatchFitter::schedule(const std::shared_ptr<Job>& job)
+{
+    const size_t size = job->m_dataset->size();
+    const size_t chunks = (size + m_chunk_size - 1) / m_chunk_size;
+    job->m_acc.resize(chunks);
+    job->m_mag.resize(chunks);
+    job->m_remaining = chunks;
+    if(!chunks) finish(*job);
+
+    {
+        QMutexLocker lock(&m_lock);
+        --m_loading;
+        for(size_t i=0 ; i<chunks ; ++i) {
+            m_chunks.push_back(Chunk{ job, i });
+        }
+    }
+    m_ready.wakeAll();
+}
+
+
+
+///
+/// \brief Suma los momentos de un bloque y, si es el último de su sesión, calcula la calibración.
+/// \param chunk Bloque.
+///
+void BatchFitter::fitChunk(const Chunk& chunk)
+{
+    Job& job = *chunk.m_job;
+    const FitDataset& dataset = *job.m_dataset;
+    const size_t begin = chunk.m_index * m_chunk_size;
+    const size_t count = std::min(m_chunk_size, dataset.size() - begin);
+    job.m_acc[chunk.m_index].add(&dataset.m_acc[0][begin], &dataset.m_acc[1][begin], &dataset.m_acc[2][begin], count);
+    job.m_mag[chunk.m_index].add(&dataset.m_mag[0][begin], &dataset.m_mag[1][begin], &dataset.m_mag[2][begin], count);
+    if(--job.m_remaining == 0) finish(job);
+}
+
+
+
+///
+/// \brief Reduce las sumas parciales de una sesión, en orden, y resuelve el ajuste.
+/// \param job Sesión, con todos sus bloques ya sumados.
+///
+void BatchFitter::finish(Job& job)
+{
+    EllipsoidAccumulator acc, mag;
+    for(size_t i=0 ; i<job.m_acc.size() ; ++i) {
+        acc.merge(job.m_acc[i]);
+        mag.merge(job.m_mag[i]);
+    }
+
+    FitResult& result = m_results[job.m_result];
+    result.m_samples = acc.count();
+    if(acc.count() < size_t(EllipsoidAccumulator::Parameters)) {
+        if(result.m_error.isEmpty()) result.m_error = "Not enough raw sensor samples";
+    }
+    else {
+        result.m_acc = acc.solve(m_model);
+        result.m_mag = mag.solve(m_model);
+        result.m_valid = true;
+    }
+
+    // Las medidas ya no hacen falta; las sesiones cargadas aquí se liberan
+    job.m_owned.reset();
+    job.m_acc.clear();
+    job.m_mag.clear();
+}
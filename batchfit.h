@@ -0,0 +1,119 @@
+#pragma once
+
+#include <QMatrix4x4>
+#include <QMutex>
+#include <QStringList>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "binaryprotocol.h"
+#include "Render/ellipsoid.h"
+
+
+
+///
+/// \brief Medidas de un IMU para recalcular su calibración, guardadas como estructura de vectores.
+///
+struct FitDataset
+{
+    QString m_name;
+    std::vector<float> m_acc[3];
+    std::vector<float> m_mag[3];
+
+    size_t size() const;
+    void append(const float* acc, const float* mag);
+};
+
+
+
+///
+/// \brief Calibración recalculada de un IMU.
+///
+struct FitResult
+{
+    QString m_name;
+    bool m_valid;
+    quint64 m_samples;
+    QMatrix4x4 m_acc, m_mag;
+    QString m_error;
+};
+
+
+
+typedef std::function<void(TelemetrySample& sample, qint64 time)> RecordingHandler;
+
+bool ReadRecording(const QString& fileName, const RecordingHandler& onSample, QString* error = nullptr);
+bool LoadRecording(const QString& fileName, FitDataset& dataset, QString* error = nullptr);
+
+
+
+///
+/// \brief Recalcula en paralelo las calibraciones de muchas sesiones grabadas.
+///
+/// Cada sesión se trocea en bloques de muestras; los hilos del pool suman los momentos de los bloques
+/// por separado y el último en terminar una sesión los reduce y resuelve el ajuste. Los bloques de todas
+/// las sesiones van a una cola compartida de la que tira cualquier hilo libre, así que una sesión muy
+/// larga no deja al resto de hilos esperando: antes de cargar otra grabación, un hilo se lleva los
+/// bloques que queden de las que están cargando los demás. Así sólo hay en memoria unas pocas sesiones
+/// a la vez, aunque el lote tenga miles.
+///
+class BatchFitter
+{
+public:
+    static const size_t DefaultChunk = 1 << 16;
+
+    explicit BatchFitter(int threads = QThread::idealThreadCount());
+    void setModel(EllipsoidModel model);
+    void setChunkSize(size_t samples);
+    int threads() const;
+    std::vector<FitResult> fitRecordings(const QStringList& files);
+    std::vector<FitResult> fitDatasets(const std::vector<FitDataset>& datasets);
+
+private:
+    ///
+    /// \brief Sesión en curso: sus medidas y las sumas parciales de cada bloque.
+    ///
+    struct Job
+    {
+        const FitDataset* m_dataset;
+        std::unique_ptr<FitDataset> m_owned;
+        size_t m_result;
+        std::vector<EllipsoidAccumulator> m_acc, m_mag;
+        std::atomic<size_t> m_remaining;
+    };
+
+    ///
+    /// \brief Bloque de muestras de una sesión.
+    ///
+    struct Chunk
+    {
+        std::shared_ptr<Job> m_job;
+        size_t m_index;
+    };
+
+    QThreadPool m_pool;
+    EllipsoidModel m_model;
+    size_t m_chunk_size;
+
+    QMutex m_lock;
+    QWaitCondition m_ready;
+    std::deque<Chunk> m_chunks;
+    int m_loading;
+    size_t m_next_source, m_sources;
+    QStringList m_files;
+    const std::vector<FitDataset>* m_datasets;
+    std::vector<FitResult> m_results;
+
+    std::vector<FitResult> run(size_t sources);
+    void work();
+    bool nextChunk(Chunk& chunk, size_t& source);
+    void schedule(const std::shared_ptr<Job>& job);
+    void fitChunk(const Chunk& chunk);
+    void finish(Job& job);
+};
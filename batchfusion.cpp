@@ -0,0 +1,248 @@
+#include "batchfusion.h"
+
+#include <QMutexLocker>
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
+#include "batchfit.h"
+
+
+
+///
+/// \brief Constructor.
+/// \param threads Número de hilos del pool.
+///
+FusionBatch::FusionBatch(int threads) :
+    m_filter(FusionMadgwick),
+    m_model(EllipsoidAligned),
+    m_next_file(0)
+{
+    m_pool.setMaxThreadCount(std::max(1, threads));
+}
+
+
+
+///
+/// \brief Elige el filtro de la fusión.
+///
+void FusionBatch::setFilter(FusionFilter filter)
+{
+    m_filter = filter;
+}
+
+
+
+///
+/// \brief Elige el modelo de elipsoide con el que se calibra cada grabación.
+///
+void FusionBatch::setModel(EllipsoidModel model)
+{
+    m_model = model;
+}
+
+
+
+///
+/// \brief Número de hilos del pool.
+///
+int FusionBatch::threads() const
+{
+    return m_pool.maxThreadCount();
+}
+
+
+
+///
+/// \brief Fusiona un conjunto de grabaciones.
+/// \param files Rutas de las grabaciones.
+/// \return Un resultado por grabación, en el mismo orden.
+///
+std::vector<FusionResult> FusionBatch::fuseRecordings(const QStringList& files)
+{
+    m_files = files;
+    m_next_file = 0;
+    m_results.assign(files.size(), FusionResult());
+    for(int i=0 ; i<files.size() ; ++i) {
+        m_results[i].m_name = files[i];
+        m_results[i].m_valid = false;
+        m_results[i].m_samples = 0;
+        m_results[i].m_period = 0.0;
+        m_results[i].m_compared = 0;
+        m_results[i].m_mean_error = m_results[i].m_max_error = 0.0;
+    }
+
+    std::vector<QFuture<void>> workers;
+    for(int i=0 ; i<std::min(threads(), files.size()) ; ++i) {
+        workers.push_back(QtConcurrent::run(&m_pool, [this]() { work(); }));
+    }
+    for(auto& worker : workers) {
+        worker.waitForFinished();
+    }
+
+    std::vector<FusionResult> results;
+    results.swap(m_results);
+    return results;
+}
+
+
+
+///
+/// \brief Bucle de cada hilo: avanza todos sus carriles a la vez y rellena los que se quedan vacíos.
+///
+void FusionBatch::work()
+{
+    FusionBank bank;
+    bank.setFilter(m_filter);
+    std::unique_ptr<Stream> lanes[FusionBank::Lanes];
+    FusionBank::Step step;
+    bool pending = true;
+
+    while(true) {
+        // Carga una grabación en cada carril vacío; la primera muestra orienta el carril
+        int active = 0;
+        for(int lane=0 ; lane<FusionBank::Lanes ; ++lane) {
+            while(!lanes[lane] && pending) {
+                std::unique_ptr<Stream> stream(new Stream);
+                if(!load(*stream)) {
+                    pending = false;
+                }
+                else if(!stream->m_gyr[0].empty()) {
+                    bank.align(lane, QVector3D(stream->m_acc[0][0], stream->m_acc[1][0], stream->m_acc[2][0]),
+                                     QVector3D(stream->m_mag[0][0], stream->m_mag[1][0], stream->m_mag[2][0]));
+                    lanes[lane] = std::move(stream);
+                    if(lanes[lane]->m_gyr[0].size() == 1) {
+                        finish(*lanes[lane], bank.orientation(lane));
+                        lanes[lane].reset();
+                    }
+                }
+            }
+            if(lanes[lane]) ++active;
+        }
+        if(!active) break;
+
+        // Un paso de todos los carriles; los vacíos avanzan con dt = 0 y no cambian
+        for(int lane=0 ; lane<FusionBank::Lanes ; ++lane) {
+            const Stream* stream = lanes[lane].get();
+            const size_t i = stream ? stream->m_next : 0;
+            for(int axis=0 ; axis<3 ; ++axis) {
+                step.m_gyr[axis][lane] = stream ? stream->m_gyr[axis][i] : 0.0f;
+                step.m_acc[axis][lane] = stream ? stream->m_acc[axis][i] : 0.0f;
+                step.m_mag[axis][lane] = stream ? stream->m_mag[axis][i] : 0.0f;
+            }
+            step.m_dt[lane] = stream ? stream->m_dt : 0.0f;
+        }
+        bank.update(step);
+
+        // Compara con la orientación del firmware que llegó tras esta muestra
+        for(int lane=0 ; lane<FusionBank::Lanes ; ++lane) {
+            Stream* stream = lanes[lane].get();
+            if(!stream) continue;
+            const size_t i = stream->m_next;
+            while((stream->m_next_device < stream->m_device.size()) && (stream->m_device_index[stream->m_next_device] <= i)) {
+                if(i >= stream->m_settle) {
+                    const double error = AngleBetween(stream->m_device[stream->m_next_device], bank.orientation(lane));
+                    stream->m_error_sum += error;
+                    stream->m_error_max = std::max(stream->m_error_max, error);
+                    ++stream->m_compared;
+                }
+                ++stream->m_next_device;
+            }
+            if(++stream->m_next == stream->m_gyr[0].size()) {
+                finish(*stream, bank.orientation(lane));
+                lanes[lane].reset();
+            }
+        }
+    }
+}
+
+
+
+///
+/// \brief Lee la siguiente grabación de la lista y calibra sus medidas.
+/// \param stream Grabación leída; sin medidas si no se ha podido leer o calibrar, con el motivo en su resultado.
+/// \return Falso si ya no quedan grabaciones.
+///
+bool FusionBatch::load(Stream& stream)
+{
+    QString fileName;
+    {
+        QMutexLocker lock(&m_lock);
+        if(m_next_file >= size_t(m_files.size())) return false;
+        stream.m_result = m_next_file++;
+        fileName = m_files[int(stream.m_result)];
+    }
+    FusionResult& result = m_results[stream.m_result];
+
+    // Medidas como estructura de vectores; cada orientación del firmware apunta a la última medida recibida
+    qint64 first = -1, last = -1;
+    const bool read = ReadRecording(fileName, [&stream, &first, &last](TelemetrySample& sample, qint64 time) {
+        const float* v = sample.m_values;
+        if(sample.m_type == SampleRawSensors) {
+            for(int axis=0 ; axis<3 ; ++axis) {
+                stream.m_gyr[axis].push_back(v[axis]);
+                stream.m_acc[axis].push_back(v[3 + axis]);
+                stream.m_mag[axis].push_back(v[6 + axis]);
+            }
+            if(first < 0) first = time;
+            last = time;
+        }
+        else if((sample.m_type == SampleOrientation) && !stream.m_gyr[0].empty()) {
+            stream.m_device.emplace_back(v[0], v[1], v[2], v[3]);
+            stream.m_device_index.push_back(stream.m_gyr[0].size() - 1);
+        }
+    }, &result.m_error);
+    if(!read) return true;
+
+    // Se calibra con su propio ajuste, igual que --refit
+    const size_t count = stream.m_gyr[0].size();
+    EllipsoidAccumulator acc, mag;
+    acc.add(stream.m_acc[0].data(), stream.m_acc[1].data(), stream.m_acc[2].data(), count);
+    mag.add(stream.m_mag[0].data(), stream.m_mag[1].data(), stream.m_mag[2].data(), count);
+    if(count < size_t(EllipsoidAccumulator::Parameters)) {
+        result.m_error = "Not enough raw sensor samples";
+        for(int axis=0 ; axis<3 ; ++axis) stream.m_gyr[axis].clear();
+        return true;
+    }
+    const QMatrix4x4 accCalib = acc.solve(m_model);
+    const QMatrix4x4 magCalib = mag.solve(m_model);
+    for(size_t i=0 ; i<count ; ++i) {
+        const QVector3D a = accCalib.map(QVector3D(stream.m_acc[0][i], stream.m_acc[1][i], stream.m_acc[2][i]));
+        const QVector3D m = magCalib.map(QVector3D(stream.m_mag[0][i], stream.m_mag[1][i], stream.m_mag[2][i]));
+        for(int axis=0 ; axis<3 ; ++axis) {
+            stream.m_acc[axis][i] = a[axis];
+            stream.m_mag[axis][i] = m[axis];
+        }
+    }
+
+    // El periodo sale de la duración, en µs, porque los instantes de llegada van a ráfagas
+    const double duration = (last - first) / 1e6;
+    stream.m_dt = float(((count > 1) && (duration > 0.0)) ? duration / (count - 1) : DefaultPeriod);
+    stream.m_settle = size_t(std::ceil(SettleTime / stream.m_dt));
+    stream.m_next = 1;
+    stream.m_next_device = 0;
+    stream.m_error_sum = stream.m_error_max = 0.0;
+    stream.m_compared = 0;
+    result.m_samples = count;
+    result.m_period = stream.m_dt;
+    return true;
+}
+
+
+
+///
+/// \brief Guarda el resultado de una grabación que ya se ha fusionado entera.
+/// \param stream Grabación.
+/// \param orientation Orientación final de su carril.
+///
+void FusionBatch::finish(const Stream& stream, const QQuaternion& orientation)
+{
+    FusionResult& result = m_results[stream.m_result];
+    result.m_valid = true;
+    result.m_orientation = orientation;
+    result.m_compared = stream.m_compared;
+    result.m_mean_error = stream.m_compared ? stream.m_error_sum / stream.m_compared : 0.0;
+    result.m_max_error = stream.m_error_max;
+}
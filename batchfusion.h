@@ -0,0 +1,82 @@
+#pragma once
+
+#include <QMutex>
+#include <QQuaternion>
+#include <QStringList>
+#include <QThreadPool>
+
+#include <vector>
+
+#include "sensorfusion.h"
+#include "Render/ellipsoid.h"
+
+
+
+///
+/// \brief Fusión en el PC de una grabación, comparada con la orientación del firmware.
+///
+struct FusionResult
+{
+    QString m_name;
+    bool m_valid;
+    quint64 m_samples;
+    double m_period;
+    QQuaternion m_orientation;
+    quint64 m_compared;
+    double m_mean_error, m_max_error;
+    QString m_error;
+};
+
+
+
+///
+/// \brief Fusiona en el PC muchas sesiones grabadas, mucho más rápido que en tiempo real.
+///
+/// Cada hilo del pool lleva un FusionBank con FusionBank::Lanes grabaciones a la vez, una por carril,
+/// que avanzan una muestra por paso. Cuando una grabación se acaba, su carril se rellena con la
+/// siguiente de la lista compartida, así que las grabaciones largas no dejan carriles vacíos. Cada
+/// grabación se calibra con su propio ajuste de elipsoide antes de fusionarla, y su periodo sale de la
+/// duración y el número de muestras "raw_gam". Si la grabación trae también la orientación del firmware
+/// ("start all"), se compara con la fusionada después de SettleTime segundos.
+///
+class FusionBatch
+{
+public:
+    static constexpr double SettleTime = 2.0;
+    static constexpr double DefaultPeriod = 0.01;
+
+    explicit FusionBatch(int threads = QThread::idealThreadCount());
+    void setFilter(FusionFilter filter);
+    void setModel(EllipsoidModel model);
+    int threads() const;
+    std::vector<FusionResult> fuseRecordings(const QStringList& files);
+
+private:
+    ///
+    /// \brief Grabación cargada en un carril: medidas calibradas y orientación del firmware.
+    ///
+    struct Stream
+    {
+        size_t m_result;
+        std::vector<float> m_gyr[3], m_acc[3], m_mag[3];
+        std::vector<QQuaternion> m_device;
+        std::vector<size_t> m_device_index;
+        size_t m_next, m_next_device, m_settle;
+        float m_dt;
+        double m_error_sum, m_error_max;
+        quint64 m_compared;
+    };
+
+    QThreadPool m_pool;
+    FusionFilter m_filter;
+    EllipsoidModel m_model;
+
+    QMutex m_lock;
+    size_t m_next_file;
+    QStringList m_files;
+    std::vector<FusionResult> m_results;
+
+    void work();
+    bool load(Stream& stream);
+    void finish(const Stream& stream, const QQuaternion& orientation);
+};
@@ -0,0 +1,323 @@
+#include "binaryprotocol.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+
+
+///
+/// \brief Tabla del CRC-16/CCITT (polinomio 0x1021), generada en tiempo de compilación.
+///
+struct CrcTable
+{
+    uint16_t m_values[256];
+
+    constexpr CrcTable() : m_values()
+    {
+        for (int i = 0; i < 256; ++i) {
+            uint16_t crc = uint16_t(i << 8);
+            for (int bit = 0; bit < 8; ++bit)
+                crc = (crc & 0x8000) ? uint16_t((crc << 1) ^ 0x1021) : uint16_t(crc << 1);
+            m_values[i] = crc;
+        }
+    }
+};
+
+static constexpr CrcTable CRC_TABLE;
+
+
+
+///
+/// \brief Tipo de muestra y número de valores asociados a cada tipo de trama.
+/// \param type Tipo de trama, sin el bit FramePacked.
+/// \param count Número de valores de la muestra.
+/// \return Tipo de muestra, o SampleNone si el tipo de trama es desconocido.
+///
+static SampleType FrameSample(uint8_t type, int& count)
+{
+    switch (type) {
+    case FrameOrientation: count = 4; return SampleOrientation;
+    case FrameForce: count = 4; return SampleForce;
+    case FrameRawAnalog: count = 6; return SampleRawAnalog;
+    case FrameRawSensors: count = 9; return SampleRawSensors;
+    default: count = 0; return SampleNone;
+    }
+}
+
+
+
+///
+/// \brief Longitud de la carga para un tipo de trama.
+/// \param type Tipo de trama.
+/// \param count Número de valores.
+/// \return Número de bytes de la carga.
+///
+static int PayloadSize(uint8_t type, int count)
+{
+    return (type & FramePacked) ? int(sizeof(float)) + count * int(sizeof(int16_t)) : count * int(sizeof(float));
+}
+
+
+
+///
+/// \brief Calcula el CRC-16/CCITT de un bloque de datos.
+/// \param data Datos.
+/// \param size Número de bytes.
+/// \return CRC, con valor inicial 0xFFFF.
+///
+uint16_t Crc16(const uint8_t* data, int size)
+{
+    uint16_t crc = 0xFFFF;
+    for (int i = 0; i < size; ++i)
+        crc = uint16_t((crc << 8) ^ CRC_TABLE.m_values[((crc >> 8) ^ data[i]) & 0xFF]);
+    return crc;
+}
+
+
+
+///
+/// \brief Completa una trama con la cabecera y el CRC, a partir de la carga ya escrita.
+/// \param type Tipo de trama.
+/// \param payload Longitud de la carga.
+/// \param frame Trama de salida; la carga empieza en el byte 4.
+/// \return Longitud total de la trama.
+///
+static int FinishFrame(uint8_t type, int payload, uint8_t* frame)
+{
+    frame[0] = FRAME_SYNC_1;
+    frame[1] = FRAME_SYNC_2;
+    frame[2] = type;
+    frame[3] = uint8_t(payload);
+    const uint16_t crc = Crc16(frame + 2, payload + 2);
+    frame[4 + payload] = uint8_t(crc & 0xFF);
+    frame[5 + payload] = uint8_t(crc >> 8);
+    return payload + FRAME_OVERHEAD;
+}
+
+
+
+///
+/// \brief Codifica una muestra como trama binaria.
+/// \param type Tipo de trama, con el bit FramePacked si los valores se envían como int16.
+/// \param values Valores de la muestra.
+/// \param count Número de valores.
+/// \param frame Buffer de salida, de al menos FRAME_MAX_SIZE bytes.
+/// \return Longitud de la trama.
+///
+int EncodeFrame(uint8_t type, const float* values, int count, uint8_t* frame)
+{
+    uint8_t* payload = frame + 4;
+    if (type & FramePacked) {
+        // La escala sale sólo de los valores finitos; los demás se envían como PACKED_INVALID
+        float range = 0.0f;
+        for (int i = 0; i < count; ++i) {
+            if (std::isfinite(values[i])) range = std::max(range, std::abs(values[i]));
+        }
+        const float scale = (range > 0.0f) ? range / float(PACKED_MAX) : 1.0f;
+        memcpy(payload, &scale, sizeof(scale));
+        for (int i = 0; i < count; ++i) {
+            int16_t value = PACKED_INVALID;
+            if (std::isfinite(values[i])) {
+                const float scaled = std::min(std::max(values[i] / scale, -float(PACKED_MAX)), float(PACKED_MAX));
+                value = int16_t(std::lround(scaled));
+            }
+            memcpy(payload + sizeof(scale) + i * sizeof(value), &value, sizeof(value));
+        }
+    }
+    else {
+        memcpy(payload, values, count * sizeof(float));
+    }
+    return FinishFrame(type, PayloadSize(type, count), frame);
+}
+
+
+
+///
+/// \brief Codifica una línea de texto como trama binaria.
+/// \param text Texto, sin fin de línea.
+/// \param size Longitud del texto, como máximo 255 bytes.
+/// \param frame Buffer de salida, de al menos FRAME_MAX_SIZE bytes.
+/// \return Longitud de la trama.
+///
+int EncodeTextFrame(const char* text, int size, uint8_t* frame)
+{
+    size = std::min(size, 255);
+    memcpy(frame + 4, text, size);
+    return FinishFrame(FrameText, size, frame);
+}
+
+
+
+///
+/// \brief Constructor.
+///
+FrameDecoder::FrameDecoder()
+{
+    reset();
+}
+
+
+
+///
+/// \brief Descarta los datos pendientes y reinicia los contadores.
+///
+void FrameDecoder::reset()
+{
+    m_begin = 0;
+    m_end = 0;
+    m_text_size = 0;
+    m_errors = 0;
+    m_skipped = 0;
+}
+
+
+
+///
+/// \brief Añade bytes recibidos al buffer interno.
+/// \param data Bytes recibidos.
+/// \param size Número de bytes.
+/// \return Número de bytes copiados; el resto debe añadirse después de llamar a next().
+///
+int FrameDecoder::append(const char* data, int size)
+{
+    // Compacta el buffer si no queda sitio al final
+    if ((m_begin > 0) && (m_end + size > int(sizeof(m_buffer)))) {
+        memmove(m_buffer, m_buffer + m_begin, m_end - m_begin);
+        m_end -= m_begin;
+        m_begin = 0;
+    }
+
+    const int copied = std::min(size, int(sizeof(m_buffer)) - m_end);
+    memcpy(m_buffer + m_end, data, copied);
+    m_end += copied;
+    return copied;
+}
+
+
+
+///
+/// \brief Extrae la siguiente trama completa del buffer.
+/// \param sample Muestra donde se escribe el resultado, si la trama es de telemetría.
+/// \return Tipo de trama extraída, o None si no hay ninguna trama completa.
+///
+FrameDecoder::Result FrameDecoder::next(TelemetrySample& sample)
+{
+    while (true) {
+        // Busca la palabra de sincronismo
+        while ((m_end - m_begin >= 2) && ((m_buffer[m_begin] != FRAME_SYNC_1) || (m_buffer[m_begin + 1] != FRAME_SYNC_2))) {
+            ++m_begin;
+            ++m_skipped;
+        }
+        if ((m_end - m_begin == 1) && (m_buffer[m_begin] != FRAME_SYNC_1)) {
+            ++m_begin;
+            ++m_skipped;
+        }
+        if (m_end - m_begin < 4) return None;
+
+        // Comprueba que la longitud corresponde al tipo
+        const uint8_t* frame = m_buffer + m_begin;
+        const uint8_t type = frame[2];
+        const int payload = frame[3];
+        int count = 0;
+        const SampleType sampleType = FrameSample(type & ~FramePacked, count);
+        if ((type != FrameText) && ((sampleType == SampleNone) || (payload != PayloadSize(type, count)))) {
+            ++m_begin;
+            ++m_errors;
+            continue;
+        }
+
+        // Espera a tener la trama completa y comprueba el CRC
+        if (m_end - m_begin < payload + FRAME_OVERHEAD) return None;
+        const uint16_t crc = uint16_t(frame[4 + payload] | (frame[5 + payload] << 8));
+        if (crc != Crc16(frame + 2, payload + 2)) {
+            ++m_begin;
+            ++m_errors;
+            continue;
+        }
+        m_begin += payload + FRAME_OVERHEAD;
+
+        // Decodifica la carga
+        const uint8_t* data = frame + 4;
+        if (type == FrameText) {
+            memcpy(m_text, data, payload);
+            m_text_size = payload;
+            return Text;
+        }
+        sample.m_type = sampleType;
+        sample.m_count = count;
+        if (type & FramePacked) {
+            float scale;
+            memcpy(&scale, data, sizeof(scale));
+            for (int i = 0; i < count; ++i) {
+                int16_t value;
+                memcpy(&value, data + sizeof(scale) + i * sizeof(value), sizeof(value));
+                sample.m_values[i] = (value == PACKED_INVALID) ? NAN : scale * value;
+            }
+        }
+        else {
+            memcpy(sample.m_values, data, count * sizeof(float));
+        }
+        return Sample;
+    }
+}
+
+
+
+///
+/// \brief Texto de la última trama de texto extraída, sin terminar en nulo.
+///
+const char* FrameDecoder::text() const
+{
+    return m_text;
+}
+
+
+
+///
+/// \brief Longitud del texto de la última trama de texto extraída.
+///
+int FrameDecoder::textSize() const
+{
+    return m_text_size;
+}
+
+
+
+///
+/// \brief Bytes recibidos que todavía no se han decodificado.
+///
+const char* FrameDecoder::pendingData() const
+{
+    return reinterpret_cast<const char*>(m_buffer + m_begin);
+}
+
+
+
+///
+/// \brief Número de bytes recibidos que todavía no se han decodificado.
+///
+int FrameDecoder::pendingSize() const
+{
+    return m_end - m_begin;
+}
+
+
+
+///
+/// \brief Número de tramas descartadas por longitud o CRC incorrectos.
+///
+uint64_t FrameDecoder::errors() const
+{
+    return m_errors;
+}
+
+
+
+///
+/// \brief Número de bytes descartados fuera de trama.
+///
+uint64_t FrameDecoder::skipped() const
+{
+    return m_skipped;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Render/types.h"
+
+
+
+///
+/// \brief Tipos de trama del protocolo binario.
+///
+/// Formato de una trama:
+///
+///     0xA5 0x5A | tipo (1 byte) | longitud (1 byte) | carga | CRC-16/CCITT (2 bytes, little endian)
+///
+/// El CRC se calcula sobre el tipo, la longitud y la carga. Si el bit FramePacked está activo, la carga
+/// es un float32 con la escala seguido de N enteros int16 entre ±PACKED_MAX, o PACKED_INVALID para un
+/// valor que no es finito; si no, son N valores float32, todo en little endian. Las respuestas a los
+/// comandos viajan como tramas de texto, una línea por trama.
+///
+enum FrameType : uint8_t
+{
+    FrameOrientation = 0x01,
+    FrameForce = 0x02,
+    FrameRawAnalog = 0x03,
+    FrameRawSensors = 0x04,
+    FrameText = 0x7F,
+    FramePacked = 0x80
+};
+
+const uint8_t FRAME_SYNC_1 = 0xA5;
+const uint8_t FRAME_SYNC_2 = 0x5A;
+const int FRAME_OVERHEAD = 6;
+const int FRAME_MAX_SIZE = FRAME_OVERHEAD + 255;
+const int16_t PACKED_MAX = 32767;
+const int16_t PACKED_INVALID = -32768;
+
+
+
+///
+/// \brief Decodificador incremental de tramas binarias, con resincronización.
+///
+/// Los bytes se copian a un buffer interno de tamaño fijo; ante una longitud imposible o un CRC erróneo
+/// se descarta un único byte y se vuelve a buscar la palabra de sincronismo.
+///
+class FrameDecoder
+{
+public:
+    enum Result { None, Sample, Text };
+    static const int Capacity = 4 * FRAME_MAX_SIZE;
+
+    FrameDecoder();
+    void reset();
+    int append(const char* data, int size);
+    Result next(TelemetrySample& sample);
+    const char* text() const;
+    int textSize() const;
+    const char* pendingData() const;
+    int pendingSize() const;
+    uint64_t errors() const;
+    uint64_t skipped() const;
+
+private:
+    uint8_t m_buffer[Capacity];
+    int m_begin, m_end;
+    char m_text[256];
+    int m_text_size;
+    uint64_t m_errors, m_skipped;
+};
+
+
+
+uint16_t Crc16(const uint8_t* data, int size);
+int EncodeFrame(uint8_t type, const float* values, int count, uint8_t* frame);
+int EncodeTextFrame(const char* text, int size, uint8_t* frame);
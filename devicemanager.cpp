@@ -0,0 +1,1112 @@
+#include "devicemanager.h"
+
+#include <QDebug>
+#include <QFileInfo>
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+
+
+
+///
+/// \brief Indica si todos los elementos de una matriz son finitos.
+///
+static bool IsFinite(const QMatrix4x4& matrix)
+{
+    for(int i=0 ; i<16 ; ++i) {
+        if(!std::isfinite(matrix.constData()[i])) return false;
+    }
+    return true;
+}
+
+
+
+///
+/// \brief Constructor, crea el hilo de lectura del IMU.
+/// \param info Datos del puerto serie a usar.
+/// \param name Nombre de la sesión; por defecto, el del puerto.
+///
+DeviceSession::DeviceSession(const QSerialPortInfo& info, const QString& name) :
+    m_name(name.isEmpty() ? info.portName() : name),
+    m_thread(new SerialThread(info))
+{
+    m_calibration.m_valid = false;
+    m_calibration.m_samples = 0;
+    m_calibration.m_acc_rejected = 0;
+    m_calibration.m_mag_rejected = 0;
+    m_calibration.m_gyr_valid = false;
+    m_duplicates = 0;
+    m_since_estimate = 0;
+    m_fit_change = std::numeric_limits<double>::infinity();
+    m_cloud_stride = 1;
+    m_cloud_skip = 0;
+    m_stats = m_thread->stats();
+    m_sample_rate = 0.0;
+}
+
+
+
+///
+/// \brief Destructor, espera a que termine el hilo de lectura.
+///
+/// El hilo se para antes de destruir el resto de miembros. Si DeviceManager::close() ya le ha avisado, sólo
+/// queda esperarle.
+///
+DeviceSession::~DeviceSession()
+{
+    m_thread->setMode(Disconnected);
+    m_thread->wait();
+}
+
+
+
+///
+/// \brief Devuelve el hilo de lectura del IMU.
+/// \return Hilo de lectura.
+///
+SerialThread& DeviceSession::thread()
+{
+    return *m_thread;
+}
+
+
+
+///
+/// \brief Devuelve el nombre del puerto serie.
+/// \return Nombre del puerto.
+///
+QString DeviceSession::name() const
+{
+    return m_name;
+}
+
+
+
+///
+/// \brief Devuelve el identificador único del IMU.
+/// \return Identificador, vacío mientras el IMU no ha respondido.
+///
+QString DeviceSession::uid() const
+{
+    return m_thread->getUID();
+}
+
+
+
+///
+/// \brief Descarta las medidas acumuladas para la calibración.
+///
+void DeviceSession::clearMeasurements()
+{
+    m_acc_measurements.clear();
+    m_acc_measurements.reserve(CloudCapacity);
+    m_mag_measurements.clear();
+    m_mag_measurements.reserve(CloudCapacity);
+    m_acc_fit.reset();
+    m_mag_fit.reset();
+    for(int i=0 ; i<3 ; ++i) {
+        m_acc_samples[i].clear();
+        m_mag_samples[i].clear();
+    }
+    m_acc_coverage.reset();
+    m_mag_coverage.reset();
+    m_acc_estimate.setToIdentity();
+    m_mag_estimate.setToIdentity();
+    m_duplicates = 0;
+    m_since_estimate = 0;
+    m_fit_change = std::numeric_limits<double>::infinity();
+    m_cloud_stride = 1;
+    m_cloud_skip = 0;
+}
+
+
+
+///
+/// \brief Añade una medida para la calibración.
+/// \param acc Acelerómetro, x/g₀
+/// \param mag Magnetómetro, x/45µT
+/// \return Cambio en la nube de puntos que se muestra.
+///
+CloudChange DeviceSession::addMeasurement(const QVector3D& acc, const QVector3D& mag)
+{
+    // Descarta la medida si las celdas de los dos sensores ya están llenas
+    const int accBin = m_acc_coverage.bin(acc);
+    const int magBin = m_mag_coverage.bin(mag);
+    if(m_acc_coverage.full(accBin) && m_mag_coverage.full(magBin)) {
+        ++m_duplicates;
+        return CloudUnchanged;
+    }
+    m_acc_coverage.insert(accBin);
+    m_mag_coverage.insert(magBin);
+
+    m_acc_fit.add(acc);
+    m_mag_fit.add(mag);
+    for(int i=0 ; i<3 ; ++i) {
+        m_acc_samples[i].push_back(acc[i]);
+        m_mag_samples[i].push_back(mag[i]);
+    }
+    if(++m_since_estimate >= EstimateInterval) updateEstimate();
+
+    if(++m_cloud_skip < m_cloud_stride) return CloudUnchanged;
+    m_cloud_skip = 0;
+    m_acc_measurements.push_back(acc);
+    m_mag_measurements.push_back(mag);
+    if(int(m_acc_measurements.size()) < CloudCapacity) return CloudAppended;
+
+    // Nube llena: se queda con uno de cada dos puntos
+    for(size_t i=1 ; 2*i<m_acc_measurements.size() ; ++i) {
+        m_acc_measurements[i] = m_acc_measurements[2*i];
+        m_mag_measurements[i] = m_mag_measurements[2*i];
+    }
+    m_acc_measurements.resize((m_acc_measurements.size() + 1) / 2);
+    m_mag_measurements.resize((m_mag_measurements.size() + 1) / 2);
+    m_cloud_stride *= 2;
+    return CloudCompacted;
+}
+
+
+
+///
+/// \brief Número de medidas acumuladas para la calibración, incluidas las que no se muestran.
+///
+uint64_t DeviceSession::measurementCount() const
+{
+    return m_acc_fit.count();
+}
+
+
+
+///
+/// \brief Ecuaciones normales acumuladas del acelerómetro.
+///
+const EllipsoidAccumulator& DeviceSession::accAccumulator() const
+{
+    return m_acc_fit;
+}
+
+
+
+///
+/// \brief Ecuaciones normales acumuladas del magnetómetro.
+///
+const EllipsoidAccumulator& DeviceSession::magAccumulator() const
+{
+    return m_mag_fit;
+}
+
+
+
+///
+/// \brief Número de medidas descartadas por caer en celdas ya llenas.
+///
+uint64_t DeviceSession::duplicateCount() const
+{
+    return m_duplicates;
+}
+
+
+
+///
+/// \brief Fracción de la esfera cubierta por las medidas del acelerómetro, entre 0 y 1.
+///
+double DeviceSession::accCoverage() const
+{
+    return m_acc_coverage.coverage();
+}
+
+
+
+///
+/// \brief Fracción de la esfera cubierta por las medidas del magnetómetro, entre 0 y 1.
+///
+double DeviceSession::magCoverage() const
+{
+    return m_mag_coverage.coverage();
+}
+
+
+
+///
+/// \brief Cambio de la calibración estimada en la última actualización.
+/// \return Máxima variación relativa del radio corregido, o infinito si todavía no hay dos estimaciones.
+///
+double DeviceSession::fitChange() const
+{
+    return m_fit_change;
+}
+
+
+
+///
+/// \brief Indica si las medidas ya cubren la esfera y la calibración estimada ha dejado de cambiar.
+///
+bool DeviceSession::calibrationComplete() const
+{
+    return (m_acc_coverage.coverage() >= StopCoverage) && (m_mag_coverage.coverage() >= StopCoverage) &&
+           (m_fit_change < StopChange);
+}
+
+
+
+///
+/// \brief Resuelve el ajuste alineado con las medidas aceptadas, mide cuánto ha cambiado y orienta con
+/// él los índices de cobertura.
+///
+/// El cambio se mide en los seis puntos de la elipsoide anterior que caen sobre los ejes: es lo que
+/// se alejan de la esfera unidad con la corrección nueva, así que no depende de las unidades.
+///
+void DeviceSession::updateEstimate()
+{
+    m_since_estimate = 0;
+    const QMatrix4x4 acc = m_acc_fit.solve(EllipsoidAligned);
+    const QMatrix4x4 mag = m_mag_fit.solve(EllipsoidAligned);
+
+    // Con pocas orientaciones el ajuste alineado puede no ser una elipsoide; se espera a tener más
+    if(!IsFinite(acc) || !IsFinite(mag)) return;
+
+    static const QVector3D AXES[6] = { QVector3D(1, 0, 0), QVector3D(-1, 0, 0), QVector3D(0, 1, 0),
+                                       QVector3D(0, -1, 0), QVector3D(0, 0, 1), QVector3D(0, 0, -1) };
+    const QMatrix4x4 accInverse = m_acc_estimate.inverted();
+    const QMatrix4x4 magInverse = m_mag_estimate.inverted();
+    double change = 0.0;
+    for(const QVector3D& axis : AXES) {
+        change = std::max(change, double(std::fabs(acc.map(accInverse.map(axis)).length() - 1.0f)));
+        change = std::max(change, double(std::fabs(mag.map(magInverse.map(axis)).length() - 1.0f)));
+    }
+    m_fit_change = (m_acc_estimate.isIdentity() || m_mag_estimate.isIdentity()) ? std::numeric_limits<double>::infinity() : change;
+    m_acc_estimate = acc;
+    m_mag_estimate = mag;
+
+    // Las medidas guardadas son pocas, como mucho Capacity por celda y sensor, así que recontarlas es barato
+    const size_t count = m_acc_samples[0].size();
+    m_acc_coverage.setCorrection(acc);
+    m_acc_coverage.rebin(m_acc_samples[0].data(), m_acc_samples[1].data(), m_acc_samples[2].data(), count);
+    m_mag_coverage.setCorrection(mag);
+    m_mag_coverage.rebin(m_mag_samples[0].data(), m_mag_samples[1].data(), m_mag_samples[2].data(), count);
+}
+
+
+
+///
+/// \brief Nube de puntos del acelerómetro que se muestra, diezmada.
+///
+const std::vector<QVector3D>& DeviceSession::accMeasurements() const
+{
+    return m_acc_measurements;
+}
+
+
+
+///
+/// \brief Nube de puntos del magnetómetro que se muestra, diezmada.
+///
+const std::vector<QVector3D>& DeviceSession::magMeasurements() const
+{
+    return m_mag_measurements;
+}
+
+
+
+///
+/// \brief Copia las medidas acumuladas, para calcular la calibración en otro hilo.
+/// \return Ecuaciones normales y medidas de los dos sensores.
+///
+FitInput DeviceSession::fitInput()
+{
+    FitInput input;
+    input.m_session = this;
+    input.m_samples.m_name = m_name;
+    for(int i=0 ; i<3 ; ++i) {
+        input.m_samples.m_acc[i] = m_acc_samples[i];
+        input.m_samples.m_mag[i] = m_mag_samples[i];
+    }
+    input.m_acc = m_acc_fit;
+    input.m_mag = m_mag_fit;
+    return input;
+}
+
+
+
+///
+/// \brief Guarda una calibración recién calculada, la envía al IMU y empieza una captura nueva.
+/// \param output Calibración calculada a partir de fitInput().
+///
+void DeviceSession::applyCalibration(const FitOutput& output)
+{
+    // La calibración del giróscopo es independiente y se conserva
+    const bool gyrValid = m_calibration.m_gyr_valid;
+    const QMatrix4x4 gyr = m_calibration.m_gyr;
+    m_calibration = output.m_calibration;
+    m_calibration.m_gyr_valid = gyrValid;
+    m_calibration.m_gyr = gyr;
+    m_fit_samples = output.m_samples;
+    m_acc_rejected = output.m_acc_rejected;
+    m_mag_rejected = output.m_mag_rejected;
+    m_thread->recalibrate(m_calibration.m_acc, m_calibration.m_mag);
+    clearMeasurements();
+}
+
+
+
+///
+/// \brief Medidas con las que se calculó el último ajuste robusto; la captura en curso ya es otra.
+///
+const FitDataset& DeviceSession::fitSamples() const
+{
+    return m_fit_samples;
+}
+
+
+
+///
+/// \brief Medidas del acelerómetro descartadas por el último ajuste robusto, una marca por cada una
+/// de fitSamples().
+///
+const std::vector<uint8_t>& DeviceSession::accRejected() const
+{
+    return m_acc_rejected;
+}
+
+
+
+///
+/// \brief Medidas del magnetómetro descartadas por el último ajuste robusto, una marca por cada una
+/// de fitSamples().
+///
+const std::vector<uint8_t>& DeviceSession::magRejected() const
+{
+    return m_mag_rejected;
+}
+
+
+
+///
+/// \brief Escribe las medidas descartadas por el último ajuste robusto en formato de texto, separado
+/// por tabuladores: el sensor, el índice de la medida en la captura y sus tres componentes sin calibrar.
+/// \param stream Flujo de salida.
+///
+void DeviceSession::writeOutliers(QTextStream& stream) const
+{
+    const size_t count = m_fit_samples.size();
+    stream << "# " << m_name << "\n";
+    stream << "# samples " << count << ", rejected acc " << m_calibration.m_acc_rejected
+           << " mag " << m_calibration.m_mag_rejected << "\n";
+    stream << "sensor\tindex\tx\ty\tz\n";
+    for(int sensor=0 ; sensor<2 ; ++sensor) {
+        const std::vector<uint8_t>& rejected = sensor ? m_mag_rejected : m_acc_rejected;
+        const std::vector<float>* xyz = sensor ? m_fit_samples.m_mag : m_fit_samples.m_acc;
+        for(size_t i=0 ; (i < rejected.size()) && (i < count) ; ++i) {
+            if(!rejected[i]) continue;
+            stream << (sensor ? "mag" : "acc") << "\t" << i << "\t";
+            stream << xyz[0][i] << "\t" << xyz[1][i] << "\t" << xyz[2][i] << "\n";
+        }
+    }
+    stream << "\n";
+}
+
+
+
+///
+/// \brief Devuelve la última calibración calculada para el IMU.
+/// \return Calibración; m_valid es falso si todavía no se ha calculado ninguna.
+///
+const DeviceCalibration& DeviceSession::calibration() const
+{
+    return m_calibration;
+}
+
+
+
+///
+/// \brief Descarta las medidas acumuladas para la calibración del giróscopo.
+///
+void DeviceSession::clearGyroMeasurements()
+{
+    m_gyro.reset();
+}
+
+
+
+///
+/// \brief Añade una medida para la calibración del giróscopo, tomada con el IMU quieto.
+/// \param gyr Giróscopo, radianes/s.
+/// \param timestamp Instante de llegada, en ns.
+///
+void DeviceSession::addGyroMeasurement(const QVector3D& gyr, qint64 timestamp)
+{
+    m_gyro.add(gyr, timestamp);
+}
+
+
+
+///
+/// \brief Sesgo, ruido y curva de Allan de las medidas del giróscopo acumuladas.
+///
+const GyroCalibrator& DeviceSession::gyroCalibrator() const
+{
+    return m_gyro;
+}
+
+
+
+///
+/// \brief Guarda la calibración del giróscopo que resta el sesgo medido y la envía al IMU.
+///
+/// Las medidas se conservan, para poder guardar después su curva de Allan.
+/// \return Falso si no hay suficientes medidas; entonces no se cambia nada.
+///
+bool DeviceSession::applyGyroCalibration()
+{
+    if(m_gyro.count() < uint64_t(GyroCalibrator::MinSamples)) return false;
+    m_calibration.m_gyr = m_gyro.correction();
+    m_calibration.m_gyr_valid = true;
+    m_thread->recalibrateGyro(m_calibration.m_gyr);
+    return true;
+}
+
+
+
+///
+/// \brief Fusiona en el PC una medida de los sensores, con la última calibración calculada.
+///
+/// Sin calibración del acelerómetro y del magnetómetro, o sin la del giróscopo, ese sensor se usa tal
+/// cual; los filtros normalizan sus medidas, pero sin calibrar el hierro duro la orientación se desvía.
+/// \param gyr Giróscopo, radianes/s.
+/// \param acc Acelerómetro.
+/// \param mag Magnetómetro.
+/// \param timestamp Instante de llegada, en ns.
+///
+void DeviceSession::fuse(const QVector3D& gyr, const QVector3D& acc, const QVector3D& mag, qint64 timestamp)
+{
+    const bool valid = m_calibration.m_valid;
+    m_fusion.update(m_calibration.m_gyr_valid ? m_calibration.m_gyr.map(gyr) : gyr,
+                    valid ? m_calibration.m_acc.map(acc) : acc,
+                    valid ? m_calibration.m_mag.map(mag) : mag,
+                    timestamp);
+}
+
+
+
+///
+/// \brief Fusión en el PC de las medidas del IMU.
+///
+SensorFusion& DeviceSession::fusion()
+{
+    return m_fusion;
+}
+
+
+
+///
+/// \brief Fusión en el PC de las medidas del IMU.
+///
+const SensorFusion& DeviceSession::fusion() const
+{
+    return m_fusion;
+}
+
+
+
+///
+/// \brief Actualiza los contadores de tráfico y la tasa de muestras.
+/// \param seconds Tiempo transcurrido desde la última actualización.
+///
+void DeviceSession::updateStats(double seconds)
+{
+    const TelemetryStats stats = m_thread->stats();
+    m_sample_rate = (seconds > 0.0) ? (stats.m_samples - m_stats.m_samples) / seconds : 0.0;
+    m_stats = stats;
+}
+
+
+
+///
+/// \brief Contadores de tráfico en la última actualización.
+///
+const TelemetryStats& DeviceSession::stats() const
+{
+    return m_stats;
+}
+
+
+
+///
+/// \brief Tasa de muestras en la última actualización, en muestras/s.
+///
+double DeviceSession::sampleRate() const
+{
+    return m_sample_rate;
+}
+
+
+
+///
+/// \brief Constructor.
+/// \param parent Objeto padre.
+///
+DeviceManager::DeviceManager(QObject* parent) :
+    QObject(parent),
+    m_fit_model(EllipsoidAligned),
+    m_robust_fit(false),
+    m_host_fusion(false),
+    m_fusion_filter(FusionMadgwick),
+    m_fit_cancel(std::make_shared<std::atomic<bool>>(false))
+{
+    connect(&m_fit_watcher, &QFutureWatcher<FitOutput>::finished, this, &DeviceManager::fitDone);
+}
+
+
+
+///
+/// \brief Destructor, cierra todas las conexiones.
+///
+/// Sólo aquí se esperan los cálculos cancelados, que usan el gestor hasta terminar la pasada en curso.
+///
+DeviceManager::~DeviceManager()
+{
+    close();
+    m_fit_watcher.waitForFinished();
+    for( auto& fit : m_cancelled_fits ) {
+        fit.waitForFinished();
+    }
+}
+
+
+
+///
+/// \brief Abre la conexión con un IMU, si el puerto no estaba ya abierto.
+/// \param info Datos del puerto serie.
+/// \param binary Verdadero para pedir la telemetría en tramas binarias.
+/// \return Sesión del IMU.
+///
+DeviceSession* DeviceManager::open(const QSerialPortInfo& info, bool binary)
+{
+    for( auto& session : m_sessions ) {
+        if(session->name() == info.portName()) return session.get();
+    }
+
+    m_sessions.emplace_back(new DeviceSession(info));
+    DeviceSession* session = m_sessions.back().get();
+    start(session, binary);
+    return session;
+}
+
+
+
+///
+/// \brief Reproduce una grabación como si fuera un IMU más.
+/// \param fileName Ruta de la grabación.
+/// \param realtime Verdadero para respetar los tiempos originales, falso para ir lo más rápido posible.
+/// \return Sesión de la reproducción.
+///
+DeviceSession* DeviceManager::openReplay(const QString& fileName, bool realtime)
+{
+    m_sessions.emplace_back(new DeviceSession(QSerialPortInfo(), QFileInfo(fileName).fileName()));
+    DeviceSession* session = m_sessions.back().get();
+    session->thread().setReplay(fileName, realtime);
+    start(session, false);
+    return session;
+}
+
+
+
+///
+/// \brief Conecta las señales del hilo de lectura de una sesión y lo arranca.
+/// \param session Sesión recién creada.
+/// \param binary Verdadero para pedir la telemetría en tramas binarias.
+///
+void DeviceManager::start(DeviceSession* session, bool binary)
+{
+    SerialThread* thread = &session->thread();
+    const QString name = session->name();
+    connect(thread, &SerialThread::samplesAvailable, this, &DeviceManager::samplesAvailable);
+    connect(thread, &SerialThread::calibrationWritten, this, [this, name](const QString& sensor, bool verified) {
+        emit calibrationWritten(name, sensor, verified);
+    });
+    connect(thread, &SerialThread::replayFinished, this, [this, name](quint64 samples, double seconds) {
+        emit replayFinished(name, samples, seconds);
+    });
+    if(binary) thread->setBinary(true);
+    if(m_host_fusion) thread->setHostFusion(true);
+    session->fusion().setFilter(m_fusion_filter);
+    thread->start();
+}
+
+
+
+///
+/// \brief Cierra todas las conexiones.
+///
+/// Primero se avisa a todos los hilos y después se espera a cada uno, para que se cierren en paralelo.
+/// El cálculo de calibraciones en curso se cancela sin esperarle, y su fitFinished() llega después.
+///
+void DeviceManager::close()
+{
+    cancelFit();
+    for( auto& session : m_sessions ) {
+        session->thread().setMode(Disconnected);
+    }
+    m_sessions.clear();
+}
+
+
+
+///
+/// \brief Número de IMUs conectados.
+///
+int DeviceManager::size() const
+{
+    return int(m_sessions.size());
+}
+
+
+
+///
+/// \brief Devuelve la sesión de un IMU.
+/// \param index Índice, entre 0 y size()-1.
+/// \return Sesión del IMU.
+///
+DeviceSession& DeviceManager::session(int index)
+{
+    return *m_sessions[index];
+}
+
+
+
+///
+/// \brief Cambia el modo de funcionamiento de todos los IMUs.
+/// \param mode Nuevo modo.
+///
+void DeviceManager::setMode(IMUMode mode)
+{
+    if(mode == Disconnected) {
+        close();
+        return;
+    }
+    for( auto& session : m_sessions ) {
+        session->thread().setMode(mode);
+    }
+}
+
+
+
+///
+/// \brief Cambia el formato de la telemetría de todos los IMUs.
+/// \param binary Verdadero para tramas binarias.
+///
+void DeviceManager::setBinary(bool binary)
+{
+    for( auto& session : m_sessions ) {
+        session->thread().setBinary(binary);
+    }
+}
+
+
+
+///
+/// \brief Descarta las medidas acumuladas de todos los IMUs.
+///
+void DeviceManager::clearMeasurements()
+{
+    for( auto& session : m_sessions ) {
+        session->clearMeasurements();
+    }
+}
+
+
+
+///
+/// \brief Empieza a grabar los bytes recibidos de todos los IMUs.
+///
+/// Con un solo IMU se usa el nombre de fichero tal cual; con varios, se añade el nombre del puerto.
+///
+/// \param fileName Ruta del fichero.
+/// \return Número de grabaciones iniciadas.
+///
+int DeviceManager::startRecording(const QString& fileName)
+{
+    const QFileInfo info(fileName);
+    int started = 0;
+    for( auto& session : m_sessions ) {
+        QString name = fileName;
+        if(m_sessions.size() > 1) {
+            const QString port = QString(session->name()).replace('/', '_');
+            name = info.path() + "/" + info.completeBaseName() + "-" + port + "." + info.suffix();
+        }
+        if(session->thread().startRecording(name)) ++started;
+        else qDebug() << "Couldn't record to" << name;
+    }
+    return started;
+}
+
+
+
+///
+/// \brief Termina las grabaciones de todos los IMUs.
+///
+void DeviceManager::stopRecording()
+{
+    for( auto& session : m_sessions ) {
+        session->thread().stopRecording();
+    }
+}
+
+
+
+///
+/// \brief Elige el modelo de elipsoide para las próximas calibraciones.
+/// \param model Modelo alineado con los ejes u orientado (soft-iron).
+///
+void DeviceManager::setFitModel(EllipsoidModel model)
+{
+    m_fit_model = model;
+}
+
+
+
+///
+/// \brief Modelo de elipsoide de las calibraciones.
+///
+EllipsoidModel DeviceManager::fitModel() const
+{
+    return m_fit_model;
+}
+
+
+
+///
+/// \brief Activa o desactiva el descarte de medidas atípicas en las próximas calibraciones.
+/// \param robust Verdadero para el ajuste robusto.
+///
+void DeviceManager::setRobustFit(bool robust)
+{
+    m_robust_fit = robust;
+}
+
+
+
+///
+/// \brief Indica si las calibraciones descartan las medidas atípicas.
+///
+bool DeviceManager::robustFit() const
+{
+    return m_robust_fit;
+}
+
+
+
+///
+/// \brief Empieza a calcular en segundo plano la calibración de todos los IMUs con medidas.
+///
+/// Avisa del avance con fitProgress() y del final con fitFinished(); las calibraciones sólo se envían
+/// a los IMUs si ha terminado sin cancelarse. Si había otro cálculo en curso, se cancela sin esperarle y
+/// ya no emite fitFinished().
+/// \return Número de IMUs que se calibran; si es 0, no se emite ninguna señal.
+///
+int DeviceManager::startFit()
+{
+    cancelFit();
+
+    auto inputs = std::make_shared<std::vector<FitInput>>();
+    for( auto& session : m_sessions ) {
+        if(session->measurementCount()) inputs->push_back(session->fitInput());
+    }
+    if(inputs->empty()) return 0;
+
+    // El cálculo cancelado sigue en el pool hasta el final de su pasada; se guarda para esperarle al destruir
+    m_cancelled_fits.erase(std::remove_if(m_cancelled_fits.begin(), m_cancelled_fits.end(),
+                                          [](const QFuture<FitOutput>& fit) { return fit.isFinished(); }),
+                           m_cancelled_fits.end());
+    if(m_fit_watcher.isRunning()) m_cancelled_fits.push_back(m_fit_watcher.future());
+
+    // Cada cálculo tiene su propia marca, así que uno ya cancelado no puede confundirse con el siguiente
+    m_fit_cancel = std::make_shared<std::atomic<bool>>(false);
+    const std::shared_ptr<std::atomic<bool>> cancel = m_fit_cancel;
+    const EllipsoidModel model = m_fit_model;
+    const bool robust = m_robust_fit;
+    const auto done = std::make_shared<std::atomic<int>>(0);
+    const int total = 2 * int(inputs->size());
+
+    // Una tarea por IMU, en paralelo; la función guarda una referencia a las entradas hasta que terminan todas
+    const std::function<FitOutput(const FitInput&)> task =
+        [this, inputs, cancel, model, robust, done, total](const FitInput& input) {
+            return solve(input, model, robust, *cancel, *done, total);
+        };
+    m_fit_timer.start();
+    m_fit_watcher.setFuture(QtConcurrent::mapped(inputs->cbegin(), inputs->cend(), task));
+    return int(inputs->size());
+}
+
+
+
+///
+/// \brief Cancela el cálculo de calibraciones en curso, si lo hay; no se envía ninguna.
+///
+void DeviceManager::cancelFit()
+{
+    *m_fit_cancel = true;
+    m_fit_watcher.cancel();
+}
+
+
+
+///
+/// \brief Indica si hay un cálculo de calibraciones en curso.
+///
+bool DeviceManager::fitting() const
+{
+    return m_fit_watcher.isRunning();
+}
+
+
+
+///
+/// \brief Calcula la calibración de un IMU; se ejecuta en un hilo del pool, a la vez que la de los demás.
+///
+/// El ajuste normal sólo resuelve las ecuaciones normales ya acumuladas, así que no depende del número
+/// de medidas. El robusto parte de ellas y descarta las medidas atípicas de cada sensor por separado;
+/// es el que puede tardar, y se interrumpe entre dos pasadas si se cancela.
+/// \param input Medidas del IMU.
+/// \param model Modelo de elipsoide que se ajusta.
+/// \param robust Verdadero para descartar las medidas atípicas.
+/// \param cancel Marca de cancelación, común a todas las tareas del cálculo.
+/// \param done Sensores ya calibrados por todas las tareas.
+/// \param total Sensores a calibrar entre todas las tareas.
+/// \return Calibración del IMU; no es válida si se ha cancelado.
+///
+FitOutput DeviceManager::solve(const FitInput& input, EllipsoidModel model, bool robust, const std::atomic<bool>& cancel,
+                               std::atomic<int>& done, int total)
+{
+    const FitDataset& samples = input.m_samples;
+    const size_t count = samples.size();
+    FitOutput output;
+    output.m_session = input.m_session;
+    output.m_calibration = DeviceCalibration();
+    output.m_calibration.m_samples = count;
+    if(robust) output.m_samples = samples;
+    RobustEllipsoidFit fitter;
+    fitter.setCancel(&cancel);
+
+    // Primero el acelerómetro y después el magnetómetro, avisando tras cada uno
+    for(int sensor=0 ; sensor<2 ; ++sensor) {
+        if(cancel) return output;
+        const std::vector<float>* xyz = sensor ? samples.m_mag : samples.m_acc;
+        const EllipsoidAccumulator& moments = sensor ? input.m_mag : input.m_acc;
+        QMatrix4x4& correction = sensor ? output.m_calibration.m_mag : output.m_calibration.m_acc;
+        uint64_t& rejected = sensor ? output.m_calibration.m_mag_rejected : output.m_calibration.m_acc_rejected;
+        if(robust) {
+            correction = fitter.solve(xyz[0].data(), xyz[1].data(), xyz[2].data(), count, model, moments);
+            rejected = fitter.rejectedCount();
+            (sensor ? output.m_mag_rejected : output.m_acc_rejected) = fitter.rejected();
+        }
+        else {
+            correction = moments.solve(model);
+        }
+        if(cancel) return output;
+
+        // El aviso sale con el cerrojo tomado, para que el avance llegue en orden aunque acaben dos tareas a la vez
+        QMutexLocker lock(&m_fit_progress_lock);
+        emit fitProgress(++done, total);
+    }
+    output.m_calibration.m_valid = true;
+    return output;
+}
+
+
+
+///
+/// \brief Ha terminado el cálculo de calibraciones: si no se ha cancelado, las envía a los IMUs.
+///
+void DeviceManager::fitDone()
+{
+    const double milliseconds = m_fit_timer.nsecsElapsed() / 1e6;
+    if(*m_fit_cancel) {
+        emit fitFinished(false, milliseconds);
+        return;
+    }
+
+    // Las sesiones cerradas mientras tanto se ignoran
+    for( const auto& output : m_fit_watcher.future().results() ) {
+        if(!output.m_calibration.m_valid) continue;
+        for( auto& session : m_sessions ) {
+            if(session.get() != output.m_session) continue;
+            session->applyCalibration(output);
+            const QString uid = session->uid();
+            if(!uid.isEmpty()) m_calibrations[uid] = session->calibration();
+        }
+    }
+    emit fitFinished(true, milliseconds);
+}
+
+
+
+///
+/// \brief Descarta las medidas para la calibración del giróscopo de todos los IMUs.
+///
+void DeviceManager::clearGyroMeasurements()
+{
+    for( auto& session : m_sessions ) {
+        session->clearGyroMeasurements();
+    }
+}
+
+
+
+///
+/// \brief Calcula el sesgo del giróscopo de todos los IMUs con suficientes medidas y se lo envía.
+/// \return Número de IMUs calibrados.
+///
+int DeviceManager::applyGyroCalibration()
+{
+    int count = 0;
+    for( auto& session : m_sessions ) {
+        if(!session->applyGyroCalibration()) continue;
+        const QString uid = session->uid();
+        if(!uid.isEmpty()) m_calibrations[uid] = session->calibration();
+        ++count;
+    }
+    return count;
+}
+
+
+
+///
+/// \brief Activa o desactiva la fusión en el PC de todos los IMUs; cada uno vuelve a orientarse desde cero.
+/// \param enabled Verdadero para pedir también las medidas de los sensores en modo brújula.
+///
+void DeviceManager::setHostFusion(bool enabled)
+{
+    m_host_fusion = enabled;
+    resetFusion();
+    for( auto& session : m_sessions ) {
+        session->thread().setHostFusion(enabled);
+    }
+}
+
+
+
+///
+/// \brief Indica si se fusionan en el PC las medidas de los IMUs.
+///
+bool DeviceManager::hostFusion() const
+{
+    return m_host_fusion;
+}
+
+
+
+///
+/// \brief Elige el filtro de la fusión en el PC de todos los IMUs.
+/// \param filter Filtro de Madgwick o de Mahony.
+///
+void DeviceManager::setFusionFilter(FusionFilter filter)
+{
+    m_fusion_filter = filter;
+    for( auto& session : m_sessions ) {
+        session->fusion().setFilter(filter);
+    }
+}
+
+
+
+///
+/// \brief Filtro de la fusión en el PC.
+///
+FusionFilter DeviceManager::fusionFilter() const
+{
+    return m_fusion_filter;
+}
+
+
+
+///
+/// \brief Reinicia la fusión en el PC de todos los IMUs, que se orientan con su siguiente medida.
+///
+void DeviceManager::resetFusion()
+{
+    for( auto& session : m_sessions ) {
+        session->fusion().reset();
+    }
+}
+
+
+
+///
+/// \brief Indica si todos los IMUs han completado la captura, para terminar la calibración sola.
+///
+bool DeviceManager::calibrationComplete() const
+{
+    if(m_sessions.empty()) return false;
+    for( const auto& session : m_sessions ) {
+        if(!session->calibrationComplete()) return false;
+    }
+    return true;
+}
+
+
+
+///
+/// \brief Devuelve la última calibración calculada para un IMU, aunque ya no esté conectado.
+/// \param uid Identificador único del IMU.
+/// \return Calibración; m_valid es falso si no se ha calculado ninguna.
+///
+DeviceCalibration DeviceManager::calibration(const QString& uid) const
+{
+    DeviceCalibration none = {};
+    none.m_valid = false;
+    none.m_gyr_valid = false;
+    return m_calibrations.value(uid, none);
+}
+
+
+
+///
+/// \brief Actualiza los contadores de tráfico de todos los IMUs.
+/// \param seconds Tiempo transcurrido desde la última actualización.
+///
+void DeviceManager::updateStats(double seconds)
+{
+    for( auto& session : m_sessions ) {
+        session->updateStats(seconds);
+    }
+}
+
+
+
+///
+/// \brief Suma de los contadores de tráfico de todos los IMUs, en la última actualización.
+/// \return Contadores agregados; la latencia de comando es la peor de todas.
+///
+TelemetryStats DeviceManager::stats() const
+{
+    TelemetryStats total = {};
+    for( const auto& session : m_sessions ) {
+        const TelemetryStats& stats = session->stats();
+        total.m_bytes += stats.m_bytes;
+        total.m_samples += stats.m_samples;
+        total.m_errors += stats.m_errors;
+        total.m_overflows += stats.m_overflows;
+        total.m_wakeups += stats.m_wakeups;
+        total.m_timeouts += stats.m_timeouts;
+        total.m_command_latency = std::max(total.m_command_latency, stats.m_command_latency);
+    }
+    return total;
+}
+
+
+
+///
+/// \brief Suma los histogramas de latencia de todos los IMUs.
+/// \param interval Histograma donde se suman los intervalos entre lecturas con muestras.
+/// \param parse Histograma donde se suman las latencias de decodificación.
+///
+void DeviceManager::mergeLatency(LatencyHistogram& interval, LatencyHistogram& parse) const
+{
+    for( const auto& session : m_sessions ) {
+        interval.merge(session->thread().intervalLatency());
+        parse.merge(session->thread().parseLatency());
+    }
+}
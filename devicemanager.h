@@ -0,0 +1,231 @@
+#pragma once
+
+#include <QElapsedTimer>
+#include <QFutureWatcher>
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QSerialPortInfo>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "batchfit.h"
+#include "gyrocalibrator.h"
+#include "sensorfusion.h"
+#include "serialthread.h"
+#include "Render/coverage.h"
+#include "Render/ellipsoid.h"
+
+
+
+///
+/// \brief Calibración calculada para un IMU.
+///
+struct DeviceCalibration
+{
+    bool m_valid;
+    QMatrix4x4 m_acc;
+    QMatrix4x4 m_mag;
+    uint64_t m_samples;
+    uint64_t m_acc_rejected;
+    uint64_t m_mag_rejected;
+    bool m_gyr_valid;
+    QMatrix4x4 m_gyr;
+};
+
+
+
+class DeviceSession;
+
+
+
+///
+/// \brief Copia de las medidas de un IMU, para calcular su calibración en otro hilo.
+///
+struct FitInput
+{
+    DeviceSession* m_session;
+    FitDataset m_samples;
+    EllipsoidAccumulator m_acc, m_mag;
+};
+
+
+
+///
+/// \brief Calibración de un IMU calculada en otro hilo, con las medidas que ha descartado el ajuste robusto.
+///
+/// En el ajuste robusto se guarda también la copia de las medidas a la que se refieren las marcas.
+///
+struct FitOutput
+{
+    DeviceSession* m_session;
+    DeviceCalibration m_calibration;
+    FitDataset m_samples;
+    std::vector<uint8_t> m_acc_rejected, m_mag_rejected;
+};
+
+
+
+///
+/// \brief Efecto de una medida nueva en la nube de puntos que se muestra.
+///
+enum CloudChange { CloudUnchanged, CloudAppended, CloudCompacted };
+
+
+
+///
+/// \brief Conexión con un IMU: su hilo de lectura, sus medidas y su calibración.
+///
+/// Las medidas se suman a los acumuladores del ajuste según llegan. Además se guardan todas como
+/// estructura de vectores, porque el ajuste robusto necesita el residuo de cada una. Una medida sólo
+/// se acepta si cae en una celda de la esfera que todavía no está llena para alguno de los dos sensores
+/// (ver CoverageIndex): con la placa quieta no se acumulan miles de medidas repetidas que ocupan memoria
+/// y desequilibran el ajuste hacia esa orientación. Cada EstimateInterval medidas aceptadas se resuelve
+/// el ajuste alineado para orientar el índice y ver cuánto cambia la calibración. Para mostrarlas
+/// sólo se guarda una nube de como mucho CloudCapacity puntos: al llenarse se queda con uno de cada
+/// dos y a partir de ahí guarda una de cada dos medidas, y así sucesivamente. En la calibración del
+/// giróscopo las medidas no se guardan: sólo se acumulan su media y su curva de Allan. En modo brújula
+/// las medidas pueden fusionarse también en el PC, con la última calibración, para comparar la
+/// orientación con la del firmware.
+///
+class DeviceSession
+{
+public:
+    static const int CloudCapacity = 20000;
+    static const int EstimateInterval = 500;
+    static constexpr double StopCoverage = 0.9;
+    static constexpr double StopChange = 2e-3;
+
+    explicit DeviceSession(const QSerialPortInfo& info, const QString& name = QString());
+    ~DeviceSession();
+    SerialThread& thread();
+    QString name() const;
+    QString uid() const;
+    void clearMeasurements();
+    CloudChange addMeasurement(const QVector3D& acc, const QVector3D& mag);
+    uint64_t measurementCount() const;
+    const EllipsoidAccumulator& accAccumulator() const;
+    const EllipsoidAccumulator& magAccumulator() const;
+    uint64_t duplicateCount() const;
+    double accCoverage() const;
+    double magCoverage() const;
+    double fitChange() const;
+    bool calibrationComplete() const;
+    const std::vector<QVector3D>& accMeasurements() const;
+    const std::vector<QVector3D>& magMeasurements() const;
+    FitInput fitInput();
+    void applyCalibration(const FitOutput& output);
+    const FitDataset& fitSamples() const;
+    const std::vector<uint8_t>& accRejected() const;
+    const std::vector<uint8_t>& magRejected() const;
+    void writeOutliers(QTextStream& stream) const;
+    const DeviceCalibration& calibration() const;
+    void clearGyroMeasurements();
+    void addGyroMeasurement(const QVector3D& gyr, qint64 timestamp);
+    const GyroCalibrator& gyroCalibrator() const;
+    bool applyGyroCalibration();
+    void fuse(const QVector3D& gyr, const QVector3D& acc, const QVector3D& mag, qint64 timestamp);
+    SensorFusion& fusion();
+    const SensorFusion& fusion() const;
+    void updateStats(double seconds);
+    const TelemetryStats& stats() const;
+    double sampleRate() const;
+
+private:
+    QString m_name;
+    std::unique_ptr<SerialThread> m_thread;
+    std::vector<QVector3D> m_acc_measurements;
+    std::vector<QVector3D> m_mag_measurements;
+    EllipsoidAccumulator m_acc_fit, m_mag_fit;
+    std::vector<float> m_acc_samples[3], m_mag_samples[3];
+    FitDataset m_fit_samples;
+    std::vector<uint8_t> m_acc_rejected, m_mag_rejected;
+    CoverageIndex m_acc_coverage, m_mag_coverage;
+    QMatrix4x4 m_acc_estimate, m_mag_estimate;
+    uint64_t m_duplicates;
+    int m_since_estimate;
+    double m_fit_change;
+    int m_cloud_stride, m_cloud_skip;
+    DeviceCalibration m_calibration;
+    GyroCalibrator m_gyro;
+    SensorFusion m_fusion;
+    TelemetryStats m_stats;
+    double m_sample_rate;
+
+    void updateEstimate();
+};
+
+
+
+///
+/// \brief Conjunto de IMUs conectados a la vez.
+///
+/// Cada IMU tiene su propio hilo de lectura y su propia cola de muestras; la interfaz gráfica las vacía
+/// todas una vez por fotograma. Las calibraciones se calculan en paralelo en el pool global, una tarea por
+/// IMU sobre una copia de sus medidas, y sólo se envían a los IMUs cuando terminan todas sin cancelarse. Las
+/// calibraciones se guardan por identificador único, de forma que sobreviven a una reconexión por otro puerto.
+///
+class DeviceManager : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit DeviceManager(QObject* parent = 0);
+    ~DeviceManager();
+    DeviceSession* open(const QSerialPortInfo& info, bool binary);
+    DeviceSession* openReplay(const QString& fileName, bool realtime);
+    void close();
+    int size() const;
+    DeviceSession& session(int index);
+    void setMode(IMUMode mode);
+    void setBinary(bool binary);
+    void clearMeasurements();
+    int startRecording(const QString& fileName);
+    void stopRecording();
+    void setFitModel(EllipsoidModel model);
+    EllipsoidModel fitModel() const;
+    void setRobustFit(bool robust);
+    bool robustFit() const;
+    int startFit();
+    void cancelFit();
+    bool fitting() const;
+    bool calibrationComplete() const;
+    void clearGyroMeasurements();
+    int applyGyroCalibration();
+    void setHostFusion(bool enabled);
+    bool hostFusion() const;
+    void setFusionFilter(FusionFilter filter);
+    FusionFilter fusionFilter() const;
+    void resetFusion();
+    DeviceCalibration calibration(const QString& uid) const;
+    void updateStats(double seconds);
+    TelemetryStats stats() const;
+    void mergeLatency(LatencyHistogram& interval, LatencyHistogram& parse) const;
+
+signals:
+    void samplesAvailable();
+    void calibrationWritten(const QString& device, const QString& sensor, bool verified);
+    void replayFinished(const QString& device, quint64 samples, double seconds);
+    void fitProgress(int done, int total);
+    void fitFinished(bool completed, double milliseconds);
+
+private:
+    std::vector<std::unique_ptr<DeviceSession>> m_sessions;
+    QHash<QString, DeviceCalibration> m_calibrations;
+    EllipsoidModel m_fit_model;
+    bool m_robust_fit;
+    bool m_host_fusion;
+    FusionFilter m_fusion_filter;
+    QFutureWatcher<FitOutput> m_fit_watcher;
+    std::vector<QFuture<FitOutput>> m_cancelled_fits;
+    QMutex m_fit_progress_lock;
+    std::shared_ptr<std::atomic<bool>> m_fit_cancel;
+    QElapsedTimer m_fit_timer;
+
+    void start(DeviceSession* session, bool binary);
+    FitOutput solve(const FitInput& input, EllipsoidModel model, bool robust, const std::atomic<bool>& cancel,
+                    std::atomic<int>& done, int total);
+    void fitDone();
+};
@@ -0,0 +1,85 @@
+#include "fitpreview.h"
+
+#include <QtConcurrent>
+
+#include "devicemanager.h"
+
+
+
+///
+/// \brief Constructor.
+/// \param parent Objeto padre.
+///
+FitPreviewer::FitPreviewer(QObject* parent) : QObject(parent), m_cancelled(false)
+{
+    connect(&m_watcher, &QFutureWatcher<FitPreview>::finished, this, [this]() {
+        if(!m_cancelled) emit previewReady(m_watcher.result());
+    });
+}
+
+
+
+///
+/// \brief Destructor, espera al ajuste en curso.
+///
+FitPreviewer::~FitPreviewer()
+{
+    m_watcher.waitForFinished();
+}
+
+
+
+///
+/// \brief Pide un ajuste provisional con las medidas acumuladas hasta ahora en una sesión.
+/// \param session Sesión del IMU.
+/// \param model Modelo de elipsoide.
+/// \return Falso si se ha ignorado porque todavía hay otro en curso.
+///
+bool FitPreviewer::request(const DeviceSession& session, EllipsoidModel model)
+{
+    if(m_watcher.isRunning()) return false;
+
+    m_cancelled = false;
+    const QString name = session.name();
+    const EllipsoidAccumulator acc = session.accAccumulator();
+    const EllipsoidAccumulator mag = session.magAccumulator();
+    m_watcher.setFuture(QtConcurrent::run([name, acc, mag, model]() { return solve(name, acc, mag, model); }));
+    return true;
+}
+
+
+
+///
+/// \brief Descarta el ajuste en curso, por ejemplo al salir del modo de calibración.
+///
+void FitPreviewer::cancel()
+{
+    m_cancelled = true;
+}
+
+
+
+///
+/// \brief Resuelve el ajuste provisional; se ejecuta en un hilo del pool.
+/// \param name Nombre de la sesión.
+/// \param acc Ecuaciones normales del acelerómetro.
+/// \param mag Ecuaciones normales del magnetómetro.
+/// \param model Modelo de elipsoide.
+/// \return Ajuste y forma de las dos elipsoides; m_valid es falso si todavía no hay suficientes medidas.
+///
+FitPreview FitPreviewer::solve(const QString& name, const EllipsoidAccumulator& acc, const EllipsoidAccumulator& mag,
+                               EllipsoidModel model)
+{
+    FitPreview preview;
+    preview.m_name = name;
+    preview.m_samples = acc.count();
+    preview.m_acc = acc.solve(model);
+    preview.m_mag = mag.solve(model);
+    preview.m_acc_shape = acc.shape(preview.m_acc);
+    preview.m_mag_shape = mag.shape(preview.m_mag);
+    // solve() devuelve la identidad cuando las medidas todavía no forman una elipsoide
+    preview.m_valid = (acc.count() >= uint64_t(EllipsoidAccumulator::Parameters)) &&
+                      !preview.m_acc.isIdentity() && !preview.m_mag.isIdentity() &&
+                      preview.m_acc_shape.m_valid && preview.m_mag_shape.m_valid;
+    return preview;
+}
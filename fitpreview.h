@@ -0,0 +1,52 @@
+#pragma once
+
+#include <QFutureWatcher>
+#include <QObject>
+
+#include "Render/ellipsoid.h"
+
+class DeviceSession;
+
+
+
+///
+/// \brief Ajuste provisional de un IMU, calculado durante la captura.
+///
+struct FitPreview
+{
+    bool m_valid;
+    QString m_name;
+    quint64 m_samples;
+    QMatrix4x4 m_acc, m_mag;
+    EllipsoidShape m_acc_shape, m_mag_shape;
+};
+
+
+
+///
+/// \brief Calcula ajustes provisionales en un hilo del pool global, sin bloquear al que los pide.
+///
+/// request() sólo copia las ecuaciones normales de la sesión, unos cientos de bytes, así que el hilo
+/// de la interfaz gráfica no espera nunca al ajuste y el del puerto serie no se entera. Si todavía hay
+/// un ajuste en curso, la petición se ignora: con pedirlo varias veces por segundo basta.
+///
+class FitPreviewer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit FitPreviewer(QObject* parent = 0);
+    ~FitPreviewer();
+    bool request(const DeviceSession& session, EllipsoidModel model);
+    void cancel();
+
+signals:
+    void previewReady(const FitPreview& preview);
+
+private:
+    QFutureWatcher<FitPreview> m_watcher;
+    bool m_cancelled;
+
+    static FitPreview solve(const QString& name, const EllipsoidAccumulator& acc, const EllipsoidAccumulator& mag,
+                            EllipsoidModel model);
+};
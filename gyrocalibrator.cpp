@@ -0,0 +1,356 @@
+#include "gyrocalibrator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+
+
+///
+/// \brief Constructor, sin muestras.
+///
+AllanVariance::AllanVariance()
+{
+    reset();
+}
+
+
+
+///
+/// \brief Descarta todas las muestras.
+///
+void AllanVariance::reset()
+{
+    for( auto& level : m_levels ) {
+        for(int i=0 ; i<3 ; ++i) {
+            level.m_previous[i] = 0.0;
+            level.m_pending[i] = 0.0;
+            level.m_squares[i] = 0.0;
+        }
+        level.m_values = 0;
+    }
+    m_count = 0;
+}
+
+
+
+///
+/// \brief Añade una muestra.
+///
+/// La muestra entra en el nivel 0; cuando completa una pareja, la media de las dos sube al nivel
+/// siguiente, y así mientras se sigan completando parejas.
+/// \param value Valor de los tres ejes.
+///
+void AllanVariance::add(const double value[3])
+{
+    double mean[3] = { value[0], value[1], value[2] };
+    ++m_count;
+    for( auto& level : m_levels ) {
+        if(level.m_values) {
+            for(int i=0 ; i<3 ; ++i) {
+                const double difference = mean[i] - level.m_previous[i];
+                level.m_squares[i] += difference * difference;
+            }
+        }
+        for(int i=0 ; i<3 ; ++i) level.m_previous[i] = mean[i];
+
+        // La primera de cada pareja espera a la segunda
+        if(!(level.m_values++ & 1)) {
+            for(int i=0 ; i<3 ; ++i) level.m_pending[i] = mean[i];
+            return;
+        }
+        for(int i=0 ; i<3 ; ++i) mean[i] = 0.5 * (level.m_pending[i] + mean[i]);
+    }
+}
+
+
+
+///
+/// \brief Número de muestras añadidas.
+///
+uint64_t AllanVariance::count() const
+{
+    return m_count;
+}
+
+
+
+///
+/// \brief Número de niveles con al menos una diferencia.
+///
+int AllanVariance::levels() const
+{
+    int levels = 0;
+    while((levels < Levels) && (m_levels[levels].m_values > 1)) ++levels;
+    return levels;
+}
+
+
+
+///
+/// \brief Número de diferencias entre medias consecutivas de un nivel.
+/// \param level Nivel, con τ = 2^level·τ₀.
+///
+uint64_t AllanVariance::pairs(int level) const
+{
+    const uint64_t values = m_levels[level].m_values;
+    return values ? values - 1 : 0;
+}
+
+
+
+///
+/// \brief Varianza de Allan de un eje.
+/// \param level Nivel, con τ = 2^level·τ₀.
+/// \param axis Eje, entre 0 y 2.
+/// \return Varianza, en las unidades de la señal al cuadrado; NaN si el nivel no tiene diferencias.
+///
+double AllanVariance::variance(int level, int axis) const
+{
+    const uint64_t count = pairs(level);
+    if(!count) return std::numeric_limits<double>::quiet_NaN();
+    return m_levels[level].m_squares[axis] / (2.0 * count);
+}
+
+
+
+///
+/// \brief Desviación de Allan de un eje.
+/// \param level Nivel, con τ = 2^level·τ₀.
+/// \param axis Eje, entre 0 y 2.
+/// \return Desviación, en las unidades de la señal; NaN si el nivel no tiene diferencias.
+///
+double AllanVariance::deviation(int level, int axis) const
+{
+    return std::sqrt(variance(level, axis));
+}
+
+
+
+///
+/// \brief Constructor, sin muestras.
+///
+GyroCalibrator::GyroCalibrator()
+{
+    reset();
+}
+
+
+
+///
+/// \brief Descarta todas las muestras.
+///
+void GyroCalibrator::reset()
+{
+    m_allan.reset();
+    m_count = 0;
+    for(int i=0 ; i<3 ; ++i) {
+        m_mean[i] = 0.0;
+        m_squares[i] = 0.0;
+    }
+    m_first_time = 0;
+    m_last_time = 0;
+}
+
+
+
+///
+/// \brief Añade una medida del giróscopo.
+/// \param rate Velocidad angular, radianes/s.
+/// \param timestamp Instante de llegada, en ns.
+///
+void GyroCalibrator::add(const QVector3D& rate, qint64 timestamp)
+{
+    const double value[3] = { rate.x(), rate.y(), rate.z() };
+    m_allan.add(value);
+
+    if(!m_count) m_first_time = timestamp;
+    m_last_time = timestamp;
+    ++m_count;
+    for(int i=0 ; i<3 ; ++i) {
+        const double delta = value[i] - m_mean[i];
+        m_mean[i] += delta / m_count;
+        m_squares[i] += delta * (value[i] - m_mean[i]);
+    }
+}
+
+
+
+///
+/// \brief Número de medidas añadidas.
+///
+uint64_t GyroCalibrator::count() const
+{
+    return m_count;
+}
+
+
+
+///
+/// \brief Tiempo entre la primera y la última medida, en segundos.
+///
+double GyroCalibrator::duration() const
+{
+    return (m_last_time - m_first_time) / 1e9;
+}
+
+
+
+///
+/// \brief Periodo medio de muestreo, en segundos; 0 con menos de dos medidas.
+///
+double GyroCalibrator::samplePeriod() const
+{
+    return (m_count > 1) ? duration() / (m_count - 1) : 0.0;
+}
+
+
+
+///
+/// \brief Número de octavas con al menos MinPairs diferencias, las que se usan para los parámetros de ruido.
+///
+int GyroCalibrator::validLevels() const
+{
+    int levels = 0;
+    while((levels < m_allan.levels()) && (m_allan.pairs(levels) >= uint64_t(MinPairs))) ++levels;
+    return levels;
+}
+
+
+
+///
+/// \brief Tiempo de integración de una octava.
+/// \param level Octava.
+/// \return τ = 2^level·τ₀, en segundos.
+///
+double GyroCalibrator::tau(int level) const
+{
+    return std::ldexp(samplePeriod(), level);
+}
+
+
+
+///
+/// \brief Sesgo de cada eje: la media de las medidas, radianes/s.
+///
+QVector3D GyroCalibrator::bias() const
+{
+    return QVector3D(m_mean[0], m_mean[1], m_mean[2]);
+}
+
+
+
+///
+/// \brief Desviación típica de las medidas de cada eje, radianes/s.
+///
+QVector3D GyroCalibrator::deviation() const
+{
+    if(m_count < 2) return QVector3D();
+    return QVector3D(std::sqrt(m_squares[0] / (m_count - 1)),
+                     std::sqrt(m_squares[1] / (m_count - 1)),
+                     std::sqrt(m_squares[2] / (m_count - 1)));
+}
+
+
+
+///
+/// \brief Densidad de ruido de cada eje (angle random walk), radianes/s/√Hz.
+///
+/// Interpola la curva de Allan en τ = 1 s, en escala logarítmica, entre las dos octavas válidas que lo
+/// rodean; fuera de ellas extrapola desde la más cercana con la pendiente del ruido blanco.
+/// \return Densidad de ruido; cero si no hay ninguna octava válida.
+///
+QVector3D GyroCalibrator::noiseDensity() const
+{
+    const int levels = validLevels();
+    if(!levels || (samplePeriod() <= 0.0)) return QVector3D();
+
+    float density[3];
+    for(int axis=0 ; axis<3 ; ++axis) {
+        // Primera octava con τ ≥ 1 s
+        int upper = 0;
+        while((upper < levels) && (tau(upper) < 1.0)) ++upper;
+        if((upper == 0) || (upper == levels)) {
+            const int level = upper ? levels - 1 : 0;
+            density[axis] = float(m_allan.deviation(level, axis) * std::sqrt(tau(level)));
+            continue;
+        }
+        const double t0 = std::log(tau(upper - 1)), t1 = std::log(tau(upper));
+        const double s0 = std::log(m_allan.deviation(upper - 1, axis)), s1 = std::log(m_allan.deviation(upper, axis));
+        density[axis] = float(std::exp(s0 + (s1 - s0) * (0.0 - t0) / (t1 - t0)));
+    }
+    return QVector3D(density[0], density[1], density[2]);
+}
+
+
+
+///
+/// \brief Inestabilidad del sesgo de cada eje: el mínimo de la curva de Allan entre 0,664, radianes/s.
+///
+/// Si el mínimo está en la última octava válida, la captura es demasiado corta y el valor es sólo una
+/// cota superior.
+/// \return Inestabilidad del sesgo; cero si no hay ninguna octava válida.
+///
+QVector3D GyroCalibrator::biasInstability() const
+{
+    const int levels = validLevels();
+    if(!levels) return QVector3D();
+
+    float instability[3];
+    for(int axis=0 ; axis<3 ; ++axis) {
+        double minimum = m_allan.deviation(0, axis);
+        for(int level=1 ; level<levels ; ++level) {
+            minimum = std::min(minimum, m_allan.deviation(level, axis));
+        }
+        instability[axis] = float(minimum / 0.664);
+    }
+    return QVector3D(instability[0], instability[1], instability[2]);
+}
+
+
+
+///
+/// \brief Calibración del giróscopo que resta el sesgo, con el formato de las del acelerómetro y el magnetómetro.
+/// \return Matriz [I | -sesgo].
+///
+QMatrix4x4 GyroCalibrator::correction() const
+{
+    const QVector3D b = bias();
+    QMatrix4x4 correction;
+    for(int i=0 ; i<3 ; ++i) correction(i, 3) = -b[i];
+    return correction;
+}
+
+
+
+///
+/// \brief Curva de Allan acumulada.
+///
+const AllanVariance& GyroCalibrator::allan() const
+{
+    return m_allan;
+}
+
+
+
+///
+/// \brief Escribe los parámetros de ruido y la curva de Allan en formato de texto, separado por tabuladores.
+/// \param stream Flujo de salida.
+/// \param title Título de la curva.
+///
+void GyroCalibrator::write(QTextStream& stream, const QString& title) const
+{
+    const QVector3D b = bias(), n = noiseDensity(), k = biasInstability();
+    stream << "# " << title << "\n";
+    stream << "# count " << m_count << ", " << duration() << " s, period " << samplePeriod() * 1e3 << " ms\n";
+    stream << "# bias_rad_s " << b.x() << " " << b.y() << " " << b.z() << "\n";
+    stream << "# noise_density_rad_s_sqrt_hz " << n.x() << " " << n.y() << " " << n.z() << "\n";
+    stream << "# bias_instability_rad_s " << k.x() << " " << k.y() << " " << k.z() << "\n";
+    stream << "tau_s\tpairs\tadev_x\tadev_y\tadev_z\n";
+    for(int level=0 ; level<m_allan.levels() ; ++level) {
+        stream << tau(level) << "\t" << m_allan.pairs(level);
+        for(int axis=0 ; axis<3 ; ++axis) stream << "\t" << m_allan.deviation(level, axis);
+        stream << "\n";
+    }
+    stream << "\n";
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <QMatrix4x4>
+#include <QString>
+#include <QTextStream>
+#include <QVector3D>
+
+#include <cstdint>
+
+
+
+///
+/// \brief Varianza de Allan por octavas de una señal de tres ejes, calculada según llegan las muestras.
+///
+/// El nivel k recibe medias de 2^k muestras consecutivas: con cada una suma el cuadrado de su diferencia
+/// con la anterior, que es la varianza de Allan sin solapamiento para τ = 2^k·τ₀, y cada dos pasa su
+/// media al nivel siguiente. Cada nivel sólo guarda la media anterior y la que espera pareja, así que la
+/// memoria no depende de la duración de la captura y cada muestra cuesta, en promedio, dos niveles.
+///
+class AllanVariance
+{
+public:
+    static const int Levels = 40;
+
+    AllanVariance();
+    void reset();
+    void add(const double value[3]);
+    uint64_t count() const;
+    int levels() const;
+    uint64_t pairs(int level) const;
+    double variance(int level, int axis) const;
+    double deviation(int level, int axis) const;
+
+private:
+    ///
+    /// \brief Estado de una octava.
+    ///
+    struct Level
+    {
+        double m_previous[3];
+        double m_pending[3];
+        double m_squares[3];
+        uint64_t m_values;
+    };
+
+    Level m_levels[Levels];
+    uint64_t m_count;
+};
+
+
+
+///
+/// \brief Caracterización del giróscopo con el IMU quieto: sesgo, ruido y curva de Allan.
+///
+/// El sesgo es la media de la captura y la desviación típica se acumula con el método de Welford. La
+/// densidad de ruido (ARW) y la inestabilidad del sesgo se leen de la curva de Allan: la primera es
+/// σ(τ)·√τ en τ = 1 s, como en IEEE 952, y la segunda el mínimo de la curva entre 0,664. Sólo se usan
+/// las octavas con al menos MinPairs diferencias; si la captura es más corta, la densidad de ruido se
+/// extrapola desde la última octava válida con la pendiente -½ del ruido blanco. El periodo de muestreo
+/// sale de las marcas de tiempo de la primera y la última muestra.
+///
+class GyroCalibrator
+{
+public:
+    static const int MinSamples = 100;
+    static const int MinPairs = 8;
+
+    GyroCalibrator();
+    void reset();
+    void add(const QVector3D& rate, qint64 timestamp);
+    uint64_t count() const;
+    double duration() const;
+    double samplePeriod() const;
+    int validLevels() const;
+    double tau(int level) const;
+    QVector3D bias() const;
+    QVector3D deviation() const;
+    QVector3D noiseDensity() const;
+    QVector3D biasInstability() const;
+    QMatrix4x4 correction() const;
+    const AllanVariance& allan() const;
+    void write(QTextStream& stream, const QString& title) const;
+
+private:
+    AllanVariance m_allan;
+    uint64_t m_count;
+    double m_mean[3];
+    double m_squares[3];
+    qint64 m_first_time, m_last_time;
+};
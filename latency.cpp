@@ -0,0 +1,186 @@
+#include "latency.h"
+
+#include <algorithm>
+#include <chrono>
+
+
+
+///
+/// \brief Instante actual del reloj monótono.
+/// \return Nanosegundos desde un origen arbitrario.
+///
+qint64 SteadyClock()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+
+///
+/// \brief Constructor.
+///
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+
+
+///
+/// \brief Registra un valor.
+/// \param value Latencia en nanosegundos; los valores negativos se cuentan como 0.
+///
+void LatencyHistogram::record(qint64 value)
+{
+    if (value < 0) value = 0;
+    m_counts[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    m_total.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(uint64_t(value), std::memory_order_relaxed);
+
+    qint64 max = m_max.load(std::memory_order_relaxed);
+    while ((value > max) && !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {}
+}
+
+
+
+///
+/// \brief Vacía el histograma.
+///
+void LatencyHistogram::reset()
+{
+    for (auto& count : m_counts) count.store(0, std::memory_order_relaxed);
+    m_total.store(0, std::memory_order_relaxed);
+    m_sum.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+
+
+///
+/// \brief Suma los valores de otro histograma a éste.
+/// \param other Histograma a sumar; puede estar registrando valores a la vez.
+///
+void LatencyHistogram::merge(const LatencyHistogram& other)
+{
+    for (int i = 0; i < Buckets; ++i) {
+        const uint64_t count = other.m_counts[i].load(std::memory_order_relaxed);
+        if (count) m_counts[i].fetch_add(count, std::memory_order_relaxed);
+    }
+    m_total.fetch_add(other.m_total.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    m_sum.fetch_add(other.m_sum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+    const qint64 value = other.m_max.load(std::memory_order_relaxed);
+    qint64 max = m_max.load(std::memory_order_relaxed);
+    while ((value > max) && !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {}
+}
+
+
+
+///
+/// \brief Número de valores registrados.
+///
+uint64_t LatencyHistogram::count() const
+{
+    return m_total.load(std::memory_order_relaxed);
+}
+
+
+
+///
+/// \brief Media de los valores registrados, en nanosegundos.
+///
+double LatencyHistogram::mean() const
+{
+    const uint64_t total = count();
+    return total ? double(m_sum.load(std::memory_order_relaxed)) / total : 0.0;
+}
+
+
+
+///
+/// \brief Mayor valor registrado, en nanosegundos.
+///
+qint64 LatencyHistogram::max() const
+{
+    return m_max.load(std::memory_order_relaxed);
+}
+
+
+
+///
+/// \brief Calcula un percentil.
+/// \param percent Percentil, entre 0 y 100.
+/// \return Límite superior del intervalo que contiene el percentil, en nanosegundos.
+///
+qint64 LatencyHistogram::percentile(double percent) const
+{
+    uint64_t counts[Buckets];
+    uint64_t total = 0;
+    for (int i = 0; i < Buckets; ++i) {
+        counts[i] = m_counts[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    if (!total) return 0;
+
+    const uint64_t target = std::max<uint64_t>(1, uint64_t(percent / 100.0 * total + 0.5));
+    uint64_t accumulated = 0;
+    for (int i = 0; i < Buckets; ++i) {
+        accumulated += counts[i];
+        if (accumulated >= target) return std::min(bucketLimit(i), max());
+    }
+    return max();
+}
+
+
+
+///
+/// \brief Escribe la distribución de percentiles en formato de texto.
+/// \param stream Flujo de salida.
+/// \param title Nombre de la etapa medida.
+///
+void LatencyHistogram::write(QTextStream& stream, const QString& title) const
+{
+    static const double PERCENTILES[] = { 0.0, 10.0, 25.0, 50.0, 75.0, 90.0, 95.0, 99.0, 99.9, 99.99, 100.0 };
+
+    stream << "# " << title << "\n";
+    stream << "# count " << count() << ", mean " << mean() / 1e3 << " us, max " << max() / 1e3 << " us\n";
+    stream << "percentile\tlatency_us\n";
+    for (double percent : PERCENTILES) {
+        stream << percent << "\t" << percentile(percent) / 1e3 << "\n";
+    }
+    stream << "\n";
+}
+
+
+
+///
+/// \brief Índice del intervalo que contiene un valor.
+/// \param value Valor no negativo.
+/// \return Índice, entre 0 y Buckets-1.
+///
+int LatencyHistogram::bucketIndex(qint64 value)
+{
+    if (value < SubBuckets) return int(value);
+
+    value = std::min<qint64>(value, (qint64(1) << MaxBits) - 1);
+    int msb = MaxBits - 1;
+    while (!(value >> msb)) --msb;
+    const int shift = msb - (SubBits - 1);
+    return shift * (SubBuckets / 2) + int(value >> shift);
+}
+
+
+
+///
+/// \brief Mayor valor que cae en un intervalo.
+/// \param index Índice del intervalo.
+/// \return Límite superior del intervalo.
+///
+qint64 LatencyHistogram::bucketLimit(int index)
+{
+    if (index < SubBuckets) return index;
+
+    const int shift = index / (SubBuckets / 2) - 1;
+    const qint64 mantissa = index - shift * (SubBuckets / 2);
+    return ((mantissa + 1) << shift) - 1;
+}
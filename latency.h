@@ -0,0 +1,48 @@
+#pragma once
+
+#include <QString>
+#include <QTextStream>
+
+#include <atomic>
+#include <cstdint>
+
+
+
+qint64 SteadyClock();
+
+
+
+///
+/// \brief Histograma de latencias log-lineal, al estilo de HdrHistogram, sin bloqueos.
+///
+/// Cada potencia de dos se divide en SubBuckets/2 intervalos iguales, así que el error relativo de
+/// cualquier valor registrado es menor del 1,6% entre 1 ns y algo más de una hora. record() sólo hace un
+/// incremento atómico relajado, por lo que pueden registrar varios hilos a la vez mientras otro lee.
+///
+class LatencyHistogram
+{
+public:
+    static const int SubBits = 7;
+    static const int SubBuckets = 1 << SubBits;
+    static const int MaxBits = 42;
+    static const int Buckets = (MaxBits - SubBits + 2) * (SubBuckets / 2);
+
+    LatencyHistogram();
+    void record(qint64 value);
+    void reset();
+    void merge(const LatencyHistogram& other);
+    uint64_t count() const;
+    double mean() const;
+    qint64 max() const;
+    qint64 percentile(double percent) const;
+    void write(QTextStream& stream, const QString& title) const;
+
+private:
+    std::atomic<uint64_t> m_counts[Buckets];
+    std::atomic<uint64_t> m_total;
+    std::atomic<uint64_t> m_sum;
+    std::atomic<qint64> m_max;
+
+    static int bucketIndex(qint64 value);
+    static qint64 bucketLimit(int index);
+};
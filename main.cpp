@@ -1,10 +1,613 @@
-#include "mainwindow.h"
-#include <QApplication>
-
-int main(int argc, char *argv[])
-{
-    QApplication a(argc, argv);
-    MainWindow w;
-    w.showMaximized();
-    return a.exec();
-}
+#include "mainwindow.h"
+#include "batchfit.h"
+#include "batchfusion.h"
+#include "gyrocalibrator.h"
+#include "renderer.h"
+#include "Render/moments.h"
+#include "Render/renderobject.h"
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QSurfaceFormat>
+#include <QtConcurrent>
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+
+
+
+///
+/// \brief Recalcula las calibraciones de un lote de grabaciones y las escribe en la salida estándar.
+///
+/// Cada línea tiene la ruta, el número de muestras y las dos calibraciones en el formato de los comandos
+/// "write acc" y "write mag", o la ruta y el error.
+/// \param files Grabaciones.
+/// \param model Modelo de elipsoide.
+/// \param threads Número de hilos, o 0 para usar todos los núcleos.
+/// \return Código de salida: 0 si todas las sesiones se han podido calibrar.
+///
+static int Refit(const QStringList& files, EllipsoidModel model, int threads)
+{
+    BatchFitter fitter((threads > 0) ? threads : QThread::idealThreadCount());
+    fitter.setModel(model);
+
+    QElapsedTimer timer;
+    timer.start();
+    const std::vector<FitResult> results = fitter.fitRecordings(files);
+    const double elapsed = timer.nsecsElapsed() / 1e6;
+
+    quint64 samples = 0;
+    int failed = 0;
+    for( const auto& result : results ) {
+        printf("%s", qPrintable(result.m_name));
+        if(!result.m_valid) {
+            printf(" error %s\n", qPrintable(result.m_error));
+            ++failed;
+            continue;
+        }
+        printf(" %llu acc", static_cast<unsigned long long>(result.m_samples));
+        for(int i=0 ; i<12 ; ++i) printf(" %f", result.m_acc(i / 4, i % 4));
+        printf(" mag");
+        for(int i=0 ; i<12 ; ++i) printf(" %f", result.m_mag(i / 4, i % 4));
+        printf("\n");
+        samples += result.m_samples;
+    }
+    fprintf(stderr, "%d sessions, %llu samples in %.1f ms with %d threads\n",
+            int(results.size()), static_cast<unsigned long long>(samples), elapsed, fitter.threads());
+    return failed ? 1 : 0;
+}
+
+
+
+///
+/// \brief Calcula el sesgo, el ruido y la curva de Allan del giróscopo de un lote de grabaciones.
+///
+/// Cada grabación se lee en un hilo del pool, sin guardar sus muestras: sólo se acumulan la media y las
+/// octavas de la varianza de Allan, así que una captura de horas no ocupa más memoria que una corta.
+/// Los resultados se escriben en la salida estándar, en el mismo formato que "Save Allan".
+/// \param files Grabaciones, tomadas con el IMU quieto.
+/// \param threads Número de hilos, o 0 para usar todos los núcleos.
+/// \return Código de salida: 0 si se han podido leer todas las grabaciones.
+///
+static int Allan(const QStringList& files, int threads)
+{
+    QThreadPool pool;
+    pool.setMaxThreadCount((threads > 0) ? threads : QThread::idealThreadCount());
+
+    QElapsedTimer timer;
+    timer.start();
+    std::vector<GyroCalibrator> results(files.size());
+    std::vector<QString> errors(files.size());
+    std::vector<QFuture<void>> jobs;
+    for(int i=0 ; i<files.size() ; ++i) {
+        jobs.push_back(QtConcurrent::run(&pool, [&files, &results, &errors, i]() {
+            GyroCalibrator& gyro = results[i];
+            ReadRecording(files[i], [&gyro](TelemetrySample& sample, qint64 time) {
+                const float* v = sample.m_values;
+                if(sample.m_type == SampleRawSensors) gyro.add(QVector3D(v[0], v[1], v[2]), time * 1000);
+            }, &errors[i]);
+        }));
+    }
+    for(auto& job : jobs) {
+        job.waitForFinished();
+    }
+    const double elapsed = timer.nsecsElapsed() / 1e6;
+
+    quint64 samples = 0;
+    int failed = 0;
+    QTextStream stream(stdout);
+    for(int i=0 ; i<files.size() ; ++i) {
+        if(!errors[i].isEmpty()) {
+            stream << "# " << files[i] << " error " << errors[i] << "\n\n";
+            ++failed;
+            continue;
+        }
+        results[i].write(stream, files[i]);
+        samples += results[i].count();
+    }
+    stream.flush();
+    fprintf(stderr, "%d recordings, %llu samples in %.1f ms with %d threads\n",
+            files.size(), static_cast<unsigned long long>(samples), elapsed, pool.maxThreadCount());
+    return failed ? 1 : 0;
+}
+
+
+
+///
+/// \brief Fusiona en el PC un lote de grabaciones y las compara con la orientación del firmware.
+///
+/// Cada línea tiene la ruta, el número de muestras, el periodo, la orientación final y, si la grabación
+/// trae también "wxyz", el error medio y máximo frente a ella; o la ruta y el error.
+/// \param files Grabaciones.
+/// \param filter Filtro de la fusión.
+/// \param model Modelo de elipsoide con el que se calibra cada grabación.
+/// \param threads Número de hilos, o 0 para usar todos los núcleos.
+/// \return Código de salida: 0 si se han podido fusionar todas las grabaciones.
+///
+static int Fuse(const QStringList& files, FusionFilter filter, EllipsoidModel model, int threads)
+{
+    FusionBatch batch((threads > 0) ? threads : QThread::idealThreadCount());
+    batch.setFilter(filter);
+    batch.setModel(model);
+
+    QElapsedTimer timer;
+    timer.start();
+    const std::vector<FusionResult> results = batch.fuseRecordings(files);
+    const double elapsed = timer.nsecsElapsed() / 1e6;
+
+    quint64 samples = 0;
+    double recorded = 0.0;
+    int failed = 0;
+    for( const auto& result : results ) {
+        printf("%s", qPrintable(result.m_name));
+        if(!result.m_valid) {
+            printf(" error %s\n", qPrintable(result.m_error));
+            ++failed;
+            continue;
+        }
+        const QQuaternion& q = result.m_orientation;
+        printf(" %llu samples %.3f ms wxyz %f %f %f %f", static_cast<unsigned long long>(result.m_samples),
+               result.m_period * 1e3, q.scalar(), q.x(), q.y(), q.z());
+        if(result.m_compared) {
+            printf(" device %llu mean %.3f max %.3f deg", static_cast<unsigned long long>(result.m_compared),
+                   result.m_mean_error, result.m_max_error);
+        }
+        printf("\n");
+        samples += result.m_samples;
+        recorded += result.m_samples * result.m_period;
+    }
+    fprintf(stderr, "%d recordings, %llu samples (%.0f s recorded) in %.1f ms with %d threads, %.0fx real time\n",
+            int(results.size()), static_cast<unsigned long long>(samples), recorded, elapsed, batch.threads(),
+            (elapsed > 0.0) ? recorded * 1e3 / elapsed : 0.0);
+    return failed ? 1 : 0;
+}
+
+
+
+///
+/// \brief Interpreta una línea como lo hacía ParseLine(), con QString, QStringList y QList<float>, para
+/// comparar con ParseTelemetry().
+/// \param bytes Línea tal y como la devuelve QIODevice::readLine().
+/// \param sum Suma de control de los valores, para que el compilador no se salte el trabajo.
+/// \return Verdadero si la línea es una muestra conocida con el número correcto de valores.
+///
+static bool ParseLegacy(const QByteArray& bytes, double& sum)
+{
+    const QString line = QString::fromUtf8(bytes);
+    if(line.isEmpty() || (line[0] == '#')) return false;
+
+    const QStringList fields = line.trimmed().split(' ');
+    const QString header = fields[0].toLower();
+    QList<float> values;
+    for(int i=1 ; i<fields.size() ; ++i) {
+        bool ok;
+        const float value = fields[i].toFloat(&ok);
+        values.append(ok ? value : NAN);
+    }
+
+    const bool valid = ((header == "wxyz") && (values.size() == 4)) ||
+                       ((header == "force") && (values.size() == 4)) ||
+                       ((header == "raw_adc") && (values.size() == 6)) ||
+                       ((header == "raw_gam") && (values.size() == 9));
+    if(valid) sum += values[0];
+    return valid;
+}
+
+
+
+///
+/// \brief Mide cuántas líneas de texto por segundo interpreta ParseTelemetry() frente al ParseLine() anterior.
+///
+/// Las líneas son como las del firmware, nueve de cada diez "raw_gam" y el resto "wxyz", ya leídas del
+/// puerto. Se mide en un solo hilo, como en SerialThread, y las dos versiones tienen que aceptar las mismas.
+/// \param lines Líneas que se interpretan con cada versión.
+/// \return Código de salida: 0 si las dos versiones aceptan las mismas líneas.
+///
+static int BenchParse(int lines)
+{
+    std::mt19937 random(1);
+    std::normal_distribution<float> normal;
+    std::vector<QByteArray> input;
+    for(int i=0 ; i<1000 ; ++i) {
+        QByteArray line = (i % 10) ? "raw_gam" : "wxyz";
+        for(int j=0 ; j<((i % 10) ? 9 : 4) ; ++j) {
+            line += ' ';
+            line += QByteArray::number(normal(random), 'f', 4);
+        }
+        input.push_back(line + "\r\n");
+    }
+
+    const int count = std::max(lines, int(input.size()));
+    printf("%-10s %10s\n", "parser", "Mlines/s");
+    quint64 accepted[2] = { 0, 0 };
+    for(int version=0 ; version<2 ; ++version) {
+        double sum = 0.0;
+        QElapsedTimer timer;
+        timer.start();
+        for(int i=0 ; i<count ; ++i) {
+            const QByteArray& line = input[i % input.size()];
+            if(version == 0) {
+                accepted[version] += ParseLegacy(line, sum);
+            }
+            else {
+                TelemetrySample sample;
+                if(ParseTelemetry(line.constData(), line.size(), sample)) {
+                    ++accepted[version];
+                    sum += sample.m_values[0];
+                }
+            }
+        }
+        const double elapsed = timer.nsecsElapsed() / 1e9;
+        printf("%-10s %10.2f\n", version ? "in-place" : "legacy", (elapsed > 0.0) ? count / elapsed / 1e6 : 0.0);
+        fprintf(stderr, "%s: %llu accepted, checksum %g\n", version ? "in-place" : "legacy",
+                static_cast<unsigned long long>(accepted[version]), sum);
+    }
+    return (accepted[0] == accepted[1]) ? 0 : 1;
+}
+
+
+
+///
+/// \brief Compara la precisión y la velocidad de los ajustes alineado y orientado con elipsoides sintéticas.
+///
+/// Cada prueba deforma puntos de la esfera unidad con una matriz simétrica (diagonal entre 0.8 y 1.2,
+/// términos cruzados de hasta ±0.15 si se piden) y un centro de hasta ±0.3, y les suma ruido gaussiano.
+/// La calibración exacta es la inversa de esa deformación. De cada modelo se da el mayor error de un
+/// elemento de la matriz frente a la exacta y el error cuadrático medio de |Wx| - 1; después, el coste
+/// de acumular una muestra y el de resolver cada modelo.
+/// \param trials Pruebas de cada combinación de ruido y términos cruzados.
+/// \param points Puntos de cada elipsoide.
+/// \return Código de salida.
+///
+static int BenchFit(int trials, int points)
+{
+    std::mt19937 random(1);
+    std::normal_distribution<float> normal;
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    const size_t count = size_t(std::max(points, 10));
+    std::vector<float> x(count), y(count), z(count);
+
+    printf("%-6s %-6s %10s %8s %10s %8s\n", "noise", "cross", "aligned", "rms", "oriented", "rms");
+    const float noises[] = { 0.0f, 0.005f, 0.02f };
+    for(float noise : noises) {
+        for(int cross=0 ; cross<2 ; ++cross) {
+            double worst[2] = { 0.0, 0.0 }, squares[2] = { 0.0, 0.0 };
+            for(int trial=0 ; trial<trials ; ++trial) {
+                const QVector3D r = QVector3D(1.0f, 1.0f, 1.0f) +
+                        0.2f * QVector3D(uniform(random), uniform(random), uniform(random));
+                const QVector3D c = cross ? 0.15f * QVector3D(uniform(random), uniform(random), uniform(random))
+                                          : QVector3D();
+                const QVector3D o = 0.3f * QVector3D(uniform(random), uniform(random), uniform(random));
+                const QMatrix4x4 distortion(r.x(), c.x(), c.y(), o.x(),
+                                            c.x(), r.y(), c.z(), o.y(),
+                                            c.y(), c.z(), r.z(), o.z(),
+                                            0.0f, 0.0f, 0.0f, 1.0f);
+                const QMatrix4x4 truth = distortion.inverted();
+
+                EllipsoidAccumulator accumulator;
+                for(size_t i=0 ; i<count ; ++i) {
+                    const QVector3D u = QVector3D(normal(random), normal(random), normal(random)).normalized();
+                    const QVector3D n(normal(random), normal(random), normal(random));
+                    const QVector3D p = distortion.map(u) + noise * n;
+                    x[i] = p.x();
+                    y[i] = p.y();
+                    z[i] = p.z();
+                }
+                accumulator.add(x.data(), y.data(), z.data(), count);
+
+                for(int model=0 ; model<2 ; ++model) {
+                    const QMatrix4x4 fit = accumulator.solve(model ? EllipsoidOriented : EllipsoidAligned);
+                    for(int i=0 ; i<12 ; ++i) {
+                        const double error = std::abs(fit(i / 4, i % 4) - truth(i / 4, i % 4));
+                        worst[model] = std::max(worst[model], error);
+                    }
+                    for(size_t i=0 ; i<count ; ++i) {
+                        const double e = fit.map(QVector3D(x[i], y[i], z[i])).length() - 1.0;
+                        squares[model] += e * e;
+                    }
+                }
+            }
+            const double samples = double(count) * std::max(trials, 1);
+            printf("%-6.3f %-6s %10.5f %8.4f %10.5f %8.4f\n", noise, cross ? "yes" : "no",
+                   worst[0], std::sqrt(squares[0] / samples), worst[1], std::sqrt(squares[1] / samples));
+        }
+    }
+
+    // Velocidad con la última nube: acumular es igual para los dos modelos, resolver no depende de los puntos
+    const int repeats = 20, solves = 1000;
+    EllipsoidAccumulator accumulator;
+    QElapsedTimer timer;
+    timer.start();
+    for(int i=0 ; i<repeats ; ++i) {
+        accumulator.add(x.data(), y.data(), z.data(), count);
+    }
+    const double add = double(timer.nsecsElapsed()) / (double(count) * repeats);
+    double solve[2];
+    for(int model=0 ; model<2 ; ++model) {
+        timer.start();
+        for(int i=0 ; i<solves ; ++i) {
+            accumulator.solve(model ? EllipsoidOriented : EllipsoidAligned);
+        }
+        solve[model] = timer.nsecsElapsed() / 1e3 / solves;
+    }
+    printf("add %.2f ns/sample, aligned solve %.2f us, oriented solve %.2f us\n", add, solve[0], solve[1]);
+    fprintf(stderr, "%d trials of %llu points per row\n", trials, static_cast<unsigned long long>(count));
+    return 0;
+}
+
+
+
+///
+/// \brief Mide cuántas muestras por segundo acumula cada implementación del cálculo de momentos.
+///
+/// Cada hilo suma los momentos de sus propias muestras, de una elipsoide con ruido, y se toma la mejor de
+/// cinco pasadas. La velocidad se da por núcleo, junto con el error relativo frente a una suma en long
+/// double. Las implementaciones que no admite el procesador se omiten.
+/// \param samples Muestras de cada hilo.
+/// \param threads Número de hilos, o 0 para usar todos los núcleos.
+/// \return Código de salida.
+///
+static int BenchMoments(int samples, int threads)
+{
+    threads = (threads > 0) ? threads : QThread::idealThreadCount();
+    const size_t count = size_t(std::max(samples, 1));
+    std::vector<float> x(count), y(count), z(count);
+    std::mt19937 random(1);
+    std::normal_distribution<float> normal;
+    for(size_t i=0 ; i<count ; ++i) {
+        const QVector3D v = QVector3D(normal(random), normal(random), normal(random)).normalized();
+        x[i] = 1.02f * v.x() + 0.02f + 0.01f * normal(random);
+        y[i] = 0.98f * v.y() - 0.01f + 0.01f * normal(random);
+        z[i] = 1.00f * v.z() + 0.03f + 0.01f * normal(random);
+    }
+
+    // Referencia: los mismos monomios sumados en long double
+    long double reference[EllipsoidMoments] = {};
+    for(size_t i=0 ; i<count ; ++i) {
+        for(int degree=1 ; degree<=4 ; ++degree) {
+            for(int a=degree ; a>=0 ; --a) {
+                for(int b=degree-a ; b>=0 ; --b) {
+                    const int c = degree - a - b;
+                    reference[MomentIndex(a, b, c)] += std::pow((long double)x[i], a) *
+                            std::pow((long double)y[i], b) * std::pow((long double)z[i], c);
+                }
+            }
+        }
+    }
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+    printf("%-8s %14s %12s\n", "kernel", "Msamples/s/core", "rel. error");
+    for(int k=MomentsScalar ; k<=SupportedMomentsKernel() ; ++k) {
+        const MomentsKernel kernel = MomentsKernel(k);
+        double moments[EllipsoidMoments] = {};
+        AccumulateMoments(x.data(), y.data(), z.data(), count, moments, kernel);
+        double error = 0.0;
+        for(int i=0 ; i<EllipsoidMoments ; ++i) {
+            const long double scale = std::max(std::abs(reference[i]), (long double)1.0);
+            error = std::max(error, double(std::abs(moments[i] - reference[i]) / scale));
+        }
+
+        double best = 0.0;
+        for(int pass=0 ; pass<5 ; ++pass) {
+            QElapsedTimer timer;
+            timer.start();
+            std::vector<QFuture<void>> jobs;
+            for(int t=0 ; t<threads ; ++t) {
+                jobs.push_back(QtConcurrent::run(&pool, [&x, &y, &z, count, kernel]() {
+                    double sums[EllipsoidMoments] = {};
+                    AccumulateMoments(x.data(), y.data(), z.data(), count, sums, kernel);
+                }));
+            }
+            for(auto& job : jobs) {
+                job.waitForFinished();
+            }
+            const double elapsed = timer.nsecsElapsed() / 1e9;
+            if(elapsed > 0.0) best = std::max(best, count / elapsed / 1e6);
+        }
+        printf("%-8s %14.1f %12.2g\n", MomentsKernelName(kernel), best, error);
+    }
+    fprintf(stderr, "%llu samples per thread, %d threads\n", static_cast<unsigned long long>(count), threads);
+    return 0;
+}
+
+
+
+///
+/// \brief Mide el tiempo de CPU por fotograma de las vistas con cada forma de dibujarlas.
+///
+/// Dibuja en una ventana las vistas de la brújula, con la fusión en el PC, y las de la calibración, con
+/// nubes sintéticas y el ajuste provisional, guardando o no el estado de OpenGL de los objetos y con una
+/// llamada por objeto o una por vista. Las nubes se dibujan enteras, sin niveles de detalle.
+/// Todas las combinaciones usan el perfil core 3.3 y el bloque de cámaras: "lookup" sólo repite en cada
+/// dibujo la búsqueda de uniforms y atributos y la descripción de los vértices (ver
+/// RenderObject::setCachedState()). No es el dibujo anterior a los VAOs, que ya no existe en el código.
+/// \param frames Fotogramas que se miden de cada combinación.
+/// \param points Puntos de cada nube.
+/// \return Código de salida: 0 si se ha podido crear un contexto de OpenGL 3.3.
+///
+static int BenchRender(int frames, int points)
+{
+    Renderer renderer;
+    renderer.resize(1280, 800);
+    renderer.show();
+    QElapsedTimer timer;
+    timer.start();
+    while(!renderer.isValid() && (timer.elapsed() < 5000)) {
+        QCoreApplication::processEvents();
+    }
+    if(!renderer.isValid()) {
+        fprintf(stderr, "Couldn't create the OpenGL context\n");
+        return 1;
+    }
+    if(!renderer.ready()) {
+        fprintf(stderr, "%s\n", qPrintable(renderer.errorString()));
+        return 1;
+    }
+
+    // Elipsoides desplazadas y con ruido, como las medidas sin calibrar
+    std::vector<QVector3D> acc, mag;
+    std::mt19937 random(1);
+    std::normal_distribution<float> normal;
+    for(int i=0 ; i<points ; ++i) {
+        const QVector3D a = QVector3D(normal(random), normal(random), normal(random)).normalized();
+        const QVector3D m = QVector3D(normal(random), normal(random), normal(random)).normalized();
+        acc.push_back(a * QVector3D(1.02f, 0.98f, 1.0f) + QVector3D(0.02f, -0.01f, 0.03f) + 0.01f * a * normal(random));
+        mag.push_back(m * QVector3D(0.9f, 1.1f, 1.0f) + QVector3D(0.2f, -0.1f, 0.1f) + 0.01f * m * normal(random));
+    }
+    renderer.setClouds(acc, mag, false);
+    renderer.setFitPreview(QMatrix4x4(), QMatrix4x4());
+    renderer.setHostFusion(true);
+    renderer.setLevelOfDetail(false);
+
+    printf("# GL 3.3 core in every row; state: cached = stored uniform locations and VAOs, lookup = looked up per draw\n");
+    printf("%-12s %-8s %-10s %10s\n", "view", "state", "calls", "us/frame");
+    const IMUMode modes[] = { Compass, Calibration };
+    for(IMUMode mode : modes) {
+        for(int cached=0 ; cached<2 ; ++cached) {
+            for(int single=0 ; single<2 ; ++single) {
+                renderer.setMode(mode);
+                RenderObject::setCachedState(cached);
+                renderer.setSinglePass(single);
+                renderer.benchmark(std::max(frames / 10, 1));
+                const double time = renderer.benchmark(frames);
+                printf("%-12s %-8s %-10s %10.1f\n", (mode == Compass) ? "compass" : "calibration",
+                       cached ? "cached" : "lookup", single ? "per-object" : "per-view", time / 1e3);
+            }
+        }
+    }
+    RenderObject::setCachedState(true);
+    return 0;
+}
+
+
+
+///
+/// \brief Modo de la línea de comandos que termina sin abrir ventana, así que funciona sin pantalla.
+///
+struct HeadlessMode
+{
+    const char* m_option;
+    int (*m_run)(const QCommandLineParser& parser);
+};
+
+
+
+///
+/// \brief Modelo de elipsoide elegido con --fit.
+///
+static EllipsoidModel FitModelOption(const QCommandLineParser& parser)
+{
+    return (parser.value("fit") == "oriented") ? EllipsoidOriented : EllipsoidAligned;
+}
+
+
+
+///
+/// \brief Filtro de la fusión elegido con --filter.
+///
+static FusionFilter FusionFilterOption(const QCommandLineParser& parser)
+{
+    return (parser.value("filter") == "mahony") ? FusionMahony : FusionMadgwick;
+}
+
+
+
+///
+/// \brief Modos sin ventana, en el orden en que se atienden. La misma tabla decide antes de crear la
+/// aplicación si hace falta pantalla y después qué modo se ejecuta, para que no puedan separarse.
+///
+static const HeadlessMode HEADLESS_MODES[] = {
+    { "refit", [](const QCommandLineParser& parser) {
+        return Refit(parser.positionalArguments(), FitModelOption(parser), parser.value("threads").toInt());
+    } },
+    { "allan", [](const QCommandLineParser& parser) {
+        return Allan(parser.positionalArguments(), parser.value("threads").toInt());
+    } },
+    { "fuse", [](const QCommandLineParser& parser) {
+        return Fuse(parser.positionalArguments(), FusionFilterOption(parser), FitModelOption(parser),
+                    parser.value("threads").toInt());
+    } },
+    { "bench-parse", [](const QCommandLineParser& parser) {
+        return BenchParse(parser.value("bench-parse").toInt());
+    } },
+    { "bench-fit", [](const QCommandLineParser& parser) {
+        return BenchFit(parser.value("bench-fit").toInt(), parser.value("bench-points").toInt());
+    } },
+    { "bench-moments", [](const QCommandLineParser& parser) {
+        return BenchMoments(parser.value("bench-moments").toInt(), parser.value("threads").toInt());
+    } },
+};
+
+
+
+///
+/// \brief Busca en los argumentos un modo sin ventana, antes de que QCommandLineParser pueda leerlos.
+///
+/// Acepta las mismas formas que QCommandLineParser para una opción larga: "--opción" y "--opción=valor".
+/// \param argc Número de argumentos.
+/// \param argv Argumentos.
+/// \return Verdadero si se ha pedido alguno de HEADLESS_MODES.
+///
+static bool IsHeadless(int argc, char *argv[])
+{
+    for(int i=1 ; i<argc ; ++i) {
+        if(strncmp(argv[i], "--", 2) != 0) continue;
+        const char* arg = argv[i] + 2;
+        for( const HeadlessMode& mode : HEADLESS_MODES ) {
+            const size_t n = strlen(mode.m_option);
+            if((strncmp(arg, mode.m_option, n) == 0) && ((arg[n] == '\0') || (arg[n] == '='))) return true;
+        }
+    }
+    return false;
+}
+
+
+
+int main(int argc, char *argv[])
+{
+    // Para recalcular calibraciones no hace falta la interfaz gráfica, así que funciona sin pantalla
+    const bool batch = IsHeadless(argc, argv);
+
+    // Los objetos de Render usan el perfil core de OpenGL 3.3; el formato se fija antes de crear la aplicación
+    if(!batch) {
+        QSurfaceFormat format;
+        format.setVersion(3, 3);
+        format.setProfile(QSurfaceFormat::CoreProfile);
+        format.setDepthBufferSize(24);
+        format.setSwapInterval(1);
+        QSurfaceFormat::setDefaultFormat(format);
+    }
+    std::unique_ptr<QCoreApplication> a(batch ? new QCoreApplication(argc, argv) : new QApplication(argc, argv));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("IMU calibration");
+    parser.addHelpOption();
+    parser.addOption({ "fit", "Ellipsoid model of the calibration: aligned or oriented.", "model", "aligned" });
+    parser.addOption({ "refit", "Recompute the calibrations of the given recordings and exit." });
+    parser.addOption({ "allan", "Compute the gyroscope bias, noise and Allan deviation of the given recordings and exit." });
+    parser.addOption({ "fuse", "Fuse the raw sensors of the given recordings on the PC and exit." });
+    parser.addOption({ "filter", "Host fusion filter: madgwick or mahony.", "filter", "madgwick" });
+    parser.addOption({ "threads", "Worker threads for --refit, --allan, --fuse and --bench-moments, 0 for one per core.", "n", "0" });
+    parser.addOption({ "bench-parse", "Measure the telemetry lines per second of the old and the in-place parser and exit.", "lines" });
+    parser.addOption({ "bench-fit", "Compare the accuracy and speed of both ellipsoid models on synthetic ellipsoids and exit.", "trials" });
+    parser.addOption({ "bench-moments", "Measure the samples per second per core of each moments kernel and exit.", "samples" });
+    parser.addOption({ "bench-render", "Measure the CPU time per frame with cached or per-draw GL state, per object or per view, and exit.", "frames" });
+    parser.addOption({ "bench-points", "Points of each synthetic cloud for --bench-fit and --bench-render.", "n", "20000" });
+    parser.addPositionalArgument("recordings", "Recordings to process with --refit, --allan or --fuse.", "[recordings...]");
+    parser.process(*a);
+
+    for( const HeadlessMode& mode : HEADLESS_MODES ) {
+        if(parser.isSet(mode.m_option)) return mode.m_run(parser);
+    }
+    if(parser.isSet("bench-render")) return BenchRender(parser.value("bench-render").toInt(), parser.value("bench-points").toInt());
+
+    MainWindow w;
+    w.setFitModel(FitModelOption(parser));
+    w.setFusionFilter(FusionFilterOption(parser));
+    w.showMaximized();
+    return a->exec();
+}
@@ -1,276 +1,1091 @@
-#include "mainwindow.h"
-#include "ui_mainwindow.h"
-#include "renderer.h"
-
-
-
-///
-/// \brief Constructor.
-/// \param parent Objeto padre.
-///
-MainWindow::MainWindow(QWidget *parent) :
-    QMainWindow(parent),
-    ui(new Ui::MainWindow),
-    m_thread(nullptr)
-{
-    // Inicializa la interfaz gráfica
-    ui->setupUi(this);
-
-    // Inicializa la barra de menú
-    connect(ui->actionConnect, &QAction::triggered, this, &MainWindow::actionConnect);
-    connect(ui->actionDisconnect, &QAction::triggered, this, &MainWindow::actionDisconnect);
-    connect(ui->actionCompass, &QAction::triggered, this, &MainWindow::actionCompass);
-    connect(ui->actionCalibration, &QAction::triggered, this, &MainWindow::actionCalibration);
-    connect(ui->actionDone, &QAction::triggered, this, &MainWindow::actionDone);
-    connect(ui->actionCancel, &QAction::triggered, this, &MainWindow::actionCancel);
-
-    // Añade la lista de puertos series
-    ui->mainToolBar->insertWidget(ui->actionConnect, &m_serialPortList);
-    m_serialPortInfos = QSerialPortInfo::availablePorts();
-    for( const auto& info : m_serialPortInfos ) {
-        const QString name = info.portName() + " - " + info.description() + " - " + info.manufacturer();
-        m_serialPortList.addItem(name);
-    }
-
-    // Inicializa la barra de estado
-    ui->statusBar->addWidget(&m_status);
-    m_status.setFont(QFont("Courier", 10));
-    setMode(Disconnected);
-    m_timer.start(1000/60, this);
-}
-
-
-
-///
-/// \brief Destructor.
-///
-MainWindow::~MainWindow()
-{
-    delete m_thread;
-    delete ui;
-}
-
-
-
-///
-/// \brief Abre la conexión con el IMU.
-///
-void MainWindow::actionConnect()
-{
-    const int index = m_serialPortList.currentIndex();
-    if (index >= 0) {
-        m_thread = new SerialThread(m_serialPortInfos[index], this);
-        m_thread->start();
-        connect(m_thread, &SerialThread::readOrientation, this, &MainWindow::readOrientation);
-        connect(m_thread, &SerialThread::readForce, this, &MainWindow::readForce);
-        connect(m_thread, &SerialThread::readRawSensors, this, &MainWindow::readRawSensors);
-        connect(m_thread, &SerialThread::readRawAnalog, this, &MainWindow::readRawAnalog);
-        setMode(Compass);
-    }
-}
-
-
-
-///
-/// \brief Cierra la conexión con el IMU.
-///
-void MainWindow::actionDisconnect()
-{
-    setMode(Disconnected);
-}
-
-
-
-///
-/// \brief Modo brújula.
-///
-void MainWindow::actionCompass()
-{
-    setMode(Compass);
-}
-
-
-
-///
-/// \brief Inicia el proceso de calibración.
-///
-void MainWindow::actionCalibration()
-{
-    setMode(Calibration);
-    m_acc_measurements.clear();
-    m_acc_measurements.reserve(100000);
-    m_mag_measurements.clear();
-    m_mag_measurements.reserve(100000);
-}
-
-
-
-///
-/// \brief Termina la calibración.
-///
-void MainWindow::actionDone()
-{
-    // Detiene la captura de datos
-    setMode(Waiting);
-
-    // Calculamos los factores de corrección
-    auto accCalib = FitAlignedEllipsoid(m_acc_measurements);
-    auto magCalib = FitAlignedEllipsoid(m_mag_measurements);
-    m_thread->recalibrate(accCalib, magCalib);
-    m_acc_measurements.clear();
-    m_mag_measurements.clear();
-}
-
-
-
-///
-/// \brief Cancela la calibración.
-///
-void MainWindow::actionCancel()
-{
-    setMode(Compass);
-    m_acc_measurements.clear();
-    m_mag_measurements.clear();
-}
-
-
-
-///
-/// \brief Recibe la orientación calculada por el IMU.
-/// \param quat Orientación en referencia al sistema ENU.
-///
-void MainWindow::readOrientation(QQuaternion quat)
-{
-    if(m_mode == Compass) {
-        QMatrix4x4 m;
-        m.rotate(quat);
-        ui->openGLWidget->setOrientation(m);
-    }
-}
-
-
-
-///
-/// \brief Recibe la fuerza ejercida sobre la muñeca.
-/// \param force Flexión XY, compresión, torsión.
-///
-void MainWindow::readForce(QVector4D force)
-{
-    if(m_mode == Compass) {
-        QString msg;
-        msg.sprintf("Flexión: (%+f, %+f) | Compresión: %+f | Torsión: %+f", force.x(), force.y(), force.z(), force.w());
-        m_status.setText(msg);
-    }
-}
-
-
-
-///
-/// \brief Lectura de los sensores del IMU, sin procesar.
-/// \param gyr Giróscopo, radianes/s.
-/// \param acc Acelerómetro, x/g₀
-/// \param mag Magnetómetro, x/45µT
-///
-void MainWindow::readRawSensors(QVector3D gyr, QVector3D acc, QVector3D mag)
-{
-    if(m_mode == Calibration) {
-        m_acc_measurements.push_back(acc);
-        m_mag_measurements.push_back(mag);
-        ui->openGLWidget->setAccCloud(m_acc_measurements);
-        ui->openGLWidget->setMagCloud(m_mag_measurements);
-
-        /*QString msg;
-        msg.sprintf("Gyr: (%+f, %+f, %+f) | Acc: (%+f, %+f, %+f) | Mag: (%+f, %+f, %+f)",
-                gyr.x(), gyr.y(), gyr.z(),
-                acc.x(), acc.y(), acc.z(),
-                mag.x(), mag.y(), mag.z());
-        m_status.setText(msg);*/
-    }
-}
-
-
-
-///
-/// \brief Lectura de los valores del ADC, sin procesar.
-/// \param values Los 6 canales del ADC, en milivoltios.
-///
-void MainWindow::readRawAnalog(float values[6])
-{
-    if(m_mode == Calibration) {
-        QString msg;
-        msg.sprintf("ADC: (%+f, %+f, %+f, %+f, %+f, %+f)", values[0], values[1], values[2], values[3], values[4], values[5]);
-        m_status.setText(msg);
-    }
-}
-
-
-
-///
-/// \brief Cambia el modo de funcionamiento de la aplicación.
-/// \param mode Nuevo modo de funcionamiento.
-///
-void MainWindow::setMode(IMUMode mode)
-{
-    m_mode = mode;
-    switch(m_mode) {
-    case Disconnected:
-        ui->actionConnect->setEnabled(true);
-        ui->actionDisconnect->setEnabled(false);
-        ui->actionCalibration->setEnabled(false);
-        ui->actionDone->setEnabled(false);
-        ui->actionCancel->setEnabled(false);
-        m_status.setText("Disconnected");
-        ui->openGLWidget->setMode(Disconnected);
-        if(m_thread) {
-            m_thread->setMode(Disconnected);
-            delete m_thread;
-            m_thread = nullptr;
-        }
-        break;
-    case Waiting:
-        ui->actionConnect->setEnabled(false);
-        ui->actionDisconnect->setEnabled(true);
-        ui->actionCompass->setEnabled(true);
-        ui->actionCalibration->setEnabled(true);
-        ui->actionDone->setEnabled(false);
-        ui->actionCancel->setEnabled(false);
-
-        m_status.setText("Waiting");
-        ui->openGLWidget->setMode(Compass);
-        m_thread->setMode(Waiting);
-        break;
-    case Compass:
-        ui->actionConnect->setEnabled(false);
-        ui->actionDisconnect->setEnabled(true);
-        ui->actionCompass->setEnabled(true);
-        ui->actionCalibration->setEnabled(true);
-        ui->actionDone->setEnabled(false);
-        ui->actionCancel->setEnabled(false);
-
-        m_status.setText("Compass mode");
-        ui->openGLWidget->setMode(Compass);
-        m_thread->setMode(Compass);
-        break;
-    case Calibration:
-        ui->actionConnect->setEnabled(false);
-        ui->actionDisconnect->setEnabled(true);
-        ui->actionCompass->setEnabled(true);
-        ui->actionCalibration->setEnabled(false);
-        ui->actionDone->setEnabled(true);
-        ui->actionCancel->setEnabled(true);
-
-        m_status.setText("Calibration mode");
-        ui->openGLWidget->setMode(Calibration);
-        m_thread->setMode(Calibration);
-        break;
-    }
-}
-
-
-
-void MainWindow::timerEvent(QTimerEvent* e)
-{
-    if(m_mode != Disconnected) {
-        ui->openGLWidget->update();
-    }
-}
+#include "mainwindow.h"
+#include "ui_mainwindow.h"
+#include "renderer.h"
+
+#include <QFile>
+#include <QFileDialog>
+#include <QMessageBox>
+#include <QTextStream>
+
+#include <cmath>
+
+
+
+static const int FRAME_PERIOD = 1000/60;
+static const int IDLE_FRAMES = 120;
+static const int PREVIEW_PERIOD = 200;
+
+
+
+///
+/// \brief Constructor.
+/// \param parent Objeto padre.
+///
+MainWindow::MainWindow(QWidget *parent) :
+    QMainWindow(parent),
+    ui(new Ui::MainWindow),
+    m_device_index(-1)
+{
+    // Inicializa la interfaz gráfica
+    ui->setupUi(this);
+
+    // Inicializa la barra de menú
+    connect(ui->actionConnect, &QAction::triggered, this, &MainWindow::actionConnect);
+    connect(ui->actionConnectAll, &QAction::triggered, this, &MainWindow::actionConnectAll);
+    connect(ui->actionDisconnect, &QAction::triggered, this, &MainWindow::actionDisconnect);
+    connect(ui->actionCompass, &QAction::triggered, this, &MainWindow::actionCompass);
+    connect(ui->actionCalibration, &QAction::triggered, this, &MainWindow::actionCalibration);
+    connect(ui->actionGyroCalibration, &QAction::triggered, this, &MainWindow::actionGyroCalibration);
+    connect(ui->actionDone, &QAction::triggered, this, &MainWindow::actionDone);
+    connect(ui->actionCancel, &QAction::triggered, this, &MainWindow::actionCancel);
+    connect(ui->actionBinary, &QAction::toggled, this, &MainWindow::actionBinary);
+    connect(ui->actionOrientedFit, &QAction::toggled, this, &MainWindow::actionOrientedFit);
+    connect(ui->actionRobustFit, &QAction::toggled, this, &MainWindow::actionRobustFit);
+    connect(ui->actionHostFusion, &QAction::toggled, this, &MainWindow::actionHostFusion);
+    connect(ui->actionSinglePass, &QAction::toggled, this, &MainWindow::actionSinglePass);
+    connect(ui->actionLevelOfDetail, &QAction::toggled, this, &MainWindow::actionLevelOfDetail);
+    connect(ui->actionFrameStats, &QAction::toggled, this, &MainWindow::actionFrameStats);
+    connect(ui->actionSaveLatency, &QAction::triggered, this, &MainWindow::actionSaveLatency);
+    connect(ui->actionSaveAllan, &QAction::triggered, this, &MainWindow::actionSaveAllan);
+    connect(ui->actionSaveOutliers, &QAction::triggered, this, &MainWindow::actionSaveOutliers);
+    connect(ui->actionRecord, &QAction::toggled, this, &MainWindow::actionRecord);
+    connect(ui->actionReplay, &QAction::triggered, this, &MainWindow::actionReplay);
+    connect(ui->openGLWidget, &QOpenGLWidget::frameSwapped, this, &MainWindow::frameSwapped);
+
+    // Añade la lista de puertos series
+    ui->mainToolBar->insertWidget(ui->actionConnect, &m_serialPortList);
+    m_serialPortInfos = QSerialPortInfo::availablePorts();
+    for( const auto& info : m_serialPortInfos ) {
+        const QString name = info.portName() + " - " + info.description() + " - " + info.manufacturer();
+        m_serialPortList.addItem(name);
+    }
+
+    // También se puede escribir la ruta de un puerto que no aparece en la lista, como un pseudoterminal
+    m_serialPortList.setEditable(true);
+    m_serialPortList.setInsertPolicy(QComboBox::NoInsert);
+
+    // Añade la lista de IMUs conectados, para elegir cuál se muestra
+    ui->mainToolBar->insertWidget(ui->actionCompass, &m_deviceList);
+    m_deviceList.setSizeAdjustPolicy(QComboBox::AdjustToContents);
+    connect(&m_deviceList, static_cast<void(QComboBox::*)(int)>(&QComboBox::currentIndexChanged), this, &MainWindow::selectDevice);
+    connect(&m_devices, &DeviceManager::samplesAvailable, this, &MainWindow::samplesArrived);
+    connect(&m_devices, &DeviceManager::calibrationWritten, this, &MainWindow::calibrationWritten);
+    connect(&m_devices, &DeviceManager::replayFinished, this, &MainWindow::replayFinished);
+    connect(&m_devices, &DeviceManager::fitProgress, this, &MainWindow::fitProgress);
+    connect(&m_devices, &DeviceManager::fitFinished, this, &MainWindow::fitFinished);
+    connect(&m_preview, &FitPreviewer::previewReady, this, &MainWindow::previewReady);
+
+    // Inicializa la barra de estado
+    ui->statusBar->addWidget(&m_status);
+    m_status.setFont(QFont("Courier", 10));
+    ui->statusBar->addWidget(&m_fit);
+    m_fit.setFont(QFont("Courier", 10));
+    ui->statusBar->addPermanentWidget(&m_progress);
+    m_progress.setMaximumWidth(160);
+    m_progress.hide();
+    ui->statusBar->addPermanentWidget(&m_rate);
+    m_rate.setFont(QFont("Courier", 10));
+    ui->statusBar->addPermanentWidget(&m_latency);
+    m_latency.setFont(QFont("Courier", 10));
+    m_present_pending = 0;
+    m_idle_frames = 0;
+    m_clouds_dirty = false;
+    m_clouds_reset = true;
+    m_preview_timer.start();
+    setMode(Disconnected);
+}
+
+
+
+///
+/// \brief Destructor.
+///
+MainWindow::~MainWindow()
+{
+    m_devices.close();
+    delete ui;
+}
+
+
+
+///
+/// \brief Abre la conexión con el IMU elegido en la lista, o con el puerto cuya ruta se ha escrito.
+///
+void MainWindow::actionConnect()
+{
+    const int index = m_serialPortList.currentIndex();
+    const QString text = m_serialPortList.currentText().trimmed();
+    if ((index >= 0) && (text == m_serialPortList.itemText(index))) {
+        m_devices.open(m_serialPortInfos[index], ui->actionBinary->isChecked());
+    }
+    else if (!text.isEmpty()) {
+        m_devices.open(QSerialPortInfo(text), ui->actionBinary->isChecked());
+    }
+    else {
+        return;
+    }
+    updateDeviceList();
+    setMode(Compass);
+    resetStats();
+}
+
+
+
+///
+/// \brief Abre la conexión con todos los IMUs de la lista de puertos.
+///
+void MainWindow::actionConnectAll()
+{
+    if (m_serialPortInfos.isEmpty()) return;
+
+    for( const auto& info : m_serialPortInfos ) {
+        m_devices.open(info, ui->actionBinary->isChecked());
+    }
+    updateDeviceList();
+    setMode(Compass);
+    resetStats();
+}
+
+
+
+///
+/// \brief Cierra la conexión con el IMU.
+///
+void MainWindow::actionDisconnect()
+{
+    setMode(Disconnected);
+}
+
+
+
+///
+/// \brief Modo brújula.
+///
+void MainWindow::actionCompass()
+{
+    setMode(Compass);
+}
+
+
+
+///
+/// \brief Inicia el proceso de calibración.
+///
+void MainWindow::actionCalibration()
+{
+    m_devices.cancelFit();
+    setMode(Calibration);
+    m_devices.clearMeasurements();
+    rebuildView();
+}
+
+
+
+///
+/// \brief Inicia la calibración del giróscopo, con los IMUs quietos.
+///
+void MainWindow::actionGyroCalibration()
+{
+    m_devices.cancelFit();
+    setMode(GyroCalibration);
+    m_devices.clearGyroMeasurements();
+}
+
+
+
+///
+/// \brief Termina la calibración.
+///
+void MainWindow::actionDone()
+{
+    // El sesgo del giróscopo es sólo la media de las medidas, así que se envía sin más
+    if(m_mode == GyroCalibration) {
+        setMode(Waiting);
+        const int devices = m_devices.applyGyroCalibration();
+        if(!devices) {
+            ui->statusBar->showMessage("Not enough gyroscope measurements to calibrate", 5000);
+            return;
+        }
+        const int index = std::min(std::max(m_device_index, 0), m_devices.size() - 1);
+        const GyroCalibrator& gyro = m_devices.session(index).gyroCalibrator();
+        const QVector3D bias = gyro.bias() * 1e3f;
+        QString message;
+        message.sprintf("Gyroscope bias of %d IMUs computed, %s: (%+.3f, %+.3f, %+.3f) mrad/s from %.0f s",
+                        devices, qPrintable(m_devices.session(index).name()), bias.x(), bias.y(), bias.z(), gyro.duration());
+        ui->statusBar->showMessage(message, 10000);
+        return;
+    }
+
+    // Detiene la captura de datos
+    setMode(Waiting);
+
+    // Calcula los factores de corrección de todos los IMUs en segundo plano; Cancel lo interrumpe
+    const int devices = m_devices.startFit();
+    if(!devices) {
+        ui->statusBar->showMessage("No measurements to calibrate", 5000);
+        return;
+    }
+    m_progress.setRange(0, 2 * devices);
+    m_progress.setValue(0);
+    m_progress.show();
+    ui->actionCancel->setEnabled(true);
+    ui->statusBar->showMessage("Computing calibration...");
+}
+
+
+
+///
+/// \brief Avance del cálculo de las calibraciones.
+/// \param done Sensores ya calibrados.
+/// \param total Sensores a calibrar.
+///
+void MainWindow::fitProgress(int done, int total)
+{
+    m_progress.setRange(0, total);
+    m_progress.setValue(done);
+}
+
+
+
+///
+/// \brief Ha terminado el cálculo de las calibraciones.
+/// \param completed Falso si se ha cancelado; entonces no se ha enviado ninguna.
+/// \param milliseconds Duración del cálculo.
+///
+void MainWindow::fitFinished(bool completed, double milliseconds)
+{
+    m_progress.hide();
+    ui->actionCancel->setEnabled(m_mode == Calibration);
+    if(!completed) {
+        ui->statusBar->showMessage("Calibration cancelled", 5000);
+        return;
+    }
+
+    const char* model = (m_devices.fitModel() == EllipsoidOriented) ? "oriented" : "aligned";
+    QString message = QString("Calibration (%1 ellipsoid) computed in %2 ms").arg(model).arg(milliseconds, 0, 'f', 1);
+
+    // Con el ajuste robusto, informa de cuántas medidas se han descartado en cada IMU
+    if(m_devices.robustFit()) {
+        QStringList rejected;
+        for(int i=0 ; i<m_devices.size() ; ++i) {
+            const DeviceCalibration& calibration = m_devices.session(i).calibration();
+            if(!calibration.m_valid) continue;
+            rejected << QString("%1: %2 acc / %3 mag of %4").arg(m_devices.session(i).name())
+                        .arg(calibration.m_acc_rejected).arg(calibration.m_mag_rejected).arg(calibration.m_samples);
+        }
+        message += ", outliers rejected " + rejected.join(", ");
+    }
+    ui->statusBar->showMessage(message, 10000);
+    rebuildView();
+}
+
+
+
+///
+/// \brief Cancela la calibración.
+///
+void MainWindow::actionCancel()
+{
+    if(m_mode == GyroCalibration) {
+        setMode(Compass);
+        m_devices.clearGyroMeasurements();
+        return;
+    }
+
+    // Mientras se calcula, interrumpe el cálculo y vuelve a la captura sin perder las medidas
+    if(m_devices.fitting()) {
+        m_devices.cancelFit();
+        setMode(Calibration);
+        return;
+    }
+
+    setMode(Compass);
+    m_devices.clearMeasurements();
+    rebuildView();
+}
+
+
+
+///
+/// \brief Cambia el formato de la telemetría entre texto y tramas binarias.
+/// \param checked Verdadero para el formato binario.
+///
+void MainWindow::actionBinary(bool checked)
+{
+    m_devices.setBinary(checked);
+}
+
+
+
+///
+/// \brief Cambia el ajuste entre la elipsoide alineada con los ejes y la orientada (soft-iron).
+/// \param checked Verdadero para la elipsoide orientada.
+///
+void MainWindow::actionOrientedFit(bool checked)
+{
+    m_devices.setFitModel(checked ? EllipsoidOriented : EllipsoidAligned);
+}
+
+
+
+///
+/// \brief Activa o desactiva el descarte de medidas atípicas (golpes, perturbaciones magnéticas).
+/// \param checked Verdadero para el ajuste robusto.
+///
+void MainWindow::actionRobustFit(bool checked)
+{
+    m_devices.setRobustFit(checked);
+}
+
+
+
+///
+/// \brief Activa o desactiva la fusión en el PC de las medidas calibradas, junto a la orientación del IMU.
+/// \param checked Verdadero para fusionar en el PC.
+///
+void MainWindow::actionHostFusion(bool checked)
+{
+    m_devices.setHostFusion(checked);
+    ui->openGLWidget->setHostFusion(checked);
+    if(!checked && (m_mode == Compass)) m_fit.clear();
+}
+
+
+
+///
+/// \brief Elige si las vistas se dibujan en una sola pasada, para comparar el coste de las dos formas.
+/// \param checked Verdadero para una pasada con instancias, falso para una pasada por vista.
+///
+void MainWindow::actionSinglePass(bool checked)
+{
+    ui->openGLWidget->setSinglePass(checked);
+    ui->openGLWidget->resetPaintStats();
+}
+
+
+
+///
+/// \brief Activa o desactiva los niveles de detalle de las nubes de puntos.
+/// \param checked Verdadero para dibujar sólo los puntos que se distinguen con el zoom actual.
+///
+void MainWindow::actionLevelOfDetail(bool checked)
+{
+    ui->openGLWidget->setLevelOfDetail(checked);
+    ui->openGLWidget->resetPaintStats();
+}
+
+
+
+///
+/// \brief Muestra u oculta sobre las vistas los tiempos de cada fotograma.
+/// \param checked Verdadero para mostrarlos.
+///
+void MainWindow::actionFrameStats(bool checked)
+{
+    ui->openGLWidget->setFrameStats(checked);
+}
+
+
+
+///
+/// \brief Elige el filtro de la fusión en el PC, por ejemplo desde la línea de comandos.
+/// \param filter Filtro de Madgwick o de Mahony.
+///
+void MainWindow::setFusionFilter(FusionFilter filter)
+{
+    m_devices.setFusionFilter(filter);
+}
+
+
+
+///
+/// \brief Elige el modelo de elipsoide de la calibración, por ejemplo desde la línea de comandos.
+/// \param model Modelo de elipsoide.
+///
+void MainWindow::setFitModel(EllipsoidModel model)
+{
+    ui->actionOrientedFit->setChecked(model == EllipsoidOriented);
+    m_devices.setFitModel(model);
+}
+
+
+
+///
+/// \brief Guarda en un fichero de texto los histogramas de latencia de cada etapa.
+///
+void MainWindow::actionSaveLatency()
+{
+    const QString fileName = QFileDialog::getSaveFileName(this, "Save latency", QString(), "Text files (*.txt)");
+    if(fileName.isEmpty()) return;
+
+    QFile file(fileName);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        ui->statusBar->showMessage("Couldn't write " + fileName, 5000);
+        return;
+    }
+
+    LatencyHistogram interval, parse;
+    m_devices.mergeLatency(interval, parse);
+    QTextStream stream(&file);
+    interval.write(stream, "read interval: time between reads that carry samples of the same type, "
+                           "later samples of the same read are skipped");
+    parse.write(stream, "parse: bytes read to sample decoded");
+    m_delivery_latency.write(stream, "delivery: bytes read to sample handed to the GUI");
+    m_present_latency.write(stream, "present: bytes read to frame swapped with the sample on screen");
+    ui->statusBar->showMessage("Latency saved to " + fileName, 5000);
+}
+
+
+
+///
+/// \brief Guarda en un fichero de texto el sesgo, el ruido y la curva de Allan del giróscopo de cada IMU.
+///
+void MainWindow::actionSaveAllan()
+{
+    const QString fileName = QFileDialog::getSaveFileName(this, "Save Allan deviation", QString(), "Text files (*.txt)");
+    if(fileName.isEmpty()) return;
+
+    QFile file(fileName);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        ui->statusBar->showMessage("Couldn't write " + fileName, 5000);
+        return;
+    }
+
+    QTextStream stream(&file);
+    for(int i=0 ; i<m_devices.size() ; ++i) {
+        m_devices.session(i).gyroCalibrator().write(stream, m_devices.session(i).name());
+    }
+    ui->statusBar->showMessage("Allan deviation saved to " + fileName, 5000);
+}
+
+
+
+///
+/// \brief Guarda en un fichero de texto las medidas que ha descartado el último ajuste robusto de cada IMU.
+///
+void MainWindow::actionSaveOutliers()
+{
+    const QString fileName = QFileDialog::getSaveFileName(this, "Save outliers", QString(), "Text files (*.txt)");
+    if(fileName.isEmpty()) return;
+
+    QFile file(fileName);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        ui->statusBar->showMessage("Couldn't write " + fileName, 5000);
+        return;
+    }
+
+    QTextStream stream(&file);
+    for(int i=0 ; i<m_devices.size() ; ++i) {
+        m_devices.session(i).writeOutliers(stream);
+    }
+    ui->statusBar->showMessage("Outliers saved to " + fileName, 5000);
+}
+
+
+
+///
+/// \brief Empieza o termina la grabación de los bytes recibidos de los IMUs conectados.
+/// \param checked Verdadero para empezar a grabar.
+///
+void MainWindow::actionRecord(bool checked)
+{
+    if(!checked) {
+        m_devices.stopRecording();
+        ui->statusBar->showMessage("Recording stopped", 5000);
+        return;
+    }
+
+    const QString fileName = QFileDialog::getSaveFileName(this, "Record", QString(), "IMU recordings (*.imurec)");
+    const int started = fileName.isEmpty() ? 0 : m_devices.startRecording(fileName);
+    if(!started) {
+        ui->actionRecord->setChecked(false);
+        if(!fileName.isEmpty()) ui->statusBar->showMessage("Nothing to record", 5000);
+        return;
+    }
+    ui->statusBar->showMessage(QString("Recording %1 device(s)").arg(started), 5000);
+}
+
+
+
+///
+/// \brief Reproduce una grabación y la usa para calibrar, sin el IMU conectado.
+///
+/// La grabación es una sesión nueva, con las medidas vacías; las de los IMUs conectados y el ajuste en curso
+/// se conservan. Si la aplicación no estaba capturando se pasa al modo de calibración.
+///
+void MainWindow::actionReplay()
+{
+    const QString fileName = QFileDialog::getOpenFileName(this, "Replay", QString(), "IMU recordings (*.imurec)");
+    if(fileName.isEmpty()) return;
+
+    const bool realtime = QMessageBox::question(this, "Replay", "Replay at the original timing?\n"
+                                                "Choose No to replay as fast as possible.",
+                                                QMessageBox::Yes | QMessageBox::No) == QMessageBox::Yes;
+    DeviceSession* session = m_devices.openReplay(fileName, realtime);
+    updateDeviceList();
+    resetStats();
+    if(m_mode == Calibration) session->thread().setMode(Calibration);
+    else setMode(Calibration);
+    rebuildView();
+}
+
+
+
+///
+/// \brief Ha terminado la reproducción de una grabación.
+/// \param device Nombre de la grabación.
+/// \param samples Número de muestras reproducidas.
+/// \param seconds Duración de la reproducción.
+///
+void MainWindow::replayFinished(const QString& device, quint64 samples, double seconds)
+{
+    QString msg;
+    msg.sprintf("Replay of %s: %llu samples in %.3f s (%.0f samples/s)",
+                qPrintable(device), samples, seconds, seconds > 0.0 ? samples / seconds : 0.0);
+    ui->statusBar->showMessage(msg, 0);
+}
+
+
+
+///
+/// \brief Elige el IMU que se muestra.
+/// \param index Índice en la lista de IMUs; el primero es la vista agregada de todos.
+///
+void MainWindow::selectDevice(int index)
+{
+    m_device_index = index - 1;
+    rebuildView();
+}
+
+
+
+///
+/// \brief Recibe la orientación calculada por el IMU.
+/// \param quat Orientación en referencia al sistema ENU.
+///
+void MainWindow::readOrientation(QQuaternion quat)
+{
+    if(m_mode == Compass) {
+        QMatrix4x4 m;
+        m.rotate(quat);
+        ui->openGLWidget->setOrientation(m);
+        m_device_orientation = quat;
+    }
+}
+
+
+
+///
+/// \brief Recibe la fuerza ejercida sobre la muñeca.
+/// \param force Flexión XY, compresión, torsión.
+///
+void MainWindow::readForce(QVector4D force)
+{
+    if(m_mode == Compass) {
+        QString msg;
+        msg.sprintf("Flexión: (%+f, %+f) | Compresión: %+f | Torsión: %+f", force.x(), force.y(), force.z(), force.w());
+        m_status.setText(msg);
+    }
+}
+
+
+
+///
+/// \brief Lectura de los sensores del IMU, sin procesar.
+/// \param session IMU del que viene la lectura.
+/// \param gyr Giróscopo, radianes/s.
+/// \param acc Acelerómetro, x/g₀
+/// \param mag Magnetómetro, x/45µT
+/// \param timestamp Instante de llegada, en ns.
+///
+void MainWindow::readRawSensors(DeviceSession& session, QVector3D gyr, QVector3D acc, QVector3D mag, qint64 timestamp)
+{
+    if(m_mode == GyroCalibration) {
+        session.addGyroMeasurement(gyr, timestamp);
+    }
+    else if((m_mode == Compass) && m_devices.hostFusion()) {
+        session.fuse(gyr, acc, mag, timestamp);
+    }
+    else if(m_mode == Calibration) {
+        switch(session.addMeasurement(acc, mag)) {
+        case CloudAppended:
+            if(m_device_index < 0) {
+                m_acc_view.push_back(acc);
+                m_mag_view.push_back(mag);
+            }
+            m_clouds_dirty = true;
+            break;
+        case CloudCompacted:
+            rebuildView();
+            break;
+        default:
+            break;
+        }
+
+        /*QString msg;
+        msg.sprintf("Gyr: (%+f, %+f, %+f) | Acc: (%+f, %+f, %+f) | Mag: (%+f, %+f, %+f)",
+                gyr.x(), gyr.y(), gyr.z(),
+                acc.x(), acc.y(), acc.z(),
+                mag.x(), mag.y(), mag.z());
+        m_status.setText(msg);*/
+    }
+}
+
+
+
+///
+/// \brief Lectura de los valores del ADC, sin procesar.
+/// \param values Los 6 canales del ADC, en milivoltios.
+///
+void MainWindow::readRawAnalog(const float values[6])
+{
+    if(m_mode == Calibration) {
+        QString msg;
+        msg.sprintf("ADC: (%+f, %+f, %+f, %+f, %+f, %+f)", values[0], values[1], values[2], values[3], values[4], values[5]);
+        m_status.setText(msg);
+    }
+}
+
+
+
+///
+/// \brief Vacía las colas de muestras de todos los IMUs y reparte cada muestra a su manejador.
+///
+/// La orientación, la fuerza y el ADC sólo se muestran para el IMU elegido, o para el primero en la
+/// vista agregada; las medidas para la calibración se guardan en la sesión de cada IMU.
+///
+/// \return Número de muestras procesadas.
+///
+int MainWindow::drainSamples()
+{
+    const qint64 now = SteadyClock();
+    int count = 0;
+    for( int i=0 ; i<m_devices.size() ; ++i ) {
+        DeviceSession& session = m_devices.session(i);
+        const bool shown = (i == std::max(m_device_index, 0));
+        SampleRing& ring = session.thread().samples();
+        ring.disarm();
+
+        TelemetrySample sample;
+        while(ring.pop(sample)) {
+            m_delivery_latency.record(now - sample.m_timestamp);
+            const float* v = sample.m_values;
+            switch(sample.m_type) {
+            case SampleOrientation:
+                if(shown) {
+                    readOrientation(QQuaternion(v[0], v[1], v[2], v[3]));
+                    if(m_mode == Compass) m_present_pending = std::max(m_present_pending, sample.m_timestamp);
+                }
+                break;
+            case SampleForce:
+                if(shown) readForce(QVector4D(v[0], v[1], v[2], v[3]));
+                break;
+            case SampleRawAnalog:
+                if(shown) readRawAnalog(v);
+                break;
+            case SampleRawSensors:
+                readRawSensors(session, QVector3D(v[0], v[1], v[2]), QVector3D(v[3], v[4], v[5]), QVector3D(v[6], v[7], v[8]),
+                               sample.m_timestamp);
+                if((m_mode == Calibration) && (shown || (m_device_index < 0))) {
+                    m_present_pending = std::max(m_present_pending, sample.m_timestamp);
+                }
+                break;
+            default:
+                break;
+            }
+            ++count;
+        }
+    }
+
+    // La orientación calculada en el PC también se sube una sola vez por fotograma
+    if((m_mode == Compass) && m_devices.hostFusion() && m_devices.size()) {
+        QMatrix4x4 m;
+        m.rotate(m_devices.session(std::min(std::max(m_device_index, 0), m_devices.size() - 1)).fusion().orientation());
+        ui->openGLWidget->setHostOrientation(m);
+    }
+
+    // Las nubes de puntos se actualizan una sola vez por fotograma
+    if(m_clouds_dirty) {
+        updateClouds();
+        m_clouds_dirty = false;
+    }
+    return count;
+}
+
+
+
+///
+/// \brief Sube al renderizador las nubes de puntos del IMU elegido, o las de todos juntos.
+///
+/// Mientras sólo se añaden medidas se suben los puntos nuevos; tras rebuildView() se suben enteras.
+///
+void MainWindow::updateClouds()
+{
+    if((m_device_index >= 0) && (m_device_index < m_devices.size())) {
+        const DeviceSession& session = m_devices.session(m_device_index);
+        ui->openGLWidget->setClouds(session.accMeasurements(), session.magMeasurements(), !m_clouds_reset);
+    }
+    else {
+        ui->openGLWidget->setClouds(m_acc_view, m_mag_view, !m_clouds_reset);
+    }
+    m_clouds_reset = false;
+}
+
+
+
+///
+/// \brief Reconstruye la vista agregada con las medidas de todos los IMUs.
+///
+/// Sólo hace falta al cambiar de vista o al descartar medidas; durante la captura las medidas nuevas
+/// se añaden al final de la vista según llegan.
+///
+void MainWindow::rebuildView()
+{
+    m_acc_view.clear();
+    m_mag_view.clear();
+    if(m_device_index < 0) {
+        for( int i=0 ; i<m_devices.size() ; ++i ) {
+            const DeviceSession& session = m_devices.session(i);
+            m_acc_view.insert(m_acc_view.end(), session.accMeasurements().begin(), session.accMeasurements().end());
+            m_mag_view.insert(m_mag_view.end(), session.magMeasurements().begin(), session.magMeasurements().end());
+        }
+    }
+    m_clouds_dirty = true;
+    m_clouds_reset = true;
+}
+
+
+
+///
+/// \brief Rellena la lista de IMUs conectados, con la tasa de muestras de cada uno.
+///
+void MainWindow::updateDeviceList()
+{
+    m_deviceList.blockSignals(true);
+    while(m_deviceList.count() > m_devices.size() + 1) {
+        m_deviceList.removeItem(m_deviceList.count() - 1);
+    }
+    while(m_deviceList.count() < m_devices.size() + 1) {
+        m_deviceList.addItem(QString());
+    }
+    m_deviceList.setItemText(0, QString("All devices (%1)").arg(m_devices.size()));
+    for( int i=0 ; i<m_devices.size() ; ++i ) {
+        const DeviceSession& session = m_devices.session(i);
+        const TelemetryStats& stats = session.stats();
+        QString text;
+        text.sprintf("%s | %s | %.0f samples/s | %llu errors | %llu overflows",
+                     qPrintable(session.name()), qPrintable(session.uid()), session.sampleRate(),
+                     stats.m_errors, stats.m_overflows);
+        m_deviceList.setItemText(i + 1, text);
+    }
+    m_deviceList.blockSignals(false);
+    if(m_device_index >= m_devices.size()) {
+        m_deviceList.setCurrentIndex(0);
+    }
+}
+
+
+
+///
+/// \brief El renderizador ha presentado un fotograma: se mide la latencia de la muestra más reciente que
+/// contenía.
+///
+void MainWindow::frameSwapped()
+{
+    if(m_present_pending) {
+        m_present_latency.record(SteadyClock() - m_present_pending);
+        m_present_pending = 0;
+    }
+}
+
+
+
+///
+/// \brief Reinicia los contadores de tráfico y los histogramas de latencia de la interfaz gráfica.
+///
+void MainWindow::resetStats()
+{
+    m_last_stats = m_devices.stats();
+    m_rate_timer.start();
+    m_delivery_latency.reset();
+    m_present_latency.reset();
+    m_present_pending = 0;
+    ui->openGLWidget->resetUploadStats();
+    ui->openGLWidget->resetPaintStats();
+}
+
+
+
+///
+/// \brief Aviso del hilo del puerto serie de que hay muestras nuevas en la cola.
+///
+/// Con baja latencia las muestras se procesan en cuanto llegan, sin esperar a la fase del temporizador,
+/// y el renderizador presenta la orientación nueva en el siguiente fotograma.
+///
+void MainWindow::samplesArrived()
+{
+    if(ui->actionLowLatency->isChecked() && (m_mode != Disconnected)) {
+        drainSamples();
+    }
+    samplesAvailable();
+}
+
+
+
+///
+/// \brief Arranca el temporizador de fotogramas si estaba parado por inactividad.
+///
+void MainWindow::samplesAvailable()
+{
+    m_idle_frames = 0;
+    if(!m_timer.isActive()) {
+        m_timer.start(FRAME_PERIOD, this);
+    }
+}
+
+
+
+///
+/// \brief Resultado de la escritura de una calibración en el IMU.
+/// \param device Puerto serie del IMU.
+/// \param sensor Sensor calibrado, "acc", "mag" o "gyr".
+/// \param verified Verdadero si la calibración leída de vuelta coincide con la enviada.
+///
+void MainWindow::calibrationWritten(const QString& device, const QString& sensor, bool verified)
+{
+    const QString name = device + ": " + ((sensor == "acc") ? "Accelerometer" : (sensor == "mag") ? "Magnetometer" : "Gyroscope");
+    if(verified) {
+        ui->statusBar->showMessage(name + " calibration written and verified", 5000);
+    }
+    else {
+        ui->statusBar->showMessage(name + " calibration could NOT be verified", 0);
+    }
+}
+
+
+
+///
+/// \brief Ha terminado un ajuste provisional: muestra la elipsoide sobre las nubes y su forma.
+/// \param preview Ajuste provisional.
+///
+void MainWindow::previewReady(const FitPreview& preview)
+{
+    if((m_mode != Calibration) || !preview.m_valid) {
+        ui->openGLWidget->clearFitPreview();
+        m_fit.clear();
+        return;
+    }
+
+    ui->openGLWidget->setFitPreview(preview.m_acc, preview.m_mag);
+    const EllipsoidShape& acc = preview.m_acc_shape;
+    const EllipsoidShape& mag = preview.m_mag_shape;
+    QString msg;
+    msg.sprintf("%s: acc c(%+.3f %+.3f %+.3f) r(%.3f %.3f %.3f) rms %.2f%% | mag c(%+.3f %+.3f %+.3f) r(%.3f %.3f %.3f) rms %.2f%%",
+                qPrintable(preview.m_name),
+                acc.m_center.x(), acc.m_center.y(), acc.m_center.z(), acc.m_radii.x(), acc.m_radii.y(), acc.m_radii.z(), acc.m_rms * 100.0,
+                mag.m_center.x(), mag.m_center.y(), mag.m_center.z(), mag.m_radii.x(), mag.m_radii.y(), mag.m_radii.z(), mag.m_rms * 100.0);
+    m_fit.setText(msg);
+}
+
+
+
+///
+/// \brief Cambia el modo de funcionamiento de la aplicación.
+/// \param mode Nuevo modo de funcionamiento.
+///
+void MainWindow::setMode(IMUMode mode)
+{
+    m_mode = mode;
+    samplesAvailable();
+
+    // El ajuste provisional sólo tiene sentido durante una captura
+    m_preview.cancel();
+    ui->openGLWidget->clearFitPreview();
+    m_fit.clear();
+    switch(m_mode) {
+    case Disconnected:
+        ui->actionRecord->setChecked(false);
+        ui->actionConnect->setEnabled(true);
+        ui->actionConnectAll->setEnabled(true);
+        ui->actionDisconnect->setEnabled(false);
+        ui->actionCalibration->setEnabled(false);
+        ui->actionGyroCalibration->setEnabled(false);
+        ui->actionDone->setEnabled(false);
+        ui->actionCancel->setEnabled(false);
+        m_status.setText("Disconnected");
+        ui->openGLWidget->setMode(Disconnected);
+        m_devices.close();
+        updateDeviceList();
+        rebuildView();
+        break;
+    case Waiting:
+        ui->actionConnect->setEnabled(false);
+        ui->actionConnectAll->setEnabled(false);
+        ui->actionDisconnect->setEnabled(true);
+        ui->actionCompass->setEnabled(true);
+        ui->actionCalibration->setEnabled(true);
+        ui->actionGyroCalibration->setEnabled(true);
+        ui->actionDone->setEnabled(false);
+        ui->actionCancel->setEnabled(false);
+
+        m_status.setText("Waiting");
+        ui->openGLWidget->setMode(Compass);
+        m_devices.setMode(Waiting);
+        break;
+    case Compass:
+        ui->actionConnect->setEnabled(false);
+        ui->actionConnectAll->setEnabled(false);
+        ui->actionDisconnect->setEnabled(true);
+        ui->actionCompass->setEnabled(true);
+        ui->actionCalibration->setEnabled(true);
+        ui->actionGyroCalibration->setEnabled(true);
+        ui->actionDone->setEnabled(false);
+        ui->actionCancel->setEnabled(false);
+
+        // La fusión en el PC empieza de cero, por si ha cambiado la calibración
+        m_status.setText("Compass mode");
+        ui->openGLWidget->setMode(Compass);
+        m_devices.resetFusion();
+        m_devices.setMode(Compass);
+        break;
+    case Calibration:
+        ui->actionConnect->setEnabled(false);
+        ui->actionConnectAll->setEnabled(false);
+        ui->actionDisconnect->setEnabled(true);
+        ui->actionCompass->setEnabled(true);
+        ui->actionCalibration->setEnabled(false);
+        ui->actionGyroCalibration->setEnabled(true);
+        ui->actionDone->setEnabled(true);
+        ui->actionCancel->setEnabled(true);
+
+        m_status.setText("Calibration mode");
+        ui->openGLWidget->setMode(Calibration);
+        m_devices.setMode(Calibration);
+        break;
+    case GyroCalibration:
+        ui->actionConnect->setEnabled(false);
+        ui->actionConnectAll->setEnabled(false);
+        ui->actionDisconnect->setEnabled(true);
+        ui->actionCompass->setEnabled(true);
+        ui->actionCalibration->setEnabled(true);
+        ui->actionGyroCalibration->setEnabled(false);
+        ui->actionDone->setEnabled(true);
+        ui->actionCancel->setEnabled(true);
+
+        // El IMU envía las medidas sin procesar y no su orientación, así que la escena se queda quieta
+        m_status.setText("Gyroscope calibration mode: keep the IMUs still");
+        ui->openGLWidget->setMode(Compass);
+        m_devices.setMode(GyroCalibration);
+        break;
+    }
+}
+
+
+
+///
+/// \brief Procesa las muestras recibidas una vez por fotograma; el renderizador sólo redibuja si algo ha cambiado.
+/// \param e Evento del temporizador.
+///
+void MainWindow::timerEvent(QTimerEvent* e)
+{
+    // Sin muestras durante un tiempo, el temporizador se para hasta el siguiente aviso
+    if(drainSamples() > 0) {
+        m_idle_frames = 0;
+    }
+    else if(++m_idle_frames > IDLE_FRAMES) {
+        m_timer.stop();
+    }
+
+    // Ajuste provisional del IMU que se muestra, varias veces por segundo
+    if((m_mode == Calibration) && m_devices.size() && (m_preview_timer.elapsed() >= PREVIEW_PERIOD)) {
+        const int index = std::min(std::max(m_device_index, 0), m_devices.size() - 1);
+        if(m_preview.request(m_devices.session(index), m_devices.fitModel())) m_preview_timer.restart();
+    }
+
+    // Con el fin automático, la calibración termina sola cuando todos los IMUs han cubierto la esfera
+    if((m_mode == Calibration) && ui->actionAutoStop->isChecked() && m_devices.calibrationComplete()) {
+        actionDone();
+    }
+
+    // Tasa de muestras y bytes por muestra, una vez por segundo
+    if(m_devices.size() && (m_rate_timer.elapsed() >= 1000)) {
+        const double seconds = m_rate_timer.restart() / 1000.0;
+        m_devices.updateStats(seconds);
+        updateDeviceList();
+        const TelemetryStats stats = m_devices.stats();
+        const double samples = stats.m_samples - m_last_stats.m_samples;
+        const double bytes = stats.m_bytes - m_last_stats.m_bytes;
+        const double wakeups = stats.m_wakeups - m_last_stats.m_wakeups;
+        QString msg;
+        msg.sprintf("%.0f samples/s | %.0f B/s | %.1f B/sample | %llu errors | %llu overflows | %.0f wakeups/s | cmd %.3f ms | %llu timeouts",
+                    samples / seconds, bytes / seconds, samples > 0 ? bytes / samples : 0.0, stats.m_errors,
+                    stats.m_overflows, wakeups / seconds, stats.m_command_latency / 1e6, stats.m_timeouts);
+        m_rate.setText(msg);
+        m_last_stats = stats;
+
+        // Percentiles 50 y 99 de la latencia de cada etapa
+        LatencyHistogram interval, parse;
+        m_devices.mergeLatency(interval, parse);
+        const PaintStats& paint = ui->openGLWidget->paintStats();
+        msg.sprintf("read interval %.2f/%.2f ms | parse %.0f/%.0f us | delivery %.1f/%.1f ms | present %.1f/%.1f ms | paint %.0f fps, cpu %.0f/%.0f us, gpu %.0f/%.0f us, %.0f points",
+                    interval.percentile(50) / 1e6, interval.percentile(99) / 1e6,
+                    parse.percentile(50) / 1e3, parse.percentile(99) / 1e3,
+                    m_delivery_latency.percentile(50) / 1e6, m_delivery_latency.percentile(99) / 1e6,
+                    m_present_latency.percentile(50) / 1e6, m_present_latency.percentile(99) / 1e6,
+                    paint.m_frames / seconds, paint.m_time / std::max<double>(paint.m_frames, 1) / 1e3, paint.m_max_time / 1e3,
+                    paint.m_gpu_time / std::max<double>(paint.m_gpu_frames, 1) / 1e3, paint.m_gpu_max_time / 1e3,
+                    paint.m_points / std::max<double>(paint.m_frames, 1));
+        m_latency.setText(msg);
+        ui->openGLWidget->resetPaintStats();
+
+        // Cobertura de la esfera y convergencia del ajuste, las del IMU más atrasado
+        if(m_mode == Calibration) {
+            double acc = 1.0, mag = 1.0, change = 0.0;
+            quint64 duplicates = 0;
+            for(int i=0 ; i<m_devices.size() ; ++i) {
+                const DeviceSession& session = m_devices.session(i);
+                acc = std::min(acc, session.accCoverage());
+                mag = std::min(mag, session.magCoverage());
+                change = std::max(change, session.fitChange());
+                duplicates += session.duplicateCount();
+            }
+
+            // Subidas de las nubes a la GPU, por fotograma con medidas nuevas
+            const UploadStats& upload = ui->openGLWidget->uploadStats();
+            const double frames = std::max<quint64>(upload.m_frames, 1);
+            msg.sprintf("Coverage acc %.0f%% mag %.0f%% | fit change %s | %llu duplicates | upload %.1f KB/frame, %.0f/%.0f us avg/max, %llu grows",
+                        acc * 100.0, mag * 100.0,
+                        std::isfinite(change) ? qPrintable(QString("%1%").arg(change * 100.0, 0, 'f', 2)) : "-",
+                        duplicates, upload.m_bytes / frames / 1024.0, upload.m_time / frames / 1e3, upload.m_max_time / 1e3,
+                        upload.m_reallocations);
+            m_status.setText(msg);
+        }
+        ui->openGLWidget->resetUploadStats();
+
+        // Sesgo y ruido del giróscopo del IMU que se muestra
+        if(m_mode == GyroCalibration) {
+            const int index = std::min(std::max(m_device_index, 0), m_devices.size() - 1);
+            const GyroCalibrator& gyro = m_devices.session(index).gyroCalibrator();
+            const QVector3D bias = gyro.bias() * 1e3f, deviation = gyro.deviation() * 1e3f, noise = gyro.noiseDensity() * 1e3f;
+            msg.sprintf("%s: %llu samples, %.0f s | bias (%+.3f %+.3f %+.3f) mrad/s | sd (%.3f %.3f %.3f) mrad/s | noise (%.3f %.3f %.3f) mrad/s/sqrt(Hz)",
+                        qPrintable(m_devices.session(index).name()), static_cast<unsigned long long>(gyro.count()), gyro.duration(),
+                        bias.x(), bias.y(), bias.z(), deviation.x(), deviation.y(), deviation.z(), noise.x(), noise.y(), noise.z());
+            m_status.setText(msg);
+        }
+
+        // Fusión en el PC del IMU que se muestra: periodo estimado y diferencia con la del firmware
+        if((m_mode == Compass) && m_devices.hostFusion()) {
+            const int index = std::min(std::max(m_device_index, 0), m_devices.size() - 1);
+            const SensorFusion& fusion = m_devices.session(index).fusion();
+            msg.sprintf("Host %s: %llu samples, %.0f Hz | device vs host %.2f deg",
+                        (fusion.filter() == FusionMahony) ? "Mahony" : "Madgwick", static_cast<unsigned long long>(fusion.count()),
+                        (fusion.samplePeriod() > 0.0) ? 1.0 / fusion.samplePeriod() : 0.0,
+                        AngleBetween(m_device_orientation, fusion.orientation()));
+            m_fit.setText(msg);
+        }
+    }
+    else if(!m_devices.size()) {
+        m_rate.clear();
+        m_latency.clear();
+    }
+}
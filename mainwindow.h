@@ -1,55 +1,107 @@
-#pragma once
-
-#include <QBasicTimer>
-#include <QComboBox>
-#include <QLabel>
-#include <QMainWindow>
-
-#include "serialthread.h"
-
-
-
-namespace Ui {
-    class MainWindow;
-}
-
-
-
-class MainWindow : public QMainWindow
-{
-    Q_OBJECT
-
-public:
-    explicit MainWindow(QWidget *parent = 0);
-    ~MainWindow();
-    virtual void timerEvent(QTimerEvent* e);
-
-private:
-    Ui::MainWindow* ui;
-    SerialThread* m_thread;
-
-    QList<QSerialPortInfo> m_serialPortInfos;
-    QComboBox m_serialPortList;
-    QLabel m_status;
-    IMUMode m_mode;
-    QBasicTimer m_timer;
-
-    std::vector<QVector3D> m_acc_measurements;
-    std::vector<QVector3D> m_mag_measurements;
-
-private slots:
-    void actionConnect();
-    void actionDisconnect();
-    void actionCompass();
-    void actionCalibration();
-    void actionDone();
-    void actionCancel();
-
-    void setMode(IMUMode mode);
-
-public slots:
-    void readOrientation(QQuaternion ori);
-    void readForce(QVector4D force);
-    void readRawSensors(QVector3D gyr, QVector3D acc, QVector3D mag);
-    void readRawAnalog(float values[6]);
-};
+#pragma once
+
+#include <QBasicTimer>
+#include <QComboBox>
+#include <QElapsedTimer>
+#include <QLabel>
+#include <QMainWindow>
+#include <QProgressBar>
+
+#include "devicemanager.h"
+#include "fitpreview.h"
+
+
+
+namespace Ui {
+    class MainWindow;
+}
+
+
+
+class MainWindow : public QMainWindow
+{
+    Q_OBJECT
+
+public:
+    explicit MainWindow(QWidget *parent = 0);
+    ~MainWindow();
+    virtual void timerEvent(QTimerEvent* e);
+    void setFitModel(EllipsoidModel model);
+    void setFusionFilter(FusionFilter filter);
+
+private:
+    Ui::MainWindow* ui;
+    DeviceManager m_devices;
+
+    QList<QSerialPortInfo> m_serialPortInfos;
+    QComboBox m_serialPortList;
+    QComboBox m_deviceList;
+    int m_device_index;
+    QLabel m_status;
+    QLabel m_fit;
+    QLabel m_rate;
+    QLabel m_latency;
+    QProgressBar m_progress;
+    IMUMode m_mode;
+    QBasicTimer m_timer;
+    int m_idle_frames;
+    bool m_clouds_dirty;
+    bool m_clouds_reset;
+    QElapsedTimer m_rate_timer;
+    TelemetryStats m_last_stats;
+    LatencyHistogram m_delivery_latency;
+    LatencyHistogram m_present_latency;
+    qint64 m_present_pending;
+    FitPreviewer m_preview;
+    QElapsedTimer m_preview_timer;
+    QQuaternion m_device_orientation;
+
+    std::vector<QVector3D> m_acc_view;
+    std::vector<QVector3D> m_mag_view;
+
+private slots:
+    void actionConnect();
+    void actionConnectAll();
+    void actionDisconnect();
+    void actionCompass();
+    void actionCalibration();
+    void actionGyroCalibration();
+    void actionDone();
+    void actionCancel();
+    void actionBinary(bool checked);
+    void actionOrientedFit(bool checked);
+    void actionRobustFit(bool checked);
+    void actionHostFusion(bool checked);
+    void actionSinglePass(bool checked);
+    void actionLevelOfDetail(bool checked);
+    void actionFrameStats(bool checked);
+    void actionSaveLatency();
+    void actionSaveAllan();
+    void actionSaveOutliers();
+    void actionRecord(bool checked);
+    void actionReplay();
+    void selectDevice(int index);
+    void frameSwapped();
+    void samplesArrived();
+
+    void setMode(IMUMode mode);
+
+public slots:
+    void samplesAvailable();
+    void calibrationWritten(const QString& device, const QString& sensor, bool verified);
+    void replayFinished(const QString& device, quint64 samples, double seconds);
+    void previewReady(const FitPreview& preview);
+    void fitProgress(int done, int total);
+    void fitFinished(bool completed, double milliseconds);
+
+private:
+    int drainSamples();
+    void resetStats();
+    void updateClouds();
+    void rebuildView();
+    void updateDeviceList();
+    void readOrientation(QQuaternion ori);
+    void readForce(QVector4D force);
+    void readRawSensors(DeviceSession& session, QVector3D gyr, QVector3D acc, QVector3D mag, qint64 timestamp);
+    void readRawAnalog(const float values[6]);
+};
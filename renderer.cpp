@@ -1,236 +1,659 @@
-#include "renderer.h"
-#include "Render/axes.h"
-#include "Render/pointcloud.h"
-#include "Render/staticmesh.h"
-
-QMatrix4x4 camSide, camFront, camTop, cam3D;
-
-
-
-///
-/// \brief Constructor.
-/// \param parent Padre del widget, el widget se borrará cuando se borre el padre.
-///
-Renderer::Renderer(QWidget *parent) : QOpenGLWidget(parent), m_axes(nullptr), m_acc_cloud(nullptr), m_mag_cloud(nullptr), m_mesh(nullptr)
-{
-    // Vista lateral
-    camSide.setToIdentity();
-    camSide.translate(0.0f, 0.0f, -3.0f);
-    camSide.rotate(-90.0f, QVector3D(0.0f, 0.0f, 1.0f));
-    camSide.rotate(-90.0f, QVector3D(0.0f, 1.0f, 0.0f));
-
-    // Vista frontal
-    camFront.setToIdentity();
-    camFront.translate(0.0f, 0.0f, -3.0f);
-    camFront.rotate(-90.0f, 1.0f, 0.0f, 0.0f);
-
-    // Vista superior
-    camTop.setToIdentity();
-    camTop.translate(0.0f, 0.0f, -3.0f);
-
-    // Vista 3D
-    cam3D.setToIdentity();
-    cam3D.translate(0.0f, 0.0f, -3.0f);
-    cam3D.rotate(-45.0f, 1.0f, 0.0f, 0.0f);
-    cam3D.rotate(-45.0f, 0.0f, 0.0f, 1.0f);
-
-    /*printf("%f %f %f %f\n", camRight(0,0), camRight(0,1), camRight(0,2), camRight(0,3));
-    printf("%f %f %f %f\n", camRight(1,0), camRight(1,1), camRight(1,2), camRight(1,3));
-    printf("%f %f %f %f\n", camRight(2,0), camRight(2,1), camRight(2,2), camRight(2,3));
-    printf("%f %f %f %f\n", camRight(3,0), camRight(3,1), camRight(3,2), camRight(3,3));*/
-
-    /*// Inicializa el puerto serie
-    m_serial.setPort(ports[1]);
-    m_serial.setBaudRate(115200);
-    if (m_serial.open(QIODevice::ReadWrite)) {
-        qDebug() << "Opened serial port";
-    }*/
-}
-
-
-
-///
-/// \brief Destructor.
-///
-Renderer::~Renderer()
-{
-    delete m_mesh;
-    delete m_acc_cloud;
-    delete m_mag_cloud;
-    delete m_axes;
-}
-
-
-
-///
-/// \brief Renderer::initializeGL
-///
-void Renderer::initializeGL()
-{
-    // Initialize OpenGL
-    initializeGLFunctions();
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_CULL_FACE);
-    glPointSize(5.0f);
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-
-    // Render objects
-    m_axes = new Axes();
-    m_acc_cloud = new PointCloud();
-    m_mag_cloud = new PointCloud();
-    m_mesh = new StaticMesh();
-    m_mesh->load( QString(":/compassXYZ.mesh") );
-}
-
-
-
-///
-/// \brief Renderer::resizeGL
-/// \param w
-/// \param h
-///
-void Renderer::resizeGL(int width, int height)
-{
-    // Set OpenGL viewport to cover whole widget
-    m_width = width;
-    m_height = height;
-    m_aspect = qreal(width) / qreal(height ? height : 1);
-    glViewport(0, 0, width, height);
-
-    // Set perspective projection
-    const qreal zNear = 0.1, zFar = 1000.0, fov = 45.0;
-    m_perspective.setToIdentity();
-    m_perspective.perspective(fov, m_aspect, zNear, zFar);
-
-    // Set orthographic projection
-    m_ortho.setToIdentity();
-    m_ortho.ortho(-1.5*2.0/3.0*m_aspect, +1.5*2.0/3.0*m_aspect, -1.5, +1.5, -2000.0, +2000.0);
-}
-
-
-
-///
-/// \brief Renderer::paintGL
-///
-void Renderer::paintGL()
-{
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    switch(m_mode) {
-        case Compass: renderMesh(); break;
-        case Calibration: renderClouds(); break;
-        default: break;
-    }
-}
-
-
-
-///
-/// \brief Cambia el modo de funcionamiento del renderizador.
-/// \param mode Nuevo modo.
-///
-void Renderer::setMode(IMUMode mode)
-{
-    m_mode = mode;
-}
-
-
-
-///
-/// \brief Actualiza la orientación del IMU.
-/// \param quat Nueva orientación.
-///
-void Renderer::setOrientation(QMatrix4x4 ori)
-{
-    m_orientation = ori;
-}
-
-
-
-///
-/// \brief Actualiza la nube de puntos del acelerómetro.
-/// \param cloud
-///
-void Renderer::setAccCloud(const std::vector<QVector3D>& cloud)
-{
-    m_acc_cloud->update(cloud);
-}
-
-
-
-///
-/// \brief Actualiza la nube de puntos del magnetómetro.
-/// \param cloud
-///
-void Renderer::setMagCloud(const std::vector<QVector3D>& cloud)
-{
-    m_mag_cloud->update(cloud);
-}
-
-
-
-///
-/// \brief Renderiza la malla del IMU con la orientación calculada.
-///
-void Renderer::renderMesh()
-{
-    //QMatrix4x4 model;
-    //model.rotate(m_orientation);
-
-    // Cuadrante superior izquierdo / vista lateral
-    glViewport(0, m_height / 2, m_width / 2, m_height / 2);
-    m_axes->render(m_perspective * camSide);
-    m_mesh->render(m_perspective * camSide, m_orientation);
-
-    // Cuadrante superior derecho / vista frontal
-    glViewport(m_width / 2, m_height / 2, m_width / 2, m_height / 2);
-    m_axes->render(m_perspective * camFront);
-    m_mesh->render(m_perspective * camFront, m_orientation);
-
-    // Cuadrante inferior izquierdo / vista superior
-    glViewport(0, 0, m_width / 2, m_height / 2);
-    m_axes->render(m_perspective * camTop);
-    m_mesh->render(m_perspective * camTop, m_orientation);
-
-    // Cuadrante inferior derecho / vista 3D
-    glViewport(m_width / 2, 0, m_width / 2, m_height / 2);
-    m_axes->render(m_perspective * cam3D);
-    m_mesh->render(m_perspective * cam3D, m_orientation);
-}
-
-
-
-///
-/// \brief Renderiza las nube de puntos.
-///
-void Renderer::renderClouds()
-{
-    // Cuadrante superior izquierdo / vista superior
-    glViewport(0 * m_width / 3, m_height / 2, m_width / 3, m_height / 2);
-    m_axes->render(m_ortho * camTop);
-    m_mag_cloud->render(m_ortho * camTop);
-
-    // Cuadrante superior central / vista lateral
-    glViewport(1 * m_width / 3, m_height / 2, m_width / 3, m_height / 2);
-    m_axes->render(m_ortho * camSide);
-    m_mag_cloud->render(m_ortho * camSide);
-
-    // Cuadrante superior derecho / vista frontal
-    glViewport(2 * m_width / 3, m_height / 2, m_width / 3, m_height / 2);
-    m_axes->render(m_ortho * camFront);
-    m_mag_cloud->render(m_ortho * camFront);
-
-    // Cuadrante inferior izquierdo / vista superior
-    glViewport(0 * m_width / 3, 0, m_width / 3, m_height / 2);
-    m_axes->render(m_ortho * camTop);
-    m_acc_cloud->render(m_ortho * camTop);
-
-    // Cuadrante inferior central / vista lateral
-    glViewport(1 * m_width / 3, 0, m_width / 3, m_height / 2);
-    m_axes->render(m_ortho * camSide);
-    m_acc_cloud->render(m_ortho * camSide);
-
-    // Cuadrante inferior derecho / vista frontal
-    glViewport(2 * m_width / 3, 0, m_width / 3, m_height / 2);
-    m_axes->render(m_ortho * camFront);
-    m_acc_cloud->render(m_ortho * camFront);
-}
+#include "renderer.h"
+#include "Render/axes.h"
+#include "Render/pointcloud.h"
+#include "Render/staticmesh.h"
+#include "Render/viewset.h"
+#include "Render/wireframe.h"
+
+#include <QDebug>
+#include <QOpenGLContext>
+#include <QPainter>
+#include <QWheelEvent>
+
+#include <algorithm>
+#include <cmath>
+
+QMatrix4x4 camSide, camFront, camTop, cam3D;
+
+// Tamaño de los puntos de las nubes, en píxeles, y zoom máximo de las vistas ortográficas
+static const float PointSize = 5.0f;
+static const float MaxZoom = 64.0f;
+
+
+
+///
+/// \brief Constructor.
+/// \param parent Padre del widget, el widget se borrará cuando se borre el padre.
+///
+Renderer::Renderer(QWidget *parent) : QOpenGLWidget(parent), m_zoom(1.0f), m_axes(nullptr), m_acc_cloud(nullptr), m_mag_cloud(nullptr), m_mesh(nullptr), m_wireframe(nullptr), m_views(nullptr), m_ready(false), m_single_pass(true), m_level_of_detail(true), m_host_visible(false), m_fit_visible(false),
+    m_dirty(false), m_frame_pending(false), m_overlay(false), m_gpu_timing(false), m_gpu_next(0), m_overlay_cpu(0.0), m_overlay_gpu(0.0), m_overlay_interval(0.0)
+{
+    // Vista lateral
+    camSide.setToIdentity();
+    camSide.translate(0.0f, 0.0f, -3.0f);
+    camSide.rotate(-90.0f, QVector3D(0.0f, 0.0f, 1.0f));
+    camSide.rotate(-90.0f, QVector3D(0.0f, 1.0f, 0.0f));
+
+    // Vista frontal
+    camFront.setToIdentity();
+    camFront.translate(0.0f, 0.0f, -3.0f);
+    camFront.rotate(-90.0f, 1.0f, 0.0f, 0.0f);
+
+    // Vista superior
+    camTop.setToIdentity();
+    camTop.translate(0.0f, 0.0f, -3.0f);
+
+    // Vista 3D
+    cam3D.setToIdentity();
+    cam3D.translate(0.0f, 0.0f, -3.0f);
+    cam3D.rotate(-45.0f, 1.0f, 0.0f, 0.0f);
+    cam3D.rotate(-45.0f, 0.0f, 0.0f, 1.0f);
+
+    resetUploadStats();
+    resetPaintStats();
+    std::fill(m_gpu_issued, m_gpu_issued + GpuQueries, false);
+    connect(this, &QOpenGLWidget::frameSwapped, this, &Renderer::presented);
+
+    /*printf("%f %f %f %f\n", camRight(0,0), camRight(0,1), camRight(0,2), camRight(0,3));
+    printf("%f %f %f %f\n", camRight(1,0), camRight(1,1), camRight(1,2), camRight(1,3));
+    printf("%f %f %f %f\n", camRight(2,0), camRight(2,1), camRight(2,2), camRight(2,3));
+    printf("%f %f %f %f\n", camRight(3,0), camRight(3,1), camRight(3,2), camRight(3,3));*/
+
+    /*// Inicializa el puerto serie
+    m_serial.setPort(ports[1]);
+    m_serial.setBaudRate(115200);
+    if (m_serial.open(QIODevice::ReadWrite)) {
+        qDebug() << "Opened serial port";
+    }*/
+}
+
+
+
+///
+/// \brief Destructor.
+///
+Renderer::~Renderer()
+{
+    // Los objetos de OpenGL se borran con su contexto activo
+    makeCurrent();
+    for(QOpenGLTimerQuery& query : m_gpu_queries) {
+        query.destroy();
+    }
+    delete m_mesh;
+    delete m_wireframe;
+    delete m_views;
+    delete m_acc_cloud;
+    delete m_mag_cloud;
+    delete m_axes;
+    doneCurrent();
+}
+
+
+
+///
+/// \brief Renderer::initializeGL
+///
+void Renderer::initializeGL()
+{
+    // Los objetos de Render necesitan OpenGL 3.3; con un contexto anterior no se dibuja nada, porque
+    // las funciones que faltan serían punteros nulos
+    const QSurfaceFormat format = context()->format();
+    if(format.version() < qMakePair(3, 3)) {
+        m_error = QString("OpenGL 3.3 is required, the context is %1.%2")
+                .arg(format.majorVersion()).arg(format.minorVersion());
+    }
+    else if(!initializeOpenGLFunctions()) {
+        m_error = QString("Couldn't resolve the OpenGL 3.3 core functions of the %1.%2 context")
+                .arg(format.majorVersion()).arg(format.minorVersion());
+    }
+    if(!m_error.isEmpty()) {
+        qCritical() << m_error;
+        return;
+    }
+    m_ready = true;
+
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_CULL_FACE);
+    glPointSize(PointSize);
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+    // Render objects
+    m_axes = new Axes();
+    m_acc_cloud = new PointCloud();
+    m_mag_cloud = new PointCloud();
+    m_mesh = new StaticMesh();
+    m_mesh->load( QString(":/compassXYZ.mesh") );
+    m_wireframe = new Wireframe();
+    m_views = new ViewSet();
+
+    // Consultas de tiempo de la GPU, si el driver las admite
+    m_gpu_timing = true;
+    for(QOpenGLTimerQuery& query : m_gpu_queries) {
+        m_gpu_timing = query.create() && m_gpu_timing;
+    }
+}
+
+
+
+///
+/// \brief Renderer::resizeGL
+/// \param w
+/// \param h
+///
+void Renderer::resizeGL(int width, int height)
+{
+    // Set OpenGL viewport to cover whole widget
+    m_width = width;
+    m_height = height;
+    m_aspect = qreal(width) / qreal(height ? height : 1);
+    if(m_ready) glViewport(0, 0, width, height);
+
+    // Set perspective projection
+    const qreal zNear = 0.1, zFar = 1000.0, fov = 45.0;
+    m_perspective.setToIdentity();
+    m_perspective.perspective(fov, m_aspect, zNear, zFar);
+
+    // Con la fusión en el PC cada cuadrante se parte en dos mitades, con la mitad de relación de aspecto
+    m_perspective_half.setToIdentity();
+    m_perspective_half.perspective(fov, m_aspect / 2.0, zNear, zFar);
+
+    updateOrtho();
+}
+
+
+
+///
+/// \brief Recalcula la proyección ortográfica de las nubes con el zoom actual.
+///
+void Renderer::updateOrtho()
+{
+    const float half = 1.5f / m_zoom;
+    m_ortho.setToIdentity();
+    m_ortho.ortho(-half*2.0/3.0*m_aspect, +half*2.0/3.0*m_aspect, -half, +half, -2000.0, +2000.0);
+}
+
+
+
+///
+/// \brief Tamaño de un punto de las nubes en pantalla, en unidades de las medidas.
+/// \return 0 si no se usan los niveles de detalle, para dibujar las nubes enteras.
+///
+float Renderer::pointSpacing() const
+{
+    // Cada vista mide m_height/2 píxeles de alto y 3/m_zoom unidades
+    if(!m_level_of_detail) return 0.0f;
+    return PointSize * 3.0f / m_zoom / std::max(m_height / 2, 1);
+}
+
+
+
+///
+/// \brief Acerca o aleja las vistas de las nubes con la rueda del ratón.
+/// \param event Evento de la rueda.
+///
+void Renderer::wheelEvent(QWheelEvent* event)
+{
+    if(m_mode != Calibration) return;
+
+    // Un paso de la rueda son 120 unidades y acerca un 20%
+    m_zoom = std::min(std::max(m_zoom * std::pow(1.2f, event->angleDelta().y() / 120.0f), 1.0f), MaxZoom);
+    updateOrtho();
+    invalidate();
+    event->accept();
+}
+
+
+
+///
+/// \brief Renderer::paintGL
+///
+void Renderer::paintGL()
+{
+    // Sin OpenGL 3.3 sólo se muestra el error, con QPainter, que resuelve sus propias funciones
+    if(!m_ready) {
+        QPainter painter(this);
+        painter.fillRect(rect(), Qt::black);
+        painter.setPen(QColor(Qt::white));
+        painter.drawText(rect(), Qt::AlignCenter, m_error);
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    m_dirty = false;
+
+    // Cada fotograma usa una consulta; la de hace GpuQueries fotogramas ya suele tener el resultado
+    const int query = m_gpu_next;
+    m_gpu_next = (m_gpu_next + 1) % GpuQueries;
+    if(m_gpu_timing) {
+        if(m_gpu_issued[query]) readGpuTime(query);
+        m_gpu_queries[query].begin();
+    }
+
+    renderScene();
+    if(m_gpu_timing) {
+        m_gpu_queries[query].end();
+        m_gpu_issued[query] = true;
+    }
+
+    // Sólo el tiempo de preparar y enviar las órdenes; la GPU las ejecuta después
+    const qint64 time = timer.nsecsElapsed();
+    ++m_paint.m_frames;
+    m_paint.m_time += time;
+    m_paint.m_max_time = std::max(m_paint.m_max_time, time);
+
+    // Valores suavizados para el resumen en pantalla
+    if(m_frame_clock.isValid()) m_overlay_interval += 0.1 * (m_frame_clock.nsecsElapsed() - m_overlay_interval);
+    m_frame_clock.start();
+    m_overlay_cpu += 0.1 * (time - m_overlay_cpu);
+    if(m_overlay) renderOverlay();
+}
+
+
+
+///
+/// \brief Dibuja la escena del modo actual.
+///
+void Renderer::renderScene()
+{
+    // QPainter cambia el estado de OpenGL al dibujar el resumen de tiempos
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_CULL_FACE);
+    glViewport(0, 0, m_width, m_height);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    switch(m_mode) {
+        case Compass: renderMesh(); break;
+        case Calibration: renderClouds(); break;
+        default: break;
+    }
+}
+
+
+
+///
+/// \brief Mide el tiempo de CPU de dibujar la escena actual, sin presentarla.
+///
+/// Después de cada fotograma se espera a la GPU con glFinish(), fuera de la medida, para que la cola del
+/// driver no se llene y no se mida la espera.
+/// \param frames Número de fotogramas.
+/// \return Tiempo medio de CPU por fotograma, en ns.
+///
+double Renderer::benchmark(int frames)
+{
+    if(!m_ready) return 0.0;
+    makeCurrent();
+    qint64 total = 0;
+    QElapsedTimer timer;
+    for(int i=0 ; i<frames ; ++i) {
+        timer.start();
+        renderScene();
+        total += timer.nsecsElapsed();
+        glFinish();
+    }
+    doneCurrent();
+    return double(total) / std::max(frames, 1);
+}
+
+
+
+///
+/// \brief Indica si el contexto de OpenGL es válido para dibujar; sólo se sabe tras initializeGL().
+///
+bool Renderer::ready() const
+{
+    return m_ready;
+}
+
+
+
+///
+/// \brief Motivo por el que no se dibuja nada, vacío si ready() es verdadero o aún no se ha inicializado.
+///
+QString Renderer::errorString() const
+{
+    return m_error;
+}
+
+
+
+///
+/// \brief Recoge el resultado de una consulta de tiempo de la GPU, si ya está disponible.
+///
+/// Si todavía no lo está, se descarta para no esperar a la GPU; la consulta se vuelve a usar igualmente.
+/// \param query Índice de la consulta.
+///
+void Renderer::readGpuTime(int query)
+{
+    m_gpu_issued[query] = false;
+    if(!m_gpu_queries[query].isResultAvailable()) return;
+
+    const qint64 time = qint64(m_gpu_queries[query].waitForResult());
+    ++m_paint.m_gpu_frames;
+    m_paint.m_gpu_time += time;
+    m_paint.m_gpu_max_time = std::max(m_paint.m_gpu_max_time, time);
+    m_overlay_gpu += 0.1 * (time - m_overlay_gpu);
+}
+
+
+
+///
+/// \brief Escribe en la esquina superior izquierda los tiempos de CPU y GPU y el intervalo entre fotogramas.
+///
+void Renderer::renderOverlay()
+{
+    QString text;
+    text.sprintf("CPU %.2f ms | GPU %s | interval %.1f ms", m_overlay_cpu / 1e6,
+                 m_gpu_timing ? qPrintable(QString("%1 ms").arg(m_overlay_gpu / 1e6, 0, 'f', 2)) : "-",
+                 m_overlay_interval / 1e6);
+
+    QPainter painter(this);
+    painter.setFont(QFont("Courier", 10));
+    painter.setPen(QColor(Qt::white));
+    painter.drawText(8, 16, text);
+}
+
+
+
+///
+/// \brief Marca la escena como sucia y pide un fotograma, salvo que haya uno pendiente de presentarse.
+///
+void Renderer::invalidate()
+{
+    m_dirty = true;
+    if(!m_frame_pending) {
+        m_frame_pending = true;
+        update();
+    }
+}
+
+
+
+///
+/// \brief Se ha presentado un fotograma: si la escena ha cambiado mientras tanto, se pide el siguiente.
+///
+void Renderer::presented()
+{
+    m_frame_pending = false;
+    if(m_dirty) {
+        m_frame_pending = true;
+        update();
+    }
+}
+
+
+
+///
+/// \brief Muestra u oculta el resumen de tiempos de cada fotograma.
+/// \param visible Verdadero para mostrar los tiempos de CPU y GPU y el intervalo entre fotogramas.
+///
+void Renderer::setFrameStats(bool visible)
+{
+    m_overlay = visible;
+    invalidate();
+}
+
+
+
+///
+/// \brief Activa o desactiva los niveles de detalle de las nubes de puntos.
+/// \param enabled Verdadero para dibujar sólo los puntos que se distinguen con el zoom actual, falso
+/// para dibujar siempre las nubes enteras.
+///
+void Renderer::setLevelOfDetail(bool enabled)
+{
+    m_level_of_detail = enabled;
+    invalidate();
+}
+
+
+
+///
+/// \brief Cambia el modo de funcionamiento del renderizador.
+/// \param mode Nuevo modo.
+///
+void Renderer::setMode(IMUMode mode)
+{
+    m_mode = mode;
+    invalidate();
+}
+
+
+
+///
+/// \brief Actualiza la orientación del IMU.
+/// \param quat Nueva orientación.
+///
+void Renderer::setOrientation(QMatrix4x4 ori)
+{
+    m_orientation = ori;
+    invalidate();
+}
+
+
+
+///
+/// \brief Actualiza la orientación calculada en el PC.
+/// \param ori Nueva orientación.
+///
+void Renderer::setHostOrientation(QMatrix4x4 ori)
+{
+    m_host_orientation = ori;
+    invalidate();
+}
+
+
+
+///
+/// \brief Muestra u oculta, junto a la del IMU, la orientación calculada en el PC.
+/// \param visible Verdadero para partir cada vista en dos: IMU a la izquierda y PC a la derecha.
+///
+void Renderer::setHostFusion(bool visible)
+{
+    m_host_visible = visible;
+    invalidate();
+}
+
+
+
+///
+/// \brief Elige cómo se dibujan las vistas.
+/// \param enabled Verdadero para dibujar cada objeto en todas sus vistas con una llamada; falso para una
+/// llamada por vista.
+///
+void Renderer::setSinglePass(bool enabled)
+{
+    m_single_pass = enabled;
+    invalidate();
+}
+
+
+
+///
+/// \brief Actualiza las nubes de puntos del acelerómetro y del magnetómetro; se llama una vez por fotograma.
+///
+/// Al añadir, sólo se suben a la GPU los puntos nuevos del final: los anteriores tienen que ser los
+/// mismos que en la llamada anterior.
+/// \param acc Puntos del acelerómetro.
+/// \param mag Puntos del magnetómetro.
+/// \param append Verdadero si las nubes sólo han crecido por el final, falso para sustituirlas.
+///
+void Renderer::setClouds(const std::vector<QVector3D>& acc, const std::vector<QVector3D>& mag, bool append)
+{
+    // Las nubes se crean con el contexto; hasta entonces no hay nada que subir
+    if(!m_acc_cloud || !m_mag_cloud) return;
+
+    makeCurrent();
+    QElapsedTimer timer;
+    timer.start();
+    const quint64 bytes = m_acc_cloud->uploadedBytes() + m_mag_cloud->uploadedBytes();
+    const quint64 reallocations = m_acc_cloud->reallocations() + m_mag_cloud->reallocations();
+    if(append) {
+        m_acc_cloud->append(acc);
+        m_mag_cloud->append(mag);
+    }
+    else {
+        m_acc_cloud->update(acc);
+        m_mag_cloud->update(mag);
+    }
+    const qint64 time = timer.nsecsElapsed();
+    doneCurrent();
+
+    ++m_upload.m_frames;
+    m_upload.m_bytes += m_acc_cloud->uploadedBytes() + m_mag_cloud->uploadedBytes() - bytes;
+    m_upload.m_reallocations += m_acc_cloud->reallocations() + m_mag_cloud->reallocations() - reallocations;
+    m_upload.m_time += time;
+    m_upload.m_max_time = std::max(m_upload.m_max_time, time);
+    invalidate();
+}
+
+
+
+///
+/// \brief Subidas de las nubes de puntos desde el último resetUploadStats().
+///
+const UploadStats& Renderer::uploadStats() const
+{
+    return m_upload;
+}
+
+
+
+///
+/// \brief Pone a cero los contadores de subidas de las nubes de puntos.
+///
+void Renderer::resetUploadStats()
+{
+    m_upload = UploadStats();
+}
+
+
+
+///
+/// \brief Tiempo de CPU de paintGL() desde el último resetPaintStats().
+///
+const PaintStats& Renderer::paintStats() const
+{
+    return m_paint;
+}
+
+
+
+///
+/// \brief Pone a cero el tiempo de CPU de paintGL().
+///
+void Renderer::resetPaintStats()
+{
+    m_paint = PaintStats();
+}
+
+
+
+///
+/// \brief Muestra sobre las nubes de puntos las elipsoides del ajuste provisional.
+/// \param acc Corrección provisional del acelerómetro.
+/// \param mag Corrección provisional del magnetómetro.
+///
+void Renderer::setFitPreview(const QMatrix4x4& acc, const QMatrix4x4& mag)
+{
+    // La elipsoide es la imagen de la esfera unidad por la inversa de la corrección
+    m_acc_fit = acc.inverted(&m_fit_visible);
+    bool visible = false;
+    m_mag_fit = mag.inverted(&visible);
+    m_fit_visible = m_fit_visible && visible;
+    invalidate();
+}
+
+
+
+///
+/// \brief Oculta las elipsoides del ajuste provisional.
+///
+void Renderer::clearFitPreview()
+{
+    m_fit_visible = false;
+    invalidate();
+}
+
+
+
+///
+/// \brief Renderiza la malla del IMU con la orientación calculada en los cuatro cuadrantes.
+///
+/// Las vistas 0 a 3 son las de la orientación del IMU y, con la fusión en el PC, las 4 a 7 las de la
+/// calculada en el PC, en la mitad derecha de cada cuadrante. En una sola pasada, cada objeto se dibuja
+/// en todas sus vistas con una llamada; si no, con una llamada por vista.
+///
+void Renderer::renderMesh()
+{
+    const QMatrix4x4* cameras[] = { &camSide, &camFront, &camTop, &cam3D };
+    const int w = m_width / 2, h = m_height / 2;
+    const int x[] = { 0, w, 0, w }, y[] = { h, h, 0, 0 };
+
+    m_views->clear();
+    if(!m_host_visible) {
+        for(int i=0 ; i<4 ; ++i) m_views->add(m_perspective * *cameras[i], x[i], y[i], w, h);
+    }
+    else {
+        for(int i=0 ; i<4 ; ++i) m_views->add(m_perspective_half * *cameras[i], x[i], y[i], w / 2, h);
+        for(int i=0 ; i<4 ; ++i) m_views->add(m_perspective_half * *cameras[i], x[i] + w / 2, y[i], w - w / 2, h);
+    }
+
+    m_views->bind(m_width, m_height);
+    if(m_single_pass) {
+        m_axes->render(0, m_views->size());
+        m_mesh->render(0, 4, m_orientation);
+        if(m_host_visible) m_mesh->render(4, 4, m_host_orientation, QVector3D(0.6f, 0.8f, 1.0f));
+    }
+    else {
+        for(int i=0 ; i<4 ; ++i) {
+            m_axes->render(i, 1);
+            m_mesh->render(i, 1, m_orientation);
+            if(!m_host_visible) continue;
+            m_axes->render(i + 4, 1);
+            m_mesh->render(i + 4, 1, m_host_orientation, QVector3D(0.6f, 0.8f, 1.0f));
+        }
+    }
+    m_views->release();
+}
+
+
+
+///
+/// \brief Renderiza las nubes de puntos y, si lo hay, el ajuste provisional.
+///
+/// Las vistas 0 a 2 son las del magnetómetro, en la fila de arriba, y las 3 a 5 las del acelerómetro,
+/// en la de abajo. En una sola pasada, cada objeto se dibuja en sus vistas con una llamada; si no, con
+/// una llamada por vista.
+///
+void Renderer::renderClouds()
+{
+    const QMatrix4x4* cameras[] = { &camTop, &camSide, &camFront };
+    const QVector4D white(1.0f, 1.0f, 1.0f, 1.0f);
+    const float spacing = pointSpacing();
+
+    m_views->clear();
+    for(int row=0 ; row<2 ; ++row) {
+        for(int i=0 ; i<3 ; ++i) {
+            m_views->add(m_ortho * *cameras[i], i * m_width / 3, row ? 0 : m_height / 2, m_width / 3, m_height / 2);
+        }
+    }
+
+    m_views->bind(m_width, m_height);
+    if(m_single_pass) {
+        m_axes->render(0, 6);
+        m_paint.m_points += m_mag_cloud->render(0, 3, spacing);
+        m_paint.m_points += m_acc_cloud->render(3, 3, spacing);
+        if(m_fit_visible) {
+            m_wireframe->render(0, 3, m_mag_fit, white);
+            m_wireframe->render(3, 3, m_acc_fit, white);
+        }
+    }
+    else {
+        for(int i=0 ; i<6 ; ++i) {
+            m_axes->render(i, 1);
+            m_paint.m_points += ((i < 3) ? m_mag_cloud : m_acc_cloud)->render(i, 1, spacing);
+            if(m_fit_visible) m_wireframe->render(i, 1, (i < 3) ? m_mag_fit : m_acc_fit, white);
+        }
+    }
+    m_views->release();
+}
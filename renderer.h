@@ -1,50 +1,142 @@
-#pragma once
-
-#include <QOpenGLWidget>
-
-#include "Render/types.h"
-
-class Axes;
-class PointCloud;
-class StaticMesh;
-
-
-
-///
-/// \brief The Renderer class
-///
-class Renderer : public QOpenGLWidget, protected QGLFunctions
-{
-    Q_OBJECT
-
-public:
-    explicit Renderer(QWidget *parent = 0);
-    ~Renderer();
-
-public slots:
-    void setOrientation(QMatrix4x4 ori);
-    void setAccCloud(const std::vector<QVector3D>& cloud);
-    void setMagCloud(const std::vector<QVector3D>& cloud);
-    void setMode(IMUMode mode);
-
-protected:
-    void initializeGL();
-    void resizeGL(int width, int height);
-    void paintGL();
-
-private:
-    int m_width, m_height;
-    float m_aspect;
-    IMUMode m_mode;
-    QMatrix4x4 m_perspective;
-    QMatrix4x4 m_ortho;
-
-    Axes* m_axes;
-    PointCloud* m_acc_cloud;
-    PointCloud* m_mag_cloud;
-    StaticMesh* m_mesh;
-    QMatrix4x4 m_orientation;
-
-    void renderMesh();
-    void renderClouds();
-};
+#pragma once
+
+#include <QElapsedTimer>
+#include <QOpenGLFunctions_3_3_Core>
+#include <QOpenGLTimerQuery>
+#include <QOpenGLWidget>
+
+#include "Render/types.h"
+
+class Axes;
+class PointCloud;
+class StaticMesh;
+class ViewSet;
+class Wireframe;
+
+
+
+///
+/// \brief Subidas de las nubes de puntos a la GPU, acumuladas desde el último resetUploadStats().
+///
+struct UploadStats
+{
+    quint64 m_frames;
+    quint64 m_bytes;
+    qint64 m_time;
+    qint64 m_max_time;
+    quint64 m_reallocations;
+};
+
+
+
+///
+/// \brief Fotogramas dibujados, tiempos de CPU y de GPU y puntos de las nubes dibujados, acumulados
+/// desde el último resetPaintStats().
+///
+/// El tiempo de CPU es el de paintGL(); el de GPU, el de sus órdenes medido con consultas de tiempo,
+/// que llegan con unos fotogramas de retraso y sólo si el driver las admite.
+///
+struct PaintStats
+{
+    quint64 m_frames;
+    qint64 m_time;
+    qint64 m_max_time;
+    quint64 m_points;
+    quint64 m_gpu_frames;
+    qint64 m_gpu_time;
+    qint64 m_gpu_max_time;
+};
+
+
+
+///
+/// \brief The Renderer class
+///
+/// Sólo se redibuja cuando cambia algo de lo que se muestra: cada cambio marca la escena como sucia y
+/// pide un fotograma, pero no se pide otro hasta que el anterior se ha presentado, así que los
+/// fotogramas van al ritmo del sincronismo vertical y no se acumulan.
+///
+class Renderer : public QOpenGLWidget, protected QOpenGLFunctions_3_3_Core
+{
+    Q_OBJECT
+
+public:
+    static const int GpuQueries = 3;
+
+    explicit Renderer(QWidget *parent = 0);
+    ~Renderer();
+    const UploadStats& uploadStats() const;
+    void resetUploadStats();
+    const PaintStats& paintStats() const;
+    void resetPaintStats();
+    double benchmark(int frames);
+    bool ready() const;
+    QString errorString() const;
+
+public slots:
+    void setOrientation(QMatrix4x4 ori);
+    void setHostOrientation(QMatrix4x4 ori);
+    void setHostFusion(bool visible);
+    void setSinglePass(bool enabled);
+    void setLevelOfDetail(bool enabled);
+    void setFrameStats(bool visible);
+    void setClouds(const std::vector<QVector3D>& acc, const std::vector<QVector3D>& mag, bool append);
+    void setFitPreview(const QMatrix4x4& acc, const QMatrix4x4& mag);
+    void clearFitPreview();
+    void setMode(IMUMode mode);
+
+protected:
+    void initializeGL();
+    void resizeGL(int width, int height);
+    void paintGL();
+    void wheelEvent(QWheelEvent* event);
+
+private slots:
+    void presented();
+
+private:
+    int m_width, m_height;
+    float m_aspect;
+    float m_zoom;
+    IMUMode m_mode;
+    QMatrix4x4 m_perspective;
+    QMatrix4x4 m_perspective_half;
+    QMatrix4x4 m_ortho;
+
+    Axes* m_axes;
+    PointCloud* m_acc_cloud;
+    PointCloud* m_mag_cloud;
+    StaticMesh* m_mesh;
+    Wireframe* m_wireframe;
+    ViewSet* m_views;
+    bool m_ready;
+    QString m_error;
+    bool m_single_pass;
+    bool m_level_of_detail;
+    QMatrix4x4 m_orientation;
+    QMatrix4x4 m_host_orientation;
+    bool m_host_visible;
+    bool m_fit_visible;
+    QMatrix4x4 m_acc_fit, m_mag_fit;
+    UploadStats m_upload;
+    PaintStats m_paint;
+
+    bool m_dirty;
+    bool m_frame_pending;
+    bool m_overlay;
+    QOpenGLTimerQuery m_gpu_queries[GpuQueries];
+    bool m_gpu_issued[GpuQueries];
+    bool m_gpu_timing;
+    int m_gpu_next;
+    QElapsedTimer m_frame_clock;
+    double m_overlay_cpu, m_overlay_gpu, m_overlay_interval;
+
+    void invalidate();
+    void readGpuTime(int query);
+    void renderOverlay();
+    void updateOrtho();
+    float pointSpacing() const;
+    void renderScene();
+    void renderMesh();
+    void renderClouds();
+};
@@ -0,0 +1,90 @@
+#include "samplering.h"
+
+
+
+///
+/// \brief Constructor.
+///
+SampleRing::SampleRing() : m_head(0), m_tail(0), m_overflows(0), m_armed(false)
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+}
+
+
+
+///
+/// \brief Añade una muestra a la cola. Solo debe llamarse desde el hilo productor.
+/// \param sample Muestra.
+/// \return Falso si la cola estaba llena y la muestra se ha descartado.
+///
+bool SampleRing::push(const TelemetrySample& sample)
+{
+    const uint32_t head = m_head.load(std::memory_order_relaxed);
+    if (head - m_tail.load(std::memory_order_acquire) == Capacity) {
+        m_overflows.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    m_samples[head & (Capacity - 1)] = sample;
+    m_head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+
+
+///
+/// \brief Extrae la muestra más antigua. Solo debe llamarse desde el hilo consumidor.
+/// \param sample Muestra extraída.
+/// \return Falso si la cola está vacía.
+///
+bool SampleRing::pop(TelemetrySample& sample)
+{
+    const uint32_t tail = m_tail.load(std::memory_order_relaxed);
+    if (tail == m_head.load(std::memory_order_acquire)) {
+        return false;
+    }
+    sample = m_samples[tail & (Capacity - 1)];
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+
+
+///
+/// \brief Indica si la cola está llena. Solo tiene sentido desde el hilo productor.
+/// \return Verdadero si el siguiente push() descartaría la muestra.
+///
+bool SampleRing::full() const
+{
+    return m_head.load(std::memory_order_relaxed) - m_tail.load(std::memory_order_acquire) == Capacity;
+}
+
+
+
+///
+/// \brief Marca que hay datos pendientes. Lo llama el productor después de push().
+/// \return Verdadero si el consumidor no había sido avisado todavía y hay que despertarle.
+///
+bool SampleRing::arm()
+{
+    return !m_armed.exchange(true, std::memory_order_acq_rel);
+}
+
+
+
+///
+/// \brief Rearma el aviso. Lo llama el consumidor justo antes de vaciar la cola.
+///
+void SampleRing::disarm()
+{
+    m_armed.store(false, std::memory_order_release);
+}
+
+
+
+///
+/// \brief Número de muestras descartadas por tener la cola llena.
+///
+uint64_t SampleRing::overflows() const
+{
+    return m_overflows.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "Render/types.h"
+
+
+
+///
+/// \brief Cola circular de muestras entre un único productor y un único consumidor, sin bloqueos.
+///
+/// El hilo del puerto serie escribe y la interfaz gráfica lee una vez por fotograma. Si la cola está llena,
+/// la muestra se descarta y se incrementa el contador de desbordamientos. El aviso al consumidor se
+/// agrupa: solo se pide despertarle una vez hasta que vuelve a vaciar la cola.
+///
+class SampleRing
+{
+public:
+    static const uint32_t Capacity = 8192;
+
+    SampleRing();
+    bool push(const TelemetrySample& sample);
+    bool pop(TelemetrySample& sample);
+    bool full() const;
+    bool arm();
+    void disarm();
+    uint64_t overflows() const;
+
+private:
+    TelemetrySample m_samples[Capacity];
+    alignas(64) std::atomic<uint32_t> m_head;
+    alignas(64) std::atomic<uint32_t> m_tail;
+    alignas(64) std::atomic<uint64_t> m_overflows;
+    std::atomic<bool> m_armed;
+};
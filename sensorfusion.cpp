@@ -0,0 +1,578 @@
+#include "sensorfusion.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+
+
+static const float SQRT_HALF = 0.70710678118654752f;
+
+// Los pasos de los filtros tienen que expandirse dentro del bucle de FusionBank para que se vectorice
+#if defined(__GNUC__)
+#define FUSION_INLINE inline __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#define FUSION_INLINE __forceinline
+#else
+#define FUSION_INLINE inline
+#endif
+
+
+
+///
+/// \brief Inverso de la raíz de un número, o 0 si no es positivo.
+///
+/// Es la aproximación inicial por bits de siempre seguida de tres iteraciones de Newton, que la dejan
+/// a un par de ulp de 1/√x. No llama a std::sqrt, que sin -fno-math-errno tiene un salto para errno, y
+/// el resultado se elige al final sin saltos: el bucle de FusionBank se vectoriza sin cambiar las
+/// opciones de coma flotante del resto de la aplicación.
+///
+static inline float InverseRoot(float value)
+{
+    // Con los bits como entero, los números positivos se ordenan igual que los reales y las comparaciones
+    // no pueden lanzar excepciones de coma flotante
+    int32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    const int32_t valid = ((bits > 0) && (bits <= 0x7f800000)) ? -1 : 0;
+    bits = (bits < 0x00800000) ? 0x00800000 : ((bits > 0x7f7fffff) ? 0x7f7fffff : bits);
+    float x;
+    std::memcpy(&x, &bits, sizeof(x));
+
+    bits = 0x5f375a86 - (bits >> 1);
+    float recip;
+    std::memcpy(&recip, &bits, sizeof(recip));
+    const float half = 0.5f * x;
+    recip *= 1.5f - half * recip * recip;
+    recip *= 1.5f - half * recip * recip;
+    recip *= 1.5f - half * recip * recip;
+
+    std::memcpy(&bits, &recip, sizeof(bits));
+    bits &= valid;
+    std::memcpy(&recip, &bits, sizeof(recip));
+    return recip;
+}
+
+
+
+///
+/// \brief Raíz de un número, o 0 si no es positivo; sin saltos, como InverseRoot().
+///
+static inline float Root(float value)
+{
+    return value * InverseRoot(value);
+}
+
+
+
+///
+/// \brief Inverso de la norma de un vector, o 0 si es nulo.
+///
+static inline float InverseNorm(float x, float y, float z)
+{
+    return InverseRoot(x * x + y * y + z * z);
+}
+
+
+
+///
+/// \brief Normaliza un cuaternión.
+///
+static inline void Normalize(float& q0, float& q1, float& q2, float& q3)
+{
+    const float recip = InverseRoot(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+    q0 *= recip;
+    q1 *= recip;
+    q2 *= recip;
+    q3 *= recip;
+}
+
+
+
+///
+/// \brief Un paso del filtro de Madgwick con magnetómetro.
+///
+/// Es el algoritmo publicado, con los mismos nombres, salvo que las comprobaciones de medidas nulas
+/// se hacen con máscaras: sin acelerómetro no hay corrección, y sin magnetómetro sus términos del
+/// gradiente se anulan y queda el filtro de sólo acelerómetro.
+/// \param q0, q1, q2, q3 Orientación, sensor respecto a norte-oeste-arriba.
+/// \param gx, gy, gz Giróscopo, radianes/s.
+/// \param ax, ay, az Acelerómetro, en cualquier escala.
+/// \param mx, my, mz Magnetómetro, en cualquier escala.
+/// \param beta Ganancia del gradiente.
+/// \param dt Periodo, en segundos.
+///
+static FUSION_INLINE void MadgwickStep(float& q0, float& q1, float& q2, float& q3,
+                                float gx, float gy, float gz, float ax, float ay, float az,
+                                float mx, float my, float mz, float beta, float dt)
+{
+    // Derivada del cuaternión según el giróscopo
+    float qDot1 = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
+    float qDot2 = 0.5f * (q0 * gx + q2 * gz - q3 * gy);
+    float qDot3 = 0.5f * (q0 * gy - q1 * gz + q3 * gx);
+    float qDot4 = 0.5f * (q0 * gz + q1 * gy - q2 * gx);
+
+    const float accRecip = InverseNorm(ax, ay, az);
+    const float accValid = (accRecip > 0.0f) ? 1.0f : 0.0f;
+    ax *= accRecip;
+    ay *= accRecip;
+    az *= accRecip;
+    const float magRecip = InverseNorm(mx, my, mz);
+    mx *= magRecip;
+    my *= magRecip;
+    mz *= magRecip;
+
+    const float _2q0mx = 2.0f * q0 * mx;
+    const float _2q0my = 2.0f * q0 * my;
+    const float _2q0mz = 2.0f * q0 * mz;
+    const float _2q1mx = 2.0f * q1 * mx;
+    const float _2q0 = 2.0f * q0;
+    const float _2q1 = 2.0f * q1;
+    const float _2q2 = 2.0f * q2;
+    const float _2q3 = 2.0f * q3;
+    const float _2q0q2 = 2.0f * q0 * q2;
+    const float _2q2q3 = 2.0f * q2 * q3;
+    const float q0q0 = q0 * q0;
+    const float q0q1 = q0 * q1;
+    const float q0q2 = q0 * q2;
+    const float q0q3 = q0 * q3;
+    const float q1q1 = q1 * q1;
+    const float q1q2 = q1 * q2;
+    const float q1q3 = q1 * q3;
+    const float q2q2 = q2 * q2;
+    const float q2q3 = q2 * q3;
+    const float q3q3 = q3 * q3;
+
+    // Dirección de referencia del campo magnético
+    const float hx = mx * q0q0 - _2q0my * q3 + _2q0mz * q2 + mx * q1q1 + _2q1 * my * q2 + _2q1 * mz * q3 - mx * q2q2 - mx * q3q3;
+    const float hy = _2q0mx * q3 + my * q0q0 - _2q0mz * q1 + _2q1mx * q2 - my * q1q1 + my * q2q2 + _2q2 * mz * q3 - my * q3q3;
+    const float _2bx = Root(hx * hx + hy * hy);
+    const float _2bz = -_2q0mx * q2 + _2q0my * q1 + mz * q0q0 + _2q1mx * q3 - mz * q1q1 + _2q2 * my * q3 - mz * q2q2 + mz * q3q3;
+    const float _4bx = 2.0f * _2bx;
+    const float _4bz = 2.0f * _2bz;
+
+    // Paso del descenso de gradiente
+    const float fax = 2.0f * q1q3 - _2q0q2 - ax;
+    const float fay = 2.0f * q0q1 + _2q2q3 - ay;
+    const float faz = 1.0f - 2.0f * q1q1 - 2.0f * q2q2 - az;
+    const float fmx = _2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx;
+    const float fmy = _2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my;
+    const float fmz = _2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz;
+    float s0 = -_2q2 * fax + _2q1 * fay - _2bz * q2 * fmx + (-_2bx * q3 + _2bz * q1) * fmy + _2bx * q2 * fmz;
+    float s1 = _2q3 * fax + _2q0 * fay - 2.0f * _2q1 * faz + _2bz * q3 * fmx + (_2bx * q2 + _2bz * q0) * fmy + (_2bx * q3 - _4bz * q1) * fmz;
+    float s2 = -_2q0 * fax + _2q3 * fay - 2.0f * _2q2 * faz + (-_4bx * q2 - _2bz * q0) * fmx + (_2bx * q1 + _2bz * q3) * fmy + (_2bx * q0 - _4bz * q2) * fmz;
+    float s3 = _2q1 * fax + _2q2 * fay + (-_4bx * q3 + _2bz * q1) * fmx + (-_2bx * q0 + _2bz * q2) * fmy + _2bx * q1 * fmz;
+    const float sRecip = accValid * InverseRoot(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3);
+    qDot1 -= beta * s0 * sRecip;
+    qDot2 -= beta * s1 * sRecip;
+    qDot3 -= beta * s2 * sRecip;
+    qDot4 -= beta * s3 * sRecip;
+
+    q0 += qDot1 * dt;
+    q1 += qDot2 * dt;
+    q2 += qDot3 * dt;
+    q3 += qDot4 * dt;
+    Normalize(q0, q1, q2, q3);
+}
+
+
+
+///
+/// \brief Un paso del filtro de Mahony con magnetómetro.
+///
+/// Es el algoritmo publicado, con las mismas máscaras que MadgwickStep(). El término integral se
+/// acumula siempre; con ki = 0 queda a cero.
+/// \param q0, q1, q2, q3 Orientación, sensor respecto a norte-oeste-arriba.
+/// \param ix, iy, iz Término integral, radianes/s.
+/// \param gx, gy, gz Giróscopo, radianes/s.
+/// \param ax, ay, az Acelerómetro, en cualquier escala.
+/// \param mx, my, mz Magnetómetro, en cualquier escala.
+/// \param kp Ganancia proporcional.
+/// \param ki Ganancia integral.
+/// \param dt Periodo, en segundos.
+///
+static FUSION_INLINE void MahonyStep(float& q0, float& q1, float& q2, float& q3, float& ix, float& iy, float& iz,
+                              float gx, float gy, float gz, float ax, float ay, float az,
+                              float mx, float my, float mz, float kp, float ki, float dt)
+{
+    const float accRecip = InverseNorm(ax, ay, az);
+    const float accValid = (accRecip > 0.0f) ? 1.0f : 0.0f;
+    ax *= accRecip;
+    ay *= accRecip;
+    az *= accRecip;
+    const float magRecip = InverseNorm(mx, my, mz);
+    mx *= magRecip;
+    my *= magRecip;
+    mz *= magRecip;
+
+    const float q0q0 = q0 * q0;
+    const float q0q1 = q0 * q1;
+    const float q0q2 = q0 * q2;
+    const float q0q3 = q0 * q3;
+    const float q1q1 = q1 * q1;
+    const float q1q2 = q1 * q2;
+    const float q1q3 = q1 * q3;
+    const float q2q2 = q2 * q2;
+    const float q2q3 = q2 * q3;
+    const float q3q3 = q3 * q3;
+
+    // Dirección de referencia del campo magnético
+    const float hx = 2.0f * (mx * (0.5f - q2q2 - q3q3) + my * (q1q2 - q0q3) + mz * (q1q3 + q0q2));
+    const float hy = 2.0f * (mx * (q1q2 + q0q3) + my * (0.5f - q1q1 - q3q3) + mz * (q2q3 - q0q1));
+    const float bx = Root(hx * hx + hy * hy);
+    const float bz = 2.0f * (mx * (q1q3 - q0q2) + my * (q2q3 + q0q1) + mz * (0.5f - q1q1 - q2q2));
+
+    // Direcciones estimadas de la gravedad y del campo magnético
+    const float halfvx = q1q3 - q0q2;
+    const float halfvy = q0q1 + q2q3;
+    const float halfvz = q0q0 - 0.5f + q3q3;
+    const float halfwx = bx * (0.5f - q2q2 - q3q3) + bz * (q1q3 - q0q2);
+    const float halfwy = bx * (q1q2 - q0q3) + bz * (q0q1 + q2q3);
+    const float halfwz = bx * (q0q2 + q1q3) + bz * (0.5f - q1q1 - q2q2);
+
+    // Error: producto vectorial entre las direcciones estimadas y las medidas
+    const float halfex = accValid * ((ay * halfvz - az * halfvy) + (my * halfwz - mz * halfwy));
+    const float halfey = accValid * ((az * halfvx - ax * halfvz) + (mz * halfwx - mx * halfwz));
+    const float halfez = accValid * ((ax * halfvy - ay * halfvx) + (mx * halfwy - my * halfwx));
+
+    ix += 2.0f * ki * halfex * dt;
+    iy += 2.0f * ki * halfey * dt;
+    iz += 2.0f * ki * halfez * dt;
+    gx += ix + 2.0f * kp * halfex;
+    gy += iy + 2.0f * kp * halfey;
+    gz += iz + 2.0f * kp * halfez;
+
+    gx *= 0.5f * dt;
+    gy *= 0.5f * dt;
+    gz *= 0.5f * dt;
+    const float qa = q0, qb = q1, qc = q2;
+    q0 += -qb * gx - qc * gy - q3 * gz;
+    q1 += qa * gx + qc * gz - q3 * gy;
+    q2 += qa * gy - qb * gz + q3 * gx;
+    q3 += qa * gz + qb * gy - qc * gx;
+    Normalize(q0, q1, q2, q3);
+}
+
+
+
+///
+/// \brief Orientación a partir de una medida del acelerómetro y otra del magnetómetro (TRIAD).
+/// \param acc Acelerómetro.
+/// \param mag Magnetómetro.
+/// \param q Orientación, sensor respecto a norte-oeste-arriba; la identidad si las medidas no sirven.
+///
+static void Align(const QVector3D& acc, const QVector3D& mag, float q[4])
+{
+    // Ejes de la tierra en ejes del sensor
+    const QVector3D up = acc.normalized();
+    const QVector3D west = QVector3D::crossProduct(up, mag).normalized();
+    const QVector3D north = QVector3D::crossProduct(west, up);
+    q[0] = 1.0f;
+    q[1] = q[2] = q[3] = 0.0f;
+    if(up.isNull() || west.isNull()) return;
+
+    // Matriz de giro del sensor a la tierra: sus filas son los ejes de la tierra
+    const float m[3][3] = {
+        { north.x(), north.y(), north.z() },
+        { west.x(), west.y(), west.z() },
+        { up.x(), up.y(), up.z() }
+    };
+    const float trace = m[0][0] + m[1][1] + m[2][2];
+    if(trace > 0.0f) {
+        const float s = 2.0f * std::sqrt(1.0f + trace);
+        q[0] = 0.25f * s;
+        q[1] = (m[2][1] - m[1][2]) / s;
+        q[2] = (m[0][2] - m[2][0]) / s;
+        q[3] = (m[1][0] - m[0][1]) / s;
+    }
+    else if((m[0][0] > m[1][1]) && (m[0][0] > m[2][2])) {
+        const float s = 2.0f * std::sqrt(1.0f + m[0][0] - m[1][1] - m[2][2]);
+        q[0] = (m[2][1] - m[1][2]) / s;
+        q[1] = 0.25f * s;
+        q[2] = (m[0][1] + m[1][0]) / s;
+        q[3] = (m[0][2] + m[2][0]) / s;
+    }
+    else if(m[1][1] > m[2][2]) {
+        const float s = 2.0f * std::sqrt(1.0f + m[1][1] - m[0][0] - m[2][2]);
+        q[0] = (m[0][2] - m[2][0]) / s;
+        q[1] = (m[0][1] + m[1][0]) / s;
+        q[2] = 0.25f * s;
+        q[3] = (m[1][2] + m[2][1]) / s;
+    }
+    else {
+        const float s = 2.0f * std::sqrt(1.0f + m[2][2] - m[0][0] - m[1][1]);
+        q[0] = (m[1][0] - m[0][1]) / s;
+        q[1] = (m[0][2] + m[2][0]) / s;
+        q[2] = (m[1][2] + m[2][1]) / s;
+        q[3] = 0.25f * s;
+    }
+    Normalize(q[0], q[1], q[2], q[3]);
+}
+
+
+
+///
+/// \brief Pasa una orientación de norte-oeste-arriba a ENU, girándola 90° sobre la vertical.
+///
+static QQuaternion ToEnu(float q0, float q1, float q2, float q3)
+{
+    return QQuaternion(SQRT_HALF * (q0 - q3), SQRT_HALF * (q1 - q2), SQRT_HALF * (q2 + q1), SQRT_HALF * (q3 + q0));
+}
+
+
+
+///
+/// \brief Ángulo entre dos orientaciones.
+/// \return Ángulo del giro que lleva una a la otra, en grados.
+///
+float AngleBetween(const QQuaternion& a, const QQuaternion& b)
+{
+    const float dot = std::fabs(a.scalar() * b.scalar() + a.x() * b.x() + a.y() * b.y() + a.z() * b.z());
+    return 2.0f * std::acos(std::min(dot, 1.0f)) * 180.0f / 3.14159265358979f;
+}
+
+
+
+///
+/// \brief Constructor, con el filtro de Madgwick.
+///
+SensorFusion::SensorFusion() :
+    m_filter(FusionMadgwick),
+    m_beta(DefaultBeta),
+    m_kp(DefaultKp),
+    m_ki(DefaultKi)
+{
+    reset();
+}
+
+
+
+///
+/// \brief Elige el filtro; no reinicia la orientación.
+///
+void SensorFusion::setFilter(FusionFilter filter)
+{
+    m_filter = filter;
+}
+
+
+
+///
+/// \brief Filtro elegido.
+///
+FusionFilter SensorFusion::filter() const
+{
+    return m_filter;
+}
+
+
+
+///
+/// \brief Cambia las ganancias de los filtros.
+/// \param beta Ganancia del gradiente, en Madgwick.
+/// \param kp Ganancia proporcional, en Mahony.
+/// \param ki Ganancia integral, en Mahony.
+///
+void SensorFusion::setGains(float beta, float kp, float ki)
+{
+    m_beta = beta;
+    m_kp = kp;
+    m_ki = ki;
+}
+
+
+
+///
+/// \brief Vuelve a empezar: la próxima medida orienta el filtro.
+///
+void SensorFusion::reset()
+{
+    m_q[0] = 1.0f;
+    m_q[1] = m_q[2] = m_q[3] = 0.0f;
+    m_integral[0] = m_integral[1] = m_integral[2] = 0.0f;
+    m_count = 0;
+    m_last_time = 0;
+    m_period = 0.0;
+}
+
+
+
+///
+/// \brief Añade una medida, con el periodo estimado de las marcas de tiempo.
+/// \param gyr Giróscopo calibrado, radianes/s.
+/// \param acc Acelerómetro calibrado.
+/// \param mag Magnetómetro calibrado.
+/// \param timestamp Instante de llegada, en ns.
+///
+void SensorFusion::update(const QVector3D& gyr, const QVector3D& acc, const QVector3D& mag, qint64 timestamp)
+{
+    // Media de los intervalos, acumulada al principio y móvil después
+    if(m_count) {
+        const double delta = std::min(std::max((timestamp - m_last_time) / 1e9, 0.0), MaxPeriod);
+        m_period += (delta - m_period) / double(std::min<uint64_t>(m_count, PeriodWindow));
+    }
+    m_last_time = timestamp;
+    update(gyr, acc, mag, float(m_period));
+}
+
+
+
+///
+/// \brief Añade una medida con un periodo conocido.
+/// \param gyr Giróscopo calibrado, radianes/s.
+/// \param acc Acelerómetro calibrado.
+/// \param mag Magnetómetro calibrado.
+/// \param dt Periodo, en segundos.
+///
+void SensorFusion::update(const QVector3D& gyr, const QVector3D& acc, const QVector3D& mag, float dt)
+{
+    if(!m_count++) {
+        Align(acc, mag, m_q);
+        return;
+    }
+    if(m_filter == FusionMahony) {
+        MahonyStep(m_q[0], m_q[1], m_q[2], m_q[3], m_integral[0], m_integral[1], m_integral[2],
+                   gyr.x(), gyr.y(), gyr.z(), acc.x(), acc.y(), acc.z(), mag.x(), mag.y(), mag.z(), m_kp, m_ki, dt);
+    }
+    else {
+        MadgwickStep(m_q[0], m_q[1], m_q[2], m_q[3],
+                     gyr.x(), gyr.y(), gyr.z(), acc.x(), acc.y(), acc.z(), mag.x(), mag.y(), mag.z(), m_beta, dt);
+    }
+}
+
+
+
+///
+/// \brief Orientación estimada.
+/// \return Orientación en referencia al sistema ENU.
+///
+QQuaternion SensorFusion::orientation() const
+{
+    return ToEnu(m_q[0], m_q[1], m_q[2], m_q[3]);
+}
+
+
+
+///
+/// \brief Número de medidas desde el último reset().
+///
+uint64_t SensorFusion::count() const
+{
+    return m_count;
+}
+
+
+
+///
+/// \brief Periodo de muestreo estimado, en segundos.
+///
+double SensorFusion::samplePeriod() const
+{
+    return m_period;
+}
+
+
+
+///
+/// \brief Constructor, con el filtro de Madgwick y todos los carriles en la identidad.
+///
+FusionBank::FusionBank() :
+    m_filter(FusionMadgwick),
+    m_beta(SensorFusion::DefaultBeta),
+    m_kp(SensorFusion::DefaultKp),
+    m_ki(SensorFusion::DefaultKi)
+{
+    for(int lane=0 ; lane<Lanes ; ++lane) {
+        m_q[0][lane] = 1.0f;
+        m_q[1][lane] = m_q[2][lane] = m_q[3][lane] = 0.0f;
+        m_integral[0][lane] = m_integral[1][lane] = m_integral[2][lane] = 0.0f;
+    }
+}
+
+
+
+///
+/// \brief Elige el filtro de todos los carriles.
+///
+void FusionBank::setFilter(FusionFilter filter)
+{
+    m_filter = filter;
+}
+
+
+
+///
+/// \brief Cambia las ganancias de todos los carriles; ver SensorFusion::setGains().
+///
+void FusionBank::setGains(float beta, float kp, float ki)
+{
+    m_beta = beta;
+    m_kp = kp;
+    m_ki = ki;
+}
+
+
+
+///
+/// \brief Empieza un flujo nuevo en un carril, orientado con su primera medida.
+/// \param lane Carril.
+/// \param acc Acelerómetro calibrado.
+/// \param mag Magnetómetro calibrado.
+///
+void FusionBank::align(int lane, const QVector3D& acc, const QVector3D& mag)
+{
+    float q[4];
+    Align(acc, mag, q);
+    for(int i=0 ; i<4 ; ++i) m_q[i][lane] = q[i];
+    m_integral[0][lane] = m_integral[1][lane] = m_integral[2][lane] = 0.0f;
+}
+
+
+
+///
+/// \brief Avanza una medida en todos los carriles.
+/// \param step Medidas de cada carril.
+///
+void FusionBank::update(const Step& step)
+{
+    // Copias locales: el compilador sabe que no se solapan con las medidas y no duplica el bucle
+    alignas(32) float q[4][Lanes];
+    alignas(32) float integral[3][Lanes];
+    std::copy(&m_q[0][0], &m_q[0][0] + 4 * Lanes, &q[0][0]);
+    std::copy(&m_integral[0][0], &m_integral[0][0] + 3 * Lanes, &integral[0][0]);
+
+    const float beta = m_beta, kp = m_kp, ki = m_ki;
+    if(m_filter == FusionMahony) {
+        for(int lane=0 ; lane<Lanes ; ++lane) {
+            MahonyStep(q[0][lane], q[1][lane], q[2][lane], q[3][lane],
+                       integral[0][lane], integral[1][lane], integral[2][lane],
+                       step.m_gyr[0][lane], step.m_gyr[1][lane], step.m_gyr[2][lane],
+                       step.m_acc[0][lane], step.m_acc[1][lane], step.m_acc[2][lane],
+                       step.m_mag[0][lane], step.m_mag[1][lane], step.m_mag[2][lane], kp, ki, step.m_dt[lane]);
+        }
+    }
+    else {
+        for(int lane=0 ; lane<Lanes ; ++lane) {
+            MadgwickStep(q[0][lane], q[1][lane], q[2][lane], q[3][lane],
+                         step.m_gyr[0][lane], step.m_gyr[1][lane], step.m_gyr[2][lane],
+                         step.m_acc[0][lane], step.m_acc[1][lane], step.m_acc[2][lane],
+                         step.m_mag[0][lane], step.m_mag[1][lane], step.m_mag[2][lane], beta, step.m_dt[lane]);
+        }
+    }
+
+    std::copy(&q[0][0], &q[0][0] + 4 * Lanes, &m_q[0][0]);
+    std::copy(&integral[0][0], &integral[0][0] + 3 * Lanes, &m_integral[0][0]);
+}
+
+
+
+///
+/// \brief Orientación estimada de un carril.
+/// \param lane Carril.
+/// \return Orientación en referencia al sistema ENU.
+///
+QQuaternion FusionBank::orientation(int lane) const
+{
+    return ToEnu(m_q[0][lane], m_q[1][lane], m_q[2][lane], m_q[3][lane]);
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <QQuaternion>
+#include <QVector3D>
+
+#include <cstdint>
+
+
+
+///
+/// \brief Filtro de fusión de la orientación.
+///
+enum FusionFilter { FusionMadgwick, FusionMahony };
+
+
+
+///
+/// \brief Fusión de la orientación en el PC a partir de las medidas "raw_gam" ya calibradas.
+///
+/// Implementa los filtros de Madgwick (descenso de gradiente) y de Mahony (complementario con término
+/// integral) con magnetómetro; si una medida del magnetómetro es nula se usan sin él, y si la del
+/// acelerómetro es nula sólo se integra el giróscopo. La primera medida orienta el filtro directamente
+/// con el acelerómetro y el magnetómetro, para no esperar a que converja desde la identidad. El periodo
+/// de muestreo se estima de las marcas de tiempo con una media móvil, porque las muestras llegan a
+/// ráfagas, una por lectura del puerto. Internamente el sistema de referencia es norte-oeste-arriba,
+/// el de los filtros originales; orientation() la devuelve en ENU, como la del firmware.
+///
+class SensorFusion
+{
+public:
+    static constexpr float DefaultBeta = 0.1f;
+    static constexpr float DefaultKp = 1.0f;
+    static constexpr float DefaultKi = 0.0f;
+    static constexpr double MaxPeriod = 0.1;
+    static const int PeriodWindow = 256;
+
+    SensorFusion();
+    void setFilter(FusionFilter filter);
+    FusionFilter filter() const;
+    void setGains(float beta, float kp, float ki);
+    void reset();
+    void update(const QVector3D& gyr, const QVector3D& acc, const QVector3D& mag, qint64 timestamp);
+    void update(const QVector3D& gyr, const QVector3D& acc, const QVector3D& mag, float dt);
+    QQuaternion orientation() const;
+    uint64_t count() const;
+    double samplePeriod() const;
+
+private:
+    FusionFilter m_filter;
+    float m_beta, m_kp, m_ki;
+    float m_q[4];
+    float m_integral[3];
+    uint64_t m_count;
+    qint64 m_last_time;
+    double m_period;
+};
+
+
+
+///
+/// \brief Varios flujos de fusión a la vez, como estructura de vectores, con un carril por flujo.
+///
+/// Cada paso avanza una muestra de todos los carriles con las mismas operaciones y sin saltos, así que
+/// el compilador las convierte en instrucciones SIMD: con Lanes carriles, un paso cuesta casi lo mismo
+/// que un paso de un solo flujo. Los carriles sin flujo se avanzan con dt = 0 y medidas nulas, que no
+/// cambian su orientación. Es lo que usa el procesado por lotes de grabaciones.
+///
+class FusionBank
+{
+public:
+    static const int Lanes = 8;
+
+    ///
+    /// \brief Medidas de un paso, un valor por carril.
+    ///
+    struct Step
+    {
+        alignas(32) float m_gyr[3][Lanes];
+        alignas(32) float m_acc[3][Lanes];
+        alignas(32) float m_mag[3][Lanes];
+        alignas(32) float m_dt[Lanes];
+    };
+
+    FusionBank();
+    void setFilter(FusionFilter filter);
+    void setGains(float beta, float kp, float ki);
+    void align(int lane, const QVector3D& acc, const QVector3D& mag);
+    void update(const Step& step);
+    QQuaternion orientation(int lane) const;
+
+private:
+    FusionFilter m_filter;
+    float m_beta, m_kp, m_ki;
+    alignas(32) float m_q[4][Lanes];
+    alignas(32) float m_integral[3][Lanes];
+};
+
+
+
+float AngleBetween(const QQuaternion& a, const QQuaternion& b);
@@ -1,245 +1,803 @@
-#include "serialthread.h"
-
-#include <QDebug>
-
-const char* COMMAND_RESET = "reset";
-const char* COMMAND_READ_UID = "read uid";
-const char* COMMAND_READ_ACC = "read acc";
-const char* COMMAND_READ_MAG = "read mag";
-const char* COMMAND_WRITE_ACC = "write acc %f %f %f %f %f %f %f %f %f %f %f %f";
-const char* COMMAND_WRITE_MAG = "write mag %f %f %f %f %f %f %f %f %f %f %f %f";
-const char* COMMAND_START_ORI = "start ori";
-const char* COMMAND_START_CAL = "start cal";
-const char* COMMAND_STOP = "stop";
-
-
-
-///
-/// \brief Constructor.
-/// \param info Datos del puerto serie a usar.
-/// \param parent Objeto padre.
-///
-SerialThread::SerialThread(const QSerialPortInfo& info, QObject* parent) : QThread(parent), m_port(nullptr)
-{
-    qDebug() << __PRETTY_FUNCTION__;
-    m_info = info;
-    m_mode = Disconnected;
-    m_write_calib = false;
-    m_change_mode = false;
-}
-
-
-
-///
-/// \brief Destructor, cierra el puerto serie.
-///
-SerialThread::~SerialThread()
-{
-    qDebug() << __PRETTY_FUNCTION__;
-    m_mode = Disconnected;
-    this->wait();
-}
-
-
-
-///
-/// \brief Bucle de comunicación con el IMU.
-///
-void SerialThread::run()
-{
-    qDebug() << __PRETTY_FUNCTION__;
-
-    // Abre el puerto serie
-    m_port = new QSerialPort(m_info, this);
-    //m_port->setBaudRate(QSerialPort::Baud115200);
-    m_port->setBaudRate(460800);
-    m_port->setDataBits(QSerialPort::Data8);
-    m_port->setParity(QSerialPort::NoParity);
-    m_port->setStopBits(QSerialPort::OneStop);
-    m_port->setFlowControl(QSerialPort::NoFlowControl);
-    if (!m_port->open(QIODevice::ReadWrite)) {
-        qDebug() << "The selected port couldn't be opened";
-        delete m_port;
-        return;
-    }
-    QThread::msleep(100);
-
-    // Lee el identificador del IMU
-    sendCommand(COMMAND_RESET);
-    const QStringList foo = sendCommand(COMMAND_READ_UID);
-    qDebug() << foo;
-    for( auto f : foo ) {
-        const QStringList bar = f.split(' ');
-        if(bar[0] == "uid") {
-            m_uid = bar[1];
-            qDebug() << "IMU unique id:" << m_uid;
-        }
-    }
-
-    // Bucle de lectura
-    while(m_mode != Disconnected) {
-        // Escribe la nueva calibración
-        if(m_write_calib) {
-            // Prepara los comandos
-            QString acc_command, mag_command;
-            acc_command.sprintf(COMMAND_WRITE_ACC,
-                                m_acc_calib(0,0), m_acc_calib(0,1), m_acc_calib(0,2), m_acc_calib(0,3),
-                                m_acc_calib(1,0), m_acc_calib(1,1), m_acc_calib(1,2), m_acc_calib(1,3),
-                                m_acc_calib(2,0), m_acc_calib(2,1), m_acc_calib(2,2), m_acc_calib(2,3));
-            mag_command.sprintf(COMMAND_WRITE_MAG,
-                                m_mag_calib(0,0), m_mag_calib(0,1), m_mag_calib(0,2), m_mag_calib(0,3),
-                                m_mag_calib(1,0), m_mag_calib(1,1), m_mag_calib(1,2), m_mag_calib(1,3),
-                                m_mag_calib(2,0), m_mag_calib(2,1), m_mag_calib(2,2), m_mag_calib(2,3));
-
-            // Envía los comandos
-            sendCommand(acc_command.toUtf8());
-            sendCommand(acc_command.toUtf8());
-            sendCommand(acc_command.toUtf8());
-            sendCommand(mag_command.toUtf8());
-            sendCommand(mag_command.toUtf8());
-            sendCommand(mag_command.toUtf8());
-            m_write_calib = false;
-        }
-
-        if(m_change_mode) {
-            switch(m_mode) {
-                case Waiting: sendCommand(COMMAND_STOP); break;
-                case Compass: sendCommand(COMMAND_START_ORI); break;
-                case Calibration: sendCommand(COMMAND_START_CAL); break;
-                default: break;
-            }
-            m_change_mode = false;
-        }
-
-        if(m_port->waitForReadyRead(10)) {
-            while( m_port->canReadLine() ) {
-                auto foo = m_port->readLine();
-                QString header;
-                QList<float> values;
-                std::tie(header, values) = ParseLine(foo);
-
-                //qDebug() << foo;
-
-                if((header == "wxyz") && (values.size() == 4)) {
-                    QQuaternion ori(values[0], values[1], values[2], values[3]);
-                    emit readOrientation(ori);
-                }
-                else if((header == "force") && (values.size() == 4)) {
-                    QVector4D force(values[0], values[1], values[2], values[3]);
-                    emit readForce(force);
-                }
-                else if((header == "raw_adc") && (values.size() == 6)) {
-                    float v[6];
-                    for(int i=0 ; i<6 ; ++i) v[i] = values[i];
-                    emit readRawAnalog(v);
-                }
-                else if((header == "raw_gam") && (values.size() == 9)) {
-                    auto gyr = QVector3D(values[0], values[1], values[2]);
-                    auto acc = QVector3D(values[3], values[4], values[5]);
-                    auto mag = QVector3D(values[6], values[7], values[8]);
-                    emit readRawSensors(gyr, acc, mag);
-                }
-            }
-        }
-    }
-
-    // Cierra el puerto serie
-    if( m_port ) {
-        sendCommand(COMMAND_STOP);
-        m_port->close();
-        delete m_port;
-        qDebug() << "Closed serial port";
-    }
-}
-
-
-
-///
-/// \brief Devuelve el identificador único del IMU.
-/// \return Identificador del IMU.
-///
-const QString& SerialThread::getUID() const
-{
-    qDebug() << __PRETTY_FUNCTION__;
-    while( m_uid.isEmpty() || m_uid.isNull() ) {}
-    return m_uid;
-}
-
-
-
-///
-/// \brief Envía los nuevos parámetros de calibración al IMU.
-/// \param acc Calibración del acelerómetro.
-/// \param mag Calibración del magnetómetro.
-///
-void SerialThread::recalibrate(const QMatrix4x4& acc, const QMatrix4x4& mag)
-{
-    qDebug() << __PRETTY_FUNCTION__;
-    m_acc_calib = acc;
-    m_mag_calib = mag;
-    m_write_calib = true;
-}
-
-
-
-///
-/// \brief Envía un comando por el puerto serie y espera a que el IMU responda.
-/// \param command Cadena con el comando. La función incluye automáticamente el fin de línea.
-/// \return
-///
-QStringList SerialThread::sendCommand(const QByteArray& command)
-{
-    qDebug() << __PRETTY_FUNCTION__;
-
-    qDebug() << "\tSending:" << command.trimmed();
-    if( true ) {
-        m_port->write(command.trimmed() + "\r\n");
-        m_port->waitForBytesWritten(-1);
-    }
-    else {
-        for( auto c : (command.trimmed() + "\r\n" )) {
-            m_port->putChar(c);
-            m_port->waitForBytesWritten(-1);
-            QThread::msleep(10);
-        }
-        m_port->write(command.trimmed() + "\r\n");
-        m_port->waitForBytesWritten(-1);
-        QThread::msleep(10);
-    }
-    QThread::msleep(10);
-
-    QString line;
-    QStringList response;
-    while(true) {
-        m_port->waitForReadyRead(-1);
-        while(m_port->canReadLine()) {
-            line = m_port->readLine().trimmed().toLower();
-            if(line.isNull() || line.isEmpty()) continue;
-            else if(line=="ready") break;
-            else response.append(line);
-            qDebug() << "\tReceived:" << line;
-        }
-        if(line == "ready") {
-            qDebug() << "\tREADY";
-            break;
-        }
-    }
-    QThread::msleep(10);
-    return response;
-}
-
-
-
-///
-/// \brief Cambia el modo de funcionamiento del IMU.
-/// \param mode Nuevo modo.
-///
-void SerialThread::setMode(IMUMode mode)
-{
-    qDebug() << __PRETTY_FUNCTION__;
-
-    if(mode != m_mode) {
-        m_mode = mode;
-        m_change_mode = true;
-    }
-}
+#include "serialthread.h"
+
+#include <QDebug>
+#include <QMutexLocker>
+#include <QTimer>
+
+#include <algorithm>
+#include <cmath>
+
+const char* COMMAND_RESET = "reset";
+const char* COMMAND_READ_UID = "read uid";
+const char* COMMAND_READ_ACC = "read acc";
+const char* COMMAND_READ_MAG = "read mag";
+const char* COMMAND_READ_GYR = "read gyr";
+const char* COMMAND_WRITE_ACC = "write acc %f %f %f %f %f %f %f %f %f %f %f %f";
+const char* COMMAND_WRITE_MAG = "write mag %f %f %f %f %f %f %f %f %f %f %f %f";
+const char* COMMAND_WRITE_GYR = "write gyr %f %f %f %f %f %f %f %f %f %f %f %f";
+const char* COMMAND_START_ORI = "start ori";
+const char* COMMAND_START_CAL = "start cal";
+const char* COMMAND_START_ALL = "start all";
+const char* COMMAND_STOP = "stop";
+const char* COMMAND_FORMAT_BIN = "format bin";
+const char* COMMAND_FORMAT_TXT = "format txt";
+
+const int CALIB_ATTEMPTS = 3;
+const float CALIB_TOLERANCE = 1e-4f;
+
+
+
+///
+/// \brief Extrae los 12 coeficientes de una calibración de la respuesta del IMU a "read acc", "read mag" o "read gyr".
+/// \param response Líneas de la respuesta.
+/// \param values Coeficientes leídos, por filas, de las tres primeras filas de la matriz.
+/// \return Verdadero si alguna línea contenía los 12 coeficientes.
+///
+static bool ParseCalibration(const QStringList& response, float values[12])
+{
+    for( const auto& line : response ) {
+        // La línea puede llevar delante el nombre del sensor; se toman los 12 últimos números
+        const QStringList fields = line.split(' ', QString::SkipEmptyParts);
+        int count = 0;
+        for( int i=fields.size()-1 ; (i >= 0) && (count < 12) ; --i ) {
+            bool ok;
+            const float value = fields[i].toFloat(&ok);
+            if(!ok) break;
+            values[11 - count++] = value;
+        }
+        if(count == 12) return true;
+    }
+    return false;
+}
+
+
+
+///
+/// \brief Constructor.
+/// \param info Datos del puerto serie a usar.
+/// \param parent Objeto padre.
+///
+SerialThread::SerialThread(const QSerialPortInfo& info, QObject* parent) : QThread(parent), m_port(nullptr)
+{
+    qDebug() << __PRETTY_FUNCTION__;
+    m_info = info;
+    m_mode = Disconnected;
+    m_write_calib = false;
+    m_write_gyr_calib = false;
+    m_change_mode = false;
+    m_host_fusion = false;
+    m_binary_requested = false;
+    m_change_format = false;
+    m_command_timer = nullptr;
+    m_command_active = false;
+    m_settling = false;
+    m_bytes_received = 0;
+    m_samples_received = 0;
+    m_frame_errors = 0;
+    m_wakeups = 0;
+    m_timeouts = 0;
+    m_request_time = 0;
+    m_command_latency = 0;
+    m_read_time = 0;
+    m_read_count = 0;
+    m_change_recorder = false;
+    m_replay_realtime = true;
+    for( auto& time : m_last_sample_time ) time = 0;
+    for( auto& read : m_last_sample_read ) read = 0;
+    m_running = false;
+    m_telemetry.setHandlers([this](TelemetrySample& sample) { dispatch(sample); },
+                            [this](const char* line, int size) { processResponse(line, size); });
+}
+
+
+
+///
+/// \brief Destructor, cierra el puerto serie.
+///
+SerialThread::~SerialThread()
+{
+    qDebug() << __PRETTY_FUNCTION__;
+    m_mode = Disconnected;
+    wake();
+    this->wait();
+}
+
+
+
+///
+/// \brief Bucle de comunicación con el IMU.
+///
+/// El hilo duerme en su propio bucle de eventos: QSerialPort vigila el descriptor del puerto con un
+/// QSocketNotifier y las peticiones del resto de la aplicación llegan como llamadas encoladas.
+///
+void SerialThread::run()
+{
+    qDebug() << __PRETTY_FUNCTION__;
+    if(!m_replay_file.isEmpty()) {
+        replay();
+        return;
+    }
+
+    // Abre el puerto serie; el objeto pertenece a este hilo, así que no puede tener padre
+    m_port = new QSerialPort(m_info);
+    //m_port->setBaudRate(QSerialPort::Baud115200);
+    m_port->setBaudRate(460800);
+    m_port->setDataBits(QSerialPort::Data8);
+    m_port->setParity(QSerialPort::NoParity);
+    m_port->setStopBits(QSerialPort::OneStop);
+    m_port->setFlowControl(QSerialPort::NoFlowControl);
+    if (!m_port->open(QIODevice::ReadWrite)) {
+        qDebug() << "The selected port couldn't be opened";
+        delete m_port;
+        m_port = nullptr;
+        failCommands();
+        return;
+    }
+    m_telemetry.reset();
+
+    // Temporizador del comando en curso
+    m_command_timer = new QTimer(m_port);
+    m_command_timer->setSingleShot(true);
+    connect(m_command_timer, &QTimer::timeout, m_port, [this]() { commandTimeout(); });
+
+    // Lee el identificador del IMU; los comandos esperan a que el puerto se estabilice
+    enqueueCommand(COMMAND_RESET);
+    enqueueCommand(COMMAND_READ_UID, [this](const CommandResult& result) {
+        for( auto f : result.m_response ) {
+            const QStringList bar = f.split(' ');
+            if(bar.size() > 1 && bar[0] == "uid") {
+                QMutexLocker lock(&m_lock);
+                m_uid = bar[1];
+                qDebug() << "IMU unique id:" << m_uid;
+            }
+        }
+    });
+    m_settling = true;
+    QTimer::singleShot(100, m_port, [this]() {
+        m_settling = false;
+        startNextCommand();
+    });
+
+    // Bucle de eventos
+    connect(m_port, &QSerialPort::readyRead, m_port, [this]() {
+        ++m_wakeups;
+        readAvailable();
+    });
+    {
+        QMutexLocker lock(&m_lock);
+        m_running = true;
+    }
+    processRequests();
+    exec();
+    {
+        QMutexLocker lock(&m_lock);
+        m_running = false;
+    }
+
+    // Cierra el puerto serie; los comandos pendientes se dan por fallidos
+    m_settling = true;
+    failCommands();
+    if(m_command_active) {
+        finishCommand(false);
+    }
+    m_port->write(QByteArray(COMMAND_STOP) + "\r\n");
+    m_port->waitForBytesWritten(100);
+    m_port->close();
+    delete m_port;
+    m_port = nullptr;
+    m_command_timer = nullptr;
+    qDebug() << "Closed serial port";
+}
+
+
+
+///
+/// \brief Atiende las peticiones pendientes del resto de la aplicación, desde el hilo del puerto serie.
+///
+void SerialThread::processRequests()
+{
+    ++m_wakeups;
+    const qint64 requested = m_request_time.exchange(0);
+    if(requested) m_command_latency = SteadyClock() - requested;
+
+    if(m_mode == Disconnected) {
+        quit();
+        return;
+    }
+
+    // Cambia el fichero de grabación; el anterior se cierra aquí, en el hilo que escribía en él
+    if(m_change_recorder.exchange(false)) {
+        QMutexLocker lock(&m_lock);
+        m_recorder = std::move(m_next_recorder);
+        if(m_recorder) m_recorder->writeFormat(SteadyClock(), m_telemetry.binary());
+    }
+
+    // Escribe la nueva calibración
+    if(m_write_calib.exchange(false)) {
+        QMatrix4x4 acc_calib, mag_calib;
+        {
+            QMutexLocker lock(&m_lock);
+            acc_calib = m_acc_calib;
+            mag_calib = m_mag_calib;
+        }
+        writeCalibration(COMMAND_WRITE_ACC, COMMAND_READ_ACC, acc_calib, CALIB_ATTEMPTS);
+        writeCalibration(COMMAND_WRITE_MAG, COMMAND_READ_MAG, mag_calib, CALIB_ATTEMPTS);
+    }
+    if(m_write_gyr_calib.exchange(false)) {
+        QMatrix4x4 gyr_calib;
+        {
+            QMutexLocker lock(&m_lock);
+            gyr_calib = m_gyr_calib;
+        }
+        writeCalibration(COMMAND_WRITE_GYR, COMMAND_READ_GYR, gyr_calib, CALIB_ATTEMPTS);
+    }
+
+    if(m_change_mode.exchange(false)) {
+        switch(m_mode) {
+            case Waiting: enqueueCommand(COMMAND_STOP); break;
+            case Compass:
+                if(m_host_fusion) {
+                    // Orientación y medidas a la vez; un firmware que no lo entiende se queda con las medidas
+                    enqueueCommand(COMMAND_START_ALL, [this](const CommandResult& result) {
+                        bool ok = result.m_ok;
+                        for( const auto& line : result.m_response ) ok = ok && !line.startsWith("error");
+                        if(!ok) {
+                            qDebug() << "The IMU doesn't support \"start all\", streaming raw sensors only";
+                            enqueueCommand(COMMAND_START_CAL);
+                        }
+                    });
+                }
+                else {
+                    enqueueCommand(COMMAND_START_ORI);
+                }
+                break;
+            case Calibration: enqueueCommand(COMMAND_START_CAL); break;
+            case GyroCalibration: enqueueCommand(COMMAND_START_CAL); break;
+            default: break;
+        }
+    }
+
+    // Negocia el formato de la telemetría; el IMU confirma el cambio todavía en el formato anterior
+    if(m_change_format.exchange(false)) {
+        if(m_binary_requested) {
+            enqueueCommand(COMMAND_FORMAT_BIN, [this](const CommandResult& result) {
+                setBinaryActive(result.m_response.contains(COMMAND_FORMAT_BIN));
+                if(!m_telemetry.binary()) qDebug() << "The IMU doesn't support the binary format";
+            });
+        }
+        else if(m_telemetry.binary()) {
+            enqueueCommand(COMMAND_FORMAT_TXT, [this](const CommandResult& result) {
+                if(result.m_ok) setBinaryActive(false);
+            });
+        }
+    }
+
+    startNextCommand();
+}
+
+
+
+///
+/// \brief Escribe una calibración en el IMU y la verifica leyéndola de vuelta.
+///
+/// La matriz se envía una sola vez y se lee a continuación; sólo se reintenta la escritura si lo
+/// leído no coincide con lo enviado. El resultado se notifica con calibrationWritten().
+///
+/// \param write Formato del comando de escritura.
+/// \param read Comando de lectura.
+/// \param calib Calibración a escribir.
+/// \param attempts Número máximo de escrituras.
+///
+void SerialThread::writeCalibration(const char* write, const char* read, const QMatrix4x4& calib, int attempts)
+{
+    QString command;
+    command.sprintf(write,
+                    calib(0,0), calib(0,1), calib(0,2), calib(0,3),
+                    calib(1,0), calib(1,1), calib(1,2), calib(1,3),
+                    calib(2,0), calib(2,1), calib(2,2), calib(2,3));
+    // Sin reenvíos por tiempo: sólo la comparación de la lectura decide si se vuelve a escribir
+    enqueueCommand(command.toUtf8(), CommandCallback(), 1000, 0);
+
+    // La lectura se encola justo detrás: aunque la escritura no se confirme, pudo haber llegado al IMU
+    const QString sensor = QString(read).section(' ', -1);
+    enqueueCommand(read, [=](const CommandResult& result) {
+        float values[12];
+        bool verified = result.m_ok && ParseCalibration(result.m_response, values);
+        for( int i=0 ; verified && (i < 12) ; ++i ) {
+            const float expected = calib(i / 4, i % 4);
+            verified = std::abs(values[i] - expected) <= CALIB_TOLERANCE * std::max(1.0f, std::abs(expected));
+        }
+
+        if(verified || (attempts <= 1) || !m_running) {
+            qDebug() << "Calibration" << sensor << (verified ? "verified" : "failed");
+            emit calibrationWritten(sensor, verified);
+        }
+        else {
+            qDebug() << "Calibration" << sensor << "mismatch, writing again";
+            writeCalibration(write, read, calib, attempts - 1);
+        }
+    });
+}
+
+
+
+///
+/// \brief Reproduce una grabación por el mismo camino que los bytes del puerto serie.
+///
+/// Al ritmo original, cada bloque se entrega en el instante en que llegó; si no, se entregan tan rápido
+/// como se pueden decodificar y, en vez de descartar muestras, se espera a que la interfaz gráfica
+/// vacíe la cola. Los comandos no tienen a quién llegar y se dan por fallidos.
+///
+void SerialThread::replay()
+{
+    StreamPlayer player;
+    if(!player.open(m_replay_file)) {
+        qDebug() << "The recording couldn't be opened:" << m_replay_file;
+        failCommands();
+        return;
+    }
+    m_telemetry.reset();
+    m_telemetry.setInferFormat(true);
+
+    const qint64 start = SteadyClock();
+    RecordChunk chunk;
+    while((m_mode != Disconnected) && player.next(chunk)) {
+        if(m_replay_realtime) {
+            // Espera en tramos cortos para poder cancelar
+            qint64 wait;
+            while(((wait = start + chunk.m_time * 1000 - SteadyClock()) > 0) && (m_mode != Disconnected)) {
+                QThread::usleep(std::min<qint64>(wait / 1000, 10000));
+            }
+        }
+
+        switch(chunk.m_type) {
+        case RecordText: setBinaryActive(false); break;
+        case RecordBinary: setBinaryActive(true); break;
+        case RecordData:
+            m_read_time = SteadyClock();
+            ++m_read_count;
+            m_bytes_received += chunk.m_data.size();
+            decode(chunk.m_data.constData(), chunk.m_data.size());
+            break;
+        }
+        failCommands();
+    }
+
+    const double seconds = (SteadyClock() - start) / 1e9;
+    qDebug() << "Replay finished:" << m_samples_received << "samples in" << seconds << "s";
+    emit replayFinished(m_samples_received, seconds);
+}
+
+
+
+///
+/// \brief Despierta al hilo para que atienda las peticiones pendientes.
+///
+/// Si el bucle de eventos todavía no ha arrancado, las peticiones se atienden al arrancar.
+///
+void SerialThread::wake()
+{
+    QMutexLocker lock(&m_lock);
+    m_request_time = SteadyClock();
+    if(m_running) {
+        QMetaObject::invokeMethod(m_port, [this]() { processRequests(); }, Qt::QueuedConnection);
+    }
+}
+
+
+
+///
+/// \brief Devuelve el identificador único del IMU.
+/// \return Identificador del IMU.
+///
+QString SerialThread::getUID() const
+{
+    qDebug() << __PRETTY_FUNCTION__;
+    QMutexLocker lock(&m_lock);
+    return m_uid;
+}
+
+
+
+///
+/// \brief Envía los nuevos parámetros de calibración al IMU.
+/// \param acc Calibración del acelerómetro.
+/// \param mag Calibración del magnetómetro.
+///
+void SerialThread::recalibrate(const QMatrix4x4& acc, const QMatrix4x4& mag)
+{
+    qDebug() << __PRETTY_FUNCTION__;
+    {
+        QMutexLocker lock(&m_lock);
+        m_acc_calib = acc;
+        m_mag_calib = mag;
+    }
+    m_write_calib = true;
+    wake();
+}
+
+
+
+///
+/// \brief Envía la nueva calibración del giróscopo al IMU, sin tocar las otras dos.
+/// \param gyr Calibración del giróscopo, que resta su sesgo.
+///
+void SerialThread::recalibrateGyro(const QMatrix4x4& gyr)
+{
+    qDebug() << __PRETTY_FUNCTION__;
+    {
+        QMutexLocker lock(&m_lock);
+        m_gyr_calib = gyr;
+    }
+    m_write_gyr_calib = true;
+    wake();
+}
+
+
+
+///
+/// \brief Reproduce una grabación en lugar de abrir el puerto serie. Debe llamarse antes de start().
+/// \param fileName Ruta de la grabación.
+/// \param realtime Verdadero para respetar los tiempos originales, falso para ir lo más rápido posible.
+///
+void SerialThread::setReplay(const QString& fileName, bool realtime)
+{
+    m_replay_file = fileName;
+    m_replay_realtime = realtime;
+}
+
+
+
+///
+/// \brief Empieza a grabar los bytes recibidos en un fichero, sustituyendo a la grabación en curso.
+/// \param fileName Ruta del fichero.
+/// \return Falso si no se ha podido crear el fichero.
+///
+bool SerialThread::startRecording(const QString& fileName)
+{
+    std::unique_ptr<StreamRecorder> recorder(new StreamRecorder);
+    if(!recorder->open(fileName)) return false;
+    {
+        QMutexLocker lock(&m_lock);
+        m_next_recorder = std::move(recorder);
+    }
+    m_change_recorder = true;
+    wake();
+    return true;
+}
+
+
+
+///
+/// \brief Termina la grabación en curso.
+///
+void SerialThread::stopRecording()
+{
+    {
+        QMutexLocker lock(&m_lock);
+        m_next_recorder.reset();
+    }
+    m_change_recorder = true;
+    wake();
+}
+
+
+
+///
+/// \brief Encola un comando para el IMU. Se puede llamar desde cualquier hilo.
+/// \param command Cadena con el comando. El fin de línea se añade automáticamente.
+/// \param callback Función a la que se llama con la respuesta, desde el hilo del puerto serie.
+/// \param timeout Tiempo máximo de espera del "ready", en milisegundos.
+/// \param retries Número de reenvíos si se agota el tiempo de espera.
+/// \return Futuro con la respuesta del IMU.
+///
+std::future<CommandResult> SerialThread::enqueueCommand(const QByteArray& command, CommandCallback callback, int timeout, int retries)
+{
+    auto promise = std::make_shared<std::promise<CommandResult>>();
+    std::future<CommandResult> future = promise->get_future();
+
+    PendingCommand pending;
+    pending.m_command = command.trimmed();
+    pending.m_timeout = timeout;
+    pending.m_retries = retries;
+    pending.m_callback = [promise, callback](const CommandResult& result) {
+        if(callback) callback(result);
+        promise->set_value(result);
+    };
+
+    QMutexLocker lock(&m_lock);
+    m_commands.push_back(pending);
+    if(m_running && (QThread::currentThread() != this)) {
+        QMetaObject::invokeMethod(m_port, [this]() { startNextCommand(); }, Qt::QueuedConnection);
+    }
+    return future;
+}
+
+
+
+///
+/// \brief Envía el siguiente comando de la cola, si no hay ninguno en curso.
+///
+void SerialThread::startNextCommand()
+{
+    if(m_command_active || m_settling || !m_port) return;
+    {
+        QMutexLocker lock(&m_lock);
+        if(m_commands.empty()) return;
+        m_current = m_commands.front();
+        m_commands.pop_front();
+    }
+    m_command_active = true;
+    writeCommand();
+}
+
+
+
+///
+/// \brief Escribe el comando en curso y arranca su temporizador.
+///
+void SerialThread::writeCommand()
+{
+    qDebug() << "\tSending:" << m_current.m_command;
+    m_response.clear();
+    m_port->write(m_current.m_command + "\r\n");
+    m_command_timer->start(m_current.m_timeout);
+}
+
+
+
+///
+/// \brief Se ha agotado el tiempo de espera del comando en curso: se reenvía o se da por fallido.
+///
+void SerialThread::commandTimeout()
+{
+    if(!m_command_active) return;
+    ++m_timeouts;
+    if(m_current.m_retries > 0) {
+        qDebug() << "\tTimeout, retrying:" << m_current.m_command;
+        --m_current.m_retries;
+        writeCommand();
+    }
+    else {
+        qDebug() << "\tTimeout:" << m_current.m_command;
+        finishCommand(false);
+    }
+}
+
+
+
+///
+/// \brief Termina el comando en curso, entrega la respuesta y pasa al siguiente.
+/// \param ok Verdadero si el IMU respondió con "ready".
+///
+void SerialThread::finishCommand(bool ok)
+{
+    m_command_timer->stop();
+    m_command_active = false;
+
+    CommandResult result;
+    result.m_ok = ok;
+    result.m_response = m_response;
+    m_response.clear();
+    m_current.m_callback(result);
+
+    startNextCommand();
+}
+
+
+
+///
+/// \brief Da por fallidos todos los comandos que quedan en la cola.
+///
+void SerialThread::failCommands()
+{
+    std::deque<PendingCommand> commands;
+    {
+        QMutexLocker lock(&m_lock);
+        commands.swap(m_commands);
+    }
+    CommandResult result;
+    result.m_ok = false;
+    for(const auto& command : commands) {
+        command.m_callback(result);
+    }
+}
+
+
+
+///
+/// \brief Cambia el formato activo de la telemetría.
+/// \param binary Verdadero para tramas binarias.
+///
+void SerialThread::setBinaryActive(bool binary)
+{
+    m_telemetry.setBinary(binary);
+}
+
+
+
+///
+/// \brief Cambia el modo de funcionamiento del IMU.
+/// \param mode Nuevo modo.
+///
+void SerialThread::setMode(IMUMode mode)
+{
+    qDebug() << __PRETTY_FUNCTION__;
+
+    if(mode != m_mode) {
+        m_mode = mode;
+        m_change_mode = true;
+        wake();
+    }
+}
+
+
+
+///
+/// \brief Activa o desactiva el formato binario de la telemetría.
+/// \param binary Verdadero para pedir tramas binarias, falso para volver al texto.
+///
+void SerialThread::setBinary(bool binary)
+{
+    qDebug() << __PRETTY_FUNCTION__;
+    m_binary_requested = binary;
+    m_change_format = true;
+    wake();
+}
+
+
+
+///
+/// \brief Pide también las medidas de los sensores en modo brújula, para fusionarlas en el PC.
+/// \param enabled Verdadero para recibir "wxyz" y "raw_gam" a la vez, falso para sólo "wxyz".
+///
+void SerialThread::setHostFusion(bool enabled)
+{
+    qDebug() << __PRETTY_FUNCTION__;
+
+    if(enabled != m_host_fusion) {
+        m_host_fusion = enabled;
+        m_change_mode = true;
+        wake();
+    }
+}
+
+
+
+///
+/// \brief Devuelve los contadores de tráfico del puerto serie.
+/// \return Bytes y muestras recibidos, y tramas descartadas.
+///
+TelemetryStats SerialThread::stats() const
+{
+    TelemetryStats stats;
+    stats.m_bytes = m_bytes_received;
+    stats.m_samples = m_samples_received;
+    stats.m_errors = m_frame_errors;
+    stats.m_overflows = m_samples.overflows();
+    stats.m_wakeups = m_wakeups;
+    stats.m_timeouts = m_timeouts;
+    stats.m_command_latency = m_command_latency;
+    return stats;
+}
+
+
+
+///
+/// \brief Devuelve la cola de muestras recibidas, que la interfaz gráfica vacía una vez por fotograma.
+/// \return Cola de muestras.
+///
+SampleRing& SerialThread::samples()
+{
+    return m_samples;
+}
+
+
+
+///
+/// \brief Histograma del intervalo entre lecturas del puerto que traen muestras del mismo tipo; las
+/// demás muestras de una misma lectura no cuentan, porque tienen el mismo instante.
+///
+const LatencyHistogram& SerialThread::intervalLatency() const
+{
+    return m_interval_latency;
+}
+
+
+
+///
+/// \brief Histograma del tiempo entre la lectura de los bytes y la muestra decodificada.
+///
+const LatencyHistogram& SerialThread::parseLatency() const
+{
+    return m_parse_latency;
+}
+
+
+
+///
+/// \brief Lee todos los bytes disponibles y los pasa al decodificador correspondiente al formato activo.
+///
+void SerialThread::readAvailable()
+{
+    char buffer[512];
+    qint64 size;
+    while((size = m_port->read(buffer, sizeof(buffer))) > 0) {
+        m_read_time = SteadyClock();
+        ++m_read_count;
+        m_bytes_received += size;
+        if(m_recorder) m_recorder->writeData(m_read_time, buffer, int(size));
+        decode(buffer, int(size));
+    }
+}
+
+
+
+///
+/// \brief Pasa los bytes recibidos al decodificador del formato activo.
+/// \param data Bytes recibidos.
+/// \param size Número de bytes.
+///
+void SerialThread::decode(const char* data, int size)
+{
+    m_telemetry.decode(data, size);
+    m_frame_errors = m_telemetry.frameErrors();
+}
+
+
+
+///
+/// \brief Acumula una línea de respuesta al comando en curso.
+/// \param line Bytes de la línea.
+/// \param size Número de bytes.
+///
+void SerialThread::processResponse(const char* line, int size)
+{
+    // En una reproducción no hay comandos en curso: el decodificador deduce el cambio de formato
+    if(!m_replay_file.isEmpty()) return;
+
+    const QString response = QString::fromLatin1(line, size).trimmed().toLower();
+
+    if(response.isEmpty() || !m_command_active) return;
+    else if(response == "ready") finishCommand(true);
+    else {
+        m_response.append(response);
+        qDebug() << "\tReceived:" << response;
+    }
+}
+
+
+
+///
+/// \brief Marca la muestra con el instante de lectura y la entrega a la interfaz gráfica.
+/// \param sample Muestra, del decodificador de texto o del binario.
+///
+void SerialThread::dispatch(TelemetrySample& sample)
+{
+    // Latencia de la decodificación
+    sample.m_timestamp = m_read_time;
+    m_parse_latency.record(SteadyClock() - m_read_time);
+
+    // Las muestras de una misma lectura comparten el instante, así que el intervalo sólo se mide con la
+    // primera de cada tipo en cada lectura: es el tiempo entre lecturas que traen muestras de ese tipo
+    if(m_last_sample_read[sample.m_type] != m_read_count) {
+        qint64& last = m_last_sample_time[sample.m_type];
+        if(last) m_interval_latency.record(m_read_time - last);
+        last = m_read_time;
+        m_last_sample_read[sample.m_type] = m_read_count;
+    }
+
+    // Reproduciendo lo más rápido posible, la cola no descarta muestras sino que espera a la interfaz
+    if(!m_replay_realtime) {
+        while(m_samples.full() && (m_mode != Disconnected)) {
+            if(m_samples.arm()) emit samplesAvailable();
+            QThread::usleep(200);
+        }
+    }
+
+    ++m_samples_received;
+    m_samples.push(sample);
+    if(m_samples.arm()) {
+        emit samplesAvailable();
+    }
+}
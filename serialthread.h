@@ -1,41 +1,139 @@
-#pragma once
-
-#include <QSerialPort>
-#include <QSerialPortInfo>
-#include <QThread>
-
-#include "Render/types.h"
-
-
-
-///
-/// \brief Hilo para la lectura del estado del IMU.
-///
-class SerialThread : public QThread
-{
-    Q_OBJECT
-
-public:
-    explicit SerialThread(const QSerialPortInfo& info, QObject* parent = 0);
-    ~SerialThread();
-    void run();
-    const QString& getUID() const;
-    void setMode(IMUMode mode);
-    void recalibrate(const QMatrix4x4& acc, const QMatrix4x4& mag);
-
-signals:
-    void readOrientation(QQuaternion ori);
-    void readForce(QVector4D force);
-    void readRawSensors(QVector3D gyr, QVector3D acc, QVector3D mag);
-    void readRawAnalog(float values[6]);
-
-private:
-    QSerialPortInfo m_info;
-    QSerialPort* m_port;
-    QString m_uid;
-    QMatrix4x4 m_acc_calib, m_mag_calib;
-    bool m_write_calib, m_change_mode;
-    IMUMode m_mode;
-
-    QStringList sendCommand(const QByteArray& command);
-};
+#pragma once
+
+#include <QSerialPort>
+#include <QMutex>
+#include <QSerialPortInfo>
+#include <QThread>
+#include <QTimer>
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+
+#include "binaryprotocol.h"
+#include "latency.h"
+#include "samplering.h"
+#include "streamrecorder.h"
+#include "telemetrydecoder.h"
+
+
+
+///
+/// \brief Contadores de tráfico del puerto serie.
+///
+struct TelemetryStats
+{
+    quint64 m_bytes;
+    quint64 m_samples;
+    quint64 m_errors;
+    quint64 m_overflows;
+    quint64 m_wakeups;
+    quint64 m_timeouts;
+    qint64 m_command_latency;
+};
+
+
+
+///
+/// \brief Respuesta del IMU a un comando.
+///
+struct CommandResult
+{
+    bool m_ok;
+    QStringList m_response;
+};
+
+typedef std::function<void(const CommandResult&)> CommandCallback;
+
+
+
+///
+/// \brief Hilo para la lectura del estado del IMU.
+///
+class SerialThread : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit SerialThread(const QSerialPortInfo& info, QObject* parent = 0);
+    ~SerialThread();
+    void run();
+    QString getUID() const;
+    void setMode(IMUMode mode);
+    void recalibrate(const QMatrix4x4& acc, const QMatrix4x4& mag);
+    void recalibrateGyro(const QMatrix4x4& gyr);
+    void setBinary(bool binary);
+    void setHostFusion(bool enabled);
+    TelemetryStats stats() const;
+    SampleRing& samples();
+    const LatencyHistogram& intervalLatency() const;
+    const LatencyHistogram& parseLatency() const;
+    void setReplay(const QString& fileName, bool realtime);
+    bool startRecording(const QString& fileName);
+    void stopRecording();
+    std::future<CommandResult> enqueueCommand(const QByteArray& command, CommandCallback callback = CommandCallback(), int timeout = 1000, int retries = 1);
+
+signals:
+    void samplesAvailable();
+    void calibrationWritten(const QString& sensor, bool verified);
+    void replayFinished(quint64 samples, double seconds);
+
+private:
+    ///
+    /// \brief Comando encolado, con su política de espera y reintentos.
+    ///
+    struct PendingCommand
+    {
+        QByteArray m_command;
+        int m_timeout;
+        int m_retries;
+        CommandCallback m_callback;
+    };
+
+    QSerialPortInfo m_info;
+    QSerialPort* m_port;
+    QString m_uid;
+    QMatrix4x4 m_acc_calib, m_mag_calib, m_gyr_calib;
+    std::atomic<bool> m_write_calib, m_write_gyr_calib, m_change_mode, m_host_fusion;
+    std::atomic<IMUMode> m_mode;
+    mutable QMutex m_lock;
+    bool m_running;
+
+    TelemetryDecoder m_telemetry;
+    std::atomic<bool> m_binary_requested, m_change_format;
+    SampleRing m_samples;
+    std::deque<PendingCommand> m_commands;
+    PendingCommand m_current;
+    QTimer* m_command_timer;
+    bool m_command_active, m_settling;
+    QStringList m_response;
+    std::atomic<quint64> m_bytes_received, m_samples_received, m_frame_errors, m_wakeups, m_timeouts;
+    std::atomic<qint64> m_request_time, m_command_latency;
+    qint64 m_read_time;
+    quint64 m_read_count;
+    qint64 m_last_sample_time[SampleRawSensors + 1];
+    quint64 m_last_sample_read[SampleRawSensors + 1];
+    LatencyHistogram m_interval_latency, m_parse_latency;
+
+    std::unique_ptr<StreamRecorder> m_recorder, m_next_recorder;
+    std::atomic<bool> m_change_recorder;
+    QString m_replay_file;
+    bool m_replay_realtime;
+
+    void processRequests();
+    void replay();
+    void writeCalibration(const char* write, const char* read, const QMatrix4x4& calib, int attempts);
+    void wake();
+    void startNextCommand();
+    void writeCommand();
+    void commandTimeout();
+    void finishCommand(bool ok);
+    void failCommands();
+    void setBinaryActive(bool binary);
+    void readAvailable();
+    void decode(const char* data, int size);
+    void processResponse(const char* line, int size);
+    void dispatch(TelemetrySample& sample);
+};
@@ -0,0 +1,178 @@
+#include "streamrecorder.h"
+
+#include <algorithm>
+#include <cstdint>
+
+static const char RECORD_MAGIC[8] = { 'I', 'M', 'U', 'R', 'E', 'C', '0', '1' };
+
+
+
+///
+/// \brief Escribe un entero sin signo como varint LEB128.
+/// \param value Valor.
+/// \param buffer Buffer de salida, de al menos 10 bytes.
+/// \return Número de bytes escritos.
+///
+static int EncodeVarint(quint64 value, char* buffer)
+{
+    int size = 0;
+    do {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        if (value) byte |= 0x80;
+        buffer[size++] = char(byte);
+    } while (value);
+    return size;
+}
+
+
+
+///
+/// \brief Constructor.
+///
+StreamRecorder::StreamRecorder() : m_last_time(0)
+{
+}
+
+
+
+///
+/// \brief Destructor, cierra el fichero.
+///
+StreamRecorder::~StreamRecorder()
+{
+    m_file.close();
+}
+
+
+
+///
+/// \brief Crea el fichero de la grabación.
+/// \param fileName Ruta del fichero.
+/// \return Falso si no se ha podido crear.
+///
+bool StreamRecorder::open(const QString& fileName)
+{
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) return false;
+    m_file.write(RECORD_MAGIC, sizeof(RECORD_MAGIC));
+    m_last_time = 0;
+    return true;
+}
+
+
+
+///
+/// \brief Graba el formato activo de la telemetría.
+/// \param time Instante, del reloj monótono.
+/// \param binary Verdadero si la telemetría llega en tramas binarias.
+///
+void StreamRecorder::writeFormat(qint64 time, bool binary)
+{
+    writeChunk(binary ? RecordBinary : RecordText, time, nullptr, 0);
+}
+
+
+
+///
+/// \brief Graba un bloque de bytes recibidos.
+/// \param time Instante de la lectura, del reloj monótono.
+/// \param data Bytes.
+/// \param size Número de bytes.
+///
+void StreamRecorder::writeData(qint64 time, const char* data, int size)
+{
+    writeChunk(RecordData, time, data, size);
+}
+
+
+
+///
+/// \brief Ruta del fichero de la grabación.
+///
+QString StreamRecorder::fileName() const
+{
+    return m_file.fileName();
+}
+
+
+
+///
+/// \brief Escribe un bloque, con el tiempo relativo al bloque anterior.
+/// \param type Tipo de bloque.
+/// \param time Instante, del reloj monótono, en nanosegundos.
+/// \param data Datos del bloque.
+/// \param size Número de bytes.
+///
+void StreamRecorder::writeChunk(RecordType type, qint64 time, const char* data, int size)
+{
+    if (!m_file.isOpen()) return;
+
+    // El primer bloque empieza en 0; el reloj no retrocede, pero se protege igualmente
+    if (!m_last_time) m_last_time = time;
+    const qint64 delta = std::max<qint64>(0, (time - m_last_time) / 1000);
+    m_last_time += delta * 1000;
+
+    char header[21];
+    int headerSize = 0;
+    header[headerSize++] = char(type);
+    headerSize += EncodeVarint(quint64(delta), header + headerSize);
+    headerSize += EncodeVarint(quint64(size), header + headerSize);
+    m_file.write(header, headerSize);
+    if (size) m_file.write(data, size);
+}
+
+
+
+///
+/// \brief Abre una grabación.
+/// \param fileName Ruta del fichero.
+/// \return Falso si no existe o no es una grabación.
+///
+bool StreamPlayer::open(const QString& fileName)
+{
+    m_file.setFileName(fileName);
+    m_time = 0;
+    if (!m_file.open(QIODevice::ReadOnly)) return false;
+    return m_file.read(sizeof(RECORD_MAGIC)) == QByteArray(RECORD_MAGIC, sizeof(RECORD_MAGIC));
+}
+
+
+
+///
+/// \brief Lee el siguiente bloque.
+/// \param chunk Bloque leído; el tiempo es en microsegundos desde el principio de la grabación.
+/// \return Falso al llegar al final o si el fichero está truncado.
+///
+bool StreamPlayer::next(RecordChunk& chunk)
+{
+    char type;
+    quint64 delta, size;
+    if (!m_file.getChar(&type) || !readVarint(delta) || !readVarint(size)) return false;
+    if ((uint8_t(type) > RecordBinary) || (size > (1u << 24))) return false;
+
+    m_time += qint64(delta);
+    chunk.m_type = RecordType(type);
+    chunk.m_time = m_time;
+    chunk.m_data = m_file.read(qint64(size));
+    return chunk.m_data.size() == int(size);
+}
+
+
+
+///
+/// \brief Lee un varint LEB128 sin signo.
+/// \param value Valor leído.
+/// \return Falso si el fichero se acaba o el valor no cabe en 64 bits.
+///
+bool StreamPlayer::readVarint(quint64& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        char byte;
+        if (!m_file.getChar(&byte)) return false;
+        value |= quint64(uint8_t(byte) & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
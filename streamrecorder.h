@@ -0,0 +1,73 @@
+#pragma once
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+
+
+
+///
+/// \brief Tipos de bloque de una grabación.
+///
+/// Formato del fichero:
+///
+///     "IMUREC01" | bloque | bloque | ...
+///
+/// Cada bloque es: tipo (1 byte) | µs desde el bloque anterior (varint) | longitud (varint) | datos.
+/// Los varint son LEB128 sin signo. Los bloques de datos guardan los bytes tal como llegaron del puerto,
+/// uno por cada lectura; los de formato sólo aparecen al principio, con el formato activo al empezar a
+/// grabar, porque los cambios posteriores ya van en la propia respuesta del IMU.
+///
+enum RecordType { RecordData = 0, RecordText = 1, RecordBinary = 2 };
+
+
+
+///
+/// \brief Bloque leído de una grabación.
+///
+struct RecordChunk
+{
+    RecordType m_type;
+    qint64 m_time;
+    QByteArray m_data;
+};
+
+
+
+///
+/// \brief Graba los bytes recibidos del IMU, con el instante de llegada.
+///
+class StreamRecorder
+{
+public:
+    StreamRecorder();
+    ~StreamRecorder();
+    bool open(const QString& fileName);
+    void writeFormat(qint64 time, bool binary);
+    void writeData(qint64 time, const char* data, int size);
+    QString fileName() const;
+
+private:
+    QFile m_file;
+    qint64 m_last_time;
+
+    void writeChunk(RecordType type, qint64 time, const char* data, int size);
+};
+
+
+
+///
+/// \brief Lee una grabación bloque a bloque.
+///
+class StreamPlayer
+{
+public:
+    bool open(const QString& fileName);
+    bool next(RecordChunk& chunk);
+
+private:
+    QFile m_file;
+    qint64 m_time;
+
+    bool readVarint(quint64& value);
+};
@@ -0,0 +1,231 @@
+#include "telemetrydecoder.h"
+
+#include <cctype>
+#include <cstring>
+
+
+
+///
+/// \brief Compara una respuesta con un texto, sin distinguir mayúsculas ni los espacios de los extremos.
+/// \param line Bytes de la respuesta.
+/// \param size Número de bytes.
+/// \param key Texto en minúsculas.
+/// \return Verdadero si coinciden.
+///
+static bool ResponseIs(const char* line, int size, const char* key)
+{
+    while((size > 0) && isspace(static_cast<unsigned char>(*line))) { ++line; --size; }
+    while((size > 0) && isspace(static_cast<unsigned char>(line[size - 1]))) --size;
+    const int length = int(strlen(key));
+    if(size != length) return false;
+    for(int i=0 ; i<size ; ++i) {
+        if(tolower(static_cast<unsigned char>(line[i])) != key[i]) return false;
+    }
+    return true;
+}
+
+
+
+///
+/// \brief Constructor, en formato de texto y sin manejadores.
+///
+TelemetryDecoder::TelemetryDecoder() : m_infer_format(false)
+{
+    reset();
+}
+
+
+
+///
+/// \brief Indica a quién se entregan las muestras y las respuestas.
+/// \param onSample Manejador de cada muestra decodificada.
+/// \param onResponse Manejador de cada línea que no es una muestra.
+///
+void TelemetryDecoder::setHandlers(SampleHandler onSample, ResponseHandler onResponse)
+{
+    m_on_sample = onSample;
+    m_on_response = onResponse;
+}
+
+
+
+///
+/// \brief Vuelve al formato de texto y descarta los bytes a medio decodificar.
+///
+void TelemetryDecoder::reset()
+{
+    m_binary = false;
+    m_pending_format = -1;
+    m_frames.reset();
+    m_frame_errors = 0;
+    m_line_size = 0;
+    m_line_overflow = false;
+}
+
+
+
+///
+/// \brief Cambia el formato activo.
+/// \param binary Verdadero para tramas binarias.
+///
+void TelemetryDecoder::setBinary(bool binary)
+{
+    if(binary != m_binary) {
+        m_binary = binary;
+        m_line_size = 0;
+        m_line_overflow = false;
+    }
+}
+
+
+
+///
+/// \brief Formato activo.
+/// \return Verdadero si la telemetría llega en tramas binarias.
+///
+bool TelemetryDecoder::binary() const
+{
+    return m_binary;
+}
+
+
+
+///
+/// \brief Deduce los cambios de formato de las respuestas, en vez de esperar a setBinary().
+///
+/// El IMU contesta a "format bin" o "format txt" repitiendo el comando y "ready" todavía en el formato
+/// anterior; el cambio se aplica al llegar ese "ready".
+/// \param infer Verdadero para deducirlos, como al leer una grabación.
+///
+void TelemetryDecoder::setInferFormat(bool infer)
+{
+    m_infer_format = infer;
+    m_pending_format = -1;
+}
+
+
+
+///
+/// \brief Pasa los bytes recibidos al decodificador del formato activo.
+/// \param data Bytes recibidos.
+/// \param size Número de bytes.
+///
+void TelemetryDecoder::decode(const char* data, int size)
+{
+    if(m_binary) decodeFrames(data, size);
+    else decodeLines(data, size);
+}
+
+
+
+///
+/// \brief Número de tramas descartadas por longitud o CRC erróneos desde el último reset().
+///
+uint64_t TelemetryDecoder::frameErrors() const
+{
+    return m_frame_errors + m_frames.errors();
+}
+
+
+
+///
+/// \brief Trocea los bytes recibidos en líneas de texto.
+/// \param data Bytes recibidos.
+/// \param size Número de bytes.
+///
+void TelemetryDecoder::decodeLines(const char* data, int size)
+{
+    for(int i=0 ; i<size ; ++i) {
+        if(data[i] == '\n') {
+            if(!m_line_overflow) processLine(m_line, m_line_size);
+            m_line_size = 0;
+            m_line_overflow = false;
+
+            // Si la línea ha cambiado el formato, el resto de bytes ya viene en tramas binarias
+            if(m_binary) {
+                decodeFrames(data + i + 1, size - i - 1);
+                return;
+            }
+        }
+        else if(m_line_size < int(sizeof(m_line))) {
+            m_line[m_line_size++] = data[i];
+        }
+        else {
+            m_line_overflow = true;
+        }
+    }
+}
+
+
+
+///
+/// \brief Extrae las tramas binarias de los bytes recibidos.
+/// \param data Bytes recibidos.
+/// \param size Número de bytes.
+///
+void TelemetryDecoder::decodeFrames(const char* data, int size)
+{
+    TelemetrySample sample;
+    int offset = 0;
+    while(offset < size) {
+        offset += m_frames.append(data + offset, size - offset);
+        FrameDecoder::Result result;
+        while((result = m_frames.next(sample)) != FrameDecoder::None) {
+            if(result == FrameDecoder::Sample) {
+                if(m_on_sample) m_on_sample(sample);
+                continue;
+            }
+            processResponse(m_frames.text(), m_frames.textSize());
+
+            // Si la respuesta ha vuelto al formato de texto, los bytes pendientes son texto
+            if(!m_binary) {
+                char pending[FrameDecoder::Capacity];
+                const int pendingSize = m_frames.pendingSize();
+                memcpy(pending, m_frames.pendingData(), pendingSize);
+                m_frame_errors += m_frames.errors();
+                m_frames.reset();
+                decodeLines(pending, pendingSize);
+                decodeLines(data + offset, size - offset);
+                return;
+            }
+        }
+    }
+}
+
+
+
+///
+/// \brief Interpreta una línea de texto completa.
+/// \param line Bytes de la línea, sin el fin de línea.
+/// \param size Número de bytes.
+///
+void TelemetryDecoder::processLine(const char* line, int size)
+{
+    TelemetrySample sample;
+    if(ParseTelemetry(line, size, sample)) {
+        if(m_on_sample) m_on_sample(sample);
+    }
+    else {
+        processResponse(line, size);
+    }
+}
+
+
+
+///
+/// \brief Entrega una línea de respuesta y, si se pide, deduce de ella el cambio de formato.
+/// \param line Bytes de la línea.
+/// \param size Número de bytes.
+///
+void TelemetryDecoder::processResponse(const char* line, int size)
+{
+    if(m_infer_format) {
+        if(ResponseIs(line, size, "format bin")) m_pending_format = 1;
+        else if(ResponseIs(line, size, "format txt")) m_pending_format = 0;
+        else if((m_pending_format >= 0) && ResponseIs(line, size, "ready")) {
+            setBinary(m_pending_format == 1);
+            m_pending_format = -1;
+        }
+    }
+    if(m_on_response) m_on_response(line, size);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <functional>
+
+#include "binaryprotocol.h"
+
+
+
+///
+/// \brief Decodificador de la telemetría del IMU, en texto o en tramas binarias.
+///
+/// Recibe los bytes tal como llegan del puerto serie o de una grabación y entrega las muestras y las
+/// líneas de respuesta a los comandos. El formato activo lo cambia quien recibe las respuestas, con
+/// setBinary(), incluso desde dentro del propio manejador: los bytes que quedan del bloque ya se
+/// interpretan con el formato nuevo. Al leer una grabación no hay comandos en curso, y con
+/// setInferFormat() el propio decodificador deduce los cambios de formato de las respuestas.
+///
+class TelemetryDecoder
+{
+public:
+    typedef std::function<void(TelemetrySample&)> SampleHandler;
+    typedef std::function<void(const char*, int)> ResponseHandler;
+
+    TelemetryDecoder();
+    void setHandlers(SampleHandler onSample, ResponseHandler onResponse);
+    void reset();
+    void setBinary(bool binary);
+    bool binary() const;
+    void setInferFormat(bool infer);
+    void decode(const char* data, int size);
+    uint64_t frameErrors() const;
+
+private:
+    SampleHandler m_on_sample;
+    ResponseHandler m_on_response;
+    bool m_binary;
+    bool m_infer_format;
+    int m_pending_format;
+    FrameDecoder m_frames;
+    uint64_t m_frame_errors;
+    char m_line[256];
+    int m_line_size;
+    bool m_line_overflow;
+
+    void decodeLines(const char* data, int size);
+    void decodeFrames(const char* data, int size);
+    void processLine(const char* line, int size);
+    void processResponse(const char* line, int size);
+};